@@ -2,7 +2,9 @@
 
 #include <chrono>
 
+#include "MainThread.h"
 #include "Renderer.h"
+#include "ThreadPool.h"
 
 namespace Ash {
 
@@ -17,7 +19,9 @@ void App::init() {
 
   // Startup systems
   Log::init();
+  MainThread::init();
   Window::init();
+  ThreadPool::init();
 
   // Initialize window
   instance->window = Window::create({
@@ -45,6 +49,7 @@ void App::cleanup() {
   Renderer::cleanup();
   instance->window->destroy();
   Window::cleanup();
+  ThreadPool::cleanup();
 
   for (auto system : instance->systems)
     delete system;
@@ -62,8 +67,7 @@ void App::setScene(std::shared_ptr<Scene> scene) {
   // Record command buffers with scene data
 
   // Set App reference to scene
-  // Allow for user to make systems that update on certain components
-  // Maybe hand raw entt iterable to user for ultimate control?
+  // Systems registered on the scene run every frame, see Scene::addSystem
 }
 
 void App::run() {
@@ -75,9 +79,16 @@ void App::run() {
   uint32_t frames = 0;
 
   while (!window->shouldClose()) {
+    // Resumes asynchronous loads waiting for the main thread
+    MainThread::update();
+
     for (auto system : systems)
       system->onUpdate();
 
+    std::shared_ptr<Scene> scene = Renderer::getScene();
+    if (scene)
+      scene->updateSystems();
+
     Renderer::render();
 
     window->swapBuffers();
@@ -98,6 +109,8 @@ void App::run() {
 
     if (frametime >= 1000.0f) {
       ASH_INFO("Average frame time: {} ms", (float)frametime / (float)frames);
+      if (scene)
+        scene->logSystemTimings();
 
       now = std::chrono::high_resolution_clock::now();
       frames = 0;
@@ -0,0 +1,252 @@
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+#include "Hash.h"
+#include "Log.h"
+
+namespace Ash {
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+bool AssetPack::open(const std::string &path) {
+  header = nullptr;
+
+  if (!file.open(path))
+    return false;
+
+  uint64_t size = file.size();
+  if (size < sizeof(AssetPackHeader)) {
+    ASH_WARN("Asset pack {} is truncated", path);
+    return false;
+  }
+
+  const AssetPackHeader *candidate =
+      reinterpret_cast<const AssetPackHeader *>(file.data());
+  if (std::memcmp(candidate->magic, ASSET_PACK_MAGIC, 4) != 0 ||
+      candidate->version != ASSET_PACK_VERSION) {
+    ASH_WARN("Asset pack {} has an unsupported version, re-cook it", path);
+    return false;
+  }
+
+  auto fits = [size](uint64_t offset, uint64_t count, uint64_t stride) {
+    return offset <= size && count <= (size - offset) / stride;
+  };
+
+  bool valid =
+      candidate->fileSize == size &&
+      fits(candidate->meshOffset, candidate->meshCount,
+           sizeof(AssetPackMesh)) &&
+      fits(candidate->materialOffset, candidate->materialCount,
+           sizeof(AssetPackMaterial)) &&
+      fits(candidate->textureOffset, candidate->textureCount,
+           sizeof(AssetPackTexture)) &&
+      fits(candidate->dependencyOffset, candidate->dependencyCount,
+           sizeof(AssetPackDependency)) &&
+      candidate->stringOffset <= size;
+
+  if (valid) {
+    header = candidate;
+    for (const AssetPackMesh &mesh : getMeshes()) {
+      uint64_t blobSize = mesh.vertexSize + mesh.indexCount * sizeof(uint32_t);
+      if (!fits(mesh.dataOffset, blobSize, 1) ||
+          mesh.material >= candidate->materialCount)
+        valid = false;
+    }
+  }
+
+  if (!valid) {
+    ASH_WARN("Asset pack {} is corrupt", path);
+    header = nullptr;
+    file.close();
+    return false;
+  }
+
+  return true;
+}
+
+std::span<const AssetPackMesh> AssetPack::getMeshes() const {
+  return getTable<AssetPackMesh>(header->meshOffset, header->meshCount);
+}
+
+std::span<const AssetPackMaterial> AssetPack::getMaterials() const {
+  return getTable<AssetPackMaterial>(header->materialOffset,
+                                     header->materialCount);
+}
+
+std::span<const AssetPackTexture> AssetPack::getTextures() const {
+  return getTable<AssetPackTexture>(header->textureOffset,
+                                    header->textureCount);
+}
+
+std::span<const AssetPackDependency> AssetPack::getDependencies() const {
+  return getTable<AssetPackDependency>(header->dependencyOffset,
+                                       header->dependencyCount);
+}
+
+std::string_view AssetPack::getString(AssetPackString string) const {
+  uint64_t offset = header->stringOffset + string.offset;
+  if (offset + string.length > file.size())
+    return {};
+  return {file.data() + offset, string.length};
+}
+
+void AssetPack::adviseMeshData() const {
+  if (header->meshCount == 0)
+    return;
+
+  uint64_t start = getMeshes().front().dataOffset;
+  file.advise(MappedFileAccess::WillNeed, start, file.size() - start);
+}
+
+uint64_t hashAssetPackSource(const std::string &path) {
+  MappedFile source(path);
+  if (!source.isOpen())
+    return 0;
+  return hash64(source.data(), source.size());
+}
+
+uint64_t hashAssetPackSources(const std::vector<AssetPackSource> &sources,
+                              uint32_t importFlags) {
+  uint64_t hash = hashCombine(
+      hashCombine(ASSET_PACK_VERSION, ASSET_PACK_IMPORTER_VERSION),
+      importFlags);
+  for (const AssetPackSource &source : sources)
+    hash = hashCombine(hash, source.hash);
+  return hash;
+}
+
+bool writeAssetPack(const std::string &path, const ImportedModel &model,
+                    uint64_t sourceHash,
+                    const std::vector<AssetPackSource> &sources) {
+  std::string strings;
+  auto addString = [&strings](const std::string &string) {
+    AssetPackString ref{static_cast<uint32_t>(strings.size()),
+                        static_cast<uint32_t>(string.size())};
+    strings += string;
+    return ref;
+  };
+
+  // Materials commonly share textures, each path is stored once
+  std::vector<AssetPackTexture> textures;
+  std::vector<AssetPackMaterial> materials;
+  std::unordered_map<std::string, uint32_t> textureIndices;
+  for (const std::string &texture : model.materials) {
+    if (texture.empty()) {
+      materials.push_back({ASSET_PACK_NO_TEXTURE});
+      continue;
+    }
+
+    auto [it, inserted] = textureIndices.try_emplace(
+        texture, static_cast<uint32_t>(textures.size()));
+    if (inserted)
+      textures.push_back({addString(texture)});
+    materials.push_back({it->second});
+  }
+
+  std::vector<AssetPackDependency> dependencies;
+  for (const AssetPackSource &source : sources)
+    dependencies.push_back({addString(source.path), source.hash});
+
+  AssetPackHeader header{};
+  std::memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+  header.version = ASSET_PACK_VERSION;
+  header.sourceHash = sourceHash;
+  header.meshCount = static_cast<uint32_t>(model.meshes.size());
+  header.materialCount = static_cast<uint32_t>(materials.size());
+  header.textureCount = static_cast<uint32_t>(textures.size());
+  header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+
+  // Tables are kept 8 byte aligned so they can be read in place
+  uint64_t offset = sizeof(AssetPackHeader);
+  header.meshOffset = offset;
+  offset += header.meshCount * sizeof(AssetPackMesh);
+  header.materialOffset = offset = alignOffset(offset, 8);
+  offset += header.materialCount * sizeof(AssetPackMaterial);
+  header.textureOffset = offset = alignOffset(offset, 8);
+  offset += header.textureCount * sizeof(AssetPackTexture);
+  header.dependencyOffset = offset = alignOffset(offset, 8);
+  offset += header.dependencyCount * sizeof(AssetPackDependency);
+  header.stringOffset = offset;
+  offset += strings.size();
+
+  std::vector<AssetPackMesh> meshes;
+  meshes.reserve(model.meshes.size());
+  for (const ImportedMesh &mesh : model.meshes) {
+    AssetPackMesh &entry = meshes.emplace_back();
+    entry.dataOffset = offset = alignOffset(offset, ASSET_PACK_ALIGNMENT);
+    entry.vertexSize = mesh.vertices.size() * sizeof(Vertex);
+    entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    entry.material = mesh.material;
+    for (int i = 0; i < 3; i++) {
+      entry.boundsMin[i] = mesh.boundsMin[i];
+      entry.boundsMax[i] = mesh.boundsMax[i];
+    }
+
+    offset += entry.vertexSize + mesh.indices.size() * sizeof(uint32_t);
+  }
+  header.fileSize = offset;
+
+  std::string temporaryPath = path + ".tmp";
+  std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    ASH_WARN("Failed to open {} for writing", temporaryPath);
+    return false;
+  }
+
+  uint64_t written = 0;
+  auto write = [&](uint64_t at, const void *data, size_t size) {
+    static const char zeros[ASSET_PACK_ALIGNMENT] = {};
+    while (written < at) {
+      size_t padding = std::min<uint64_t>(at - written, sizeof(zeros));
+      out.write(zeros, padding);
+      written += padding;
+    }
+    out.write(static_cast<const char *>(data), size);
+    written += size;
+  };
+
+  write(0, &header, sizeof(header));
+  write(header.meshOffset, meshes.data(),
+        meshes.size() * sizeof(AssetPackMesh));
+  write(header.materialOffset, materials.data(),
+        materials.size() * sizeof(AssetPackMaterial));
+  write(header.textureOffset, textures.data(),
+        textures.size() * sizeof(AssetPackTexture));
+  write(header.dependencyOffset, dependencies.data(),
+        dependencies.size() * sizeof(AssetPackDependency));
+  write(header.stringOffset, strings.data(), strings.size());
+
+  for (size_t i = 0; i < model.meshes.size(); i++) {
+    const ImportedMesh &mesh = model.meshes[i];
+    write(meshes[i].dataOffset, mesh.vertices.data(), meshes[i].vertexSize);
+    write(written, mesh.indices.data(),
+          mesh.indices.size() * sizeof(uint32_t));
+  }
+
+  out.close();
+
+  std::error_code error;
+  if (out.fail() || written != header.fileSize ||
+      !syncFile(temporaryPath)) {
+    ASH_WARN("Failed to write {}", temporaryPath);
+    std::filesystem::remove(temporaryPath, error);
+    return false;
+  }
+
+  std::filesystem::rename(temporaryPath, path, error);
+  if (error) {
+    ASH_WARN("Failed to replace {}: {}", path, error.message());
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace Ash
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Helper.h"
+#include "MappedFile.h"
+
+namespace Ash {
+
+// Cooked model written by ash-cook. Tables and blobs are addressed by byte
+// offset from the start of the file. Each mesh blob holds its vertices
+// followed by its indices, exactly as the GPU buffer is laid out, and starts
+// on an ASSET_PACK_ALIGNMENT boundary so it can be uploaded from the mapping
+constexpr char ASSET_PACK_MAGIC[4] = {'A', 'S', 'H', 'P'};
+constexpr uint32_t ASSET_PACK_VERSION = 1;
+constexpr uint64_t ASSET_PACK_ALIGNMENT = 16;
+constexpr uint32_t ASSET_PACK_NO_TEXTURE = UINT32_MAX;
+
+// Part of the source hash, bumped whenever the importers give different
+// output for the same sources so older packs are re-cooked. 2 is the switch
+// from Assimp to the native importers
+constexpr uint32_t ASSET_PACK_IMPORTER_VERSION = 2;
+
+struct AssetPackString {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct AssetPackHeader {
+  char magic[4];
+  uint32_t version;
+
+  // Combined hash of the cook settings and every source file, re-cooking is
+  // skipped while it matches
+  uint64_t sourceHash;
+
+  uint32_t meshCount;
+  uint32_t materialCount;
+  uint32_t textureCount;
+  uint32_t dependencyCount;
+
+  uint64_t meshOffset;
+  uint64_t materialOffset;
+  uint64_t textureOffset;
+  uint64_t dependencyOffset;
+  uint64_t stringOffset;
+  uint64_t fileSize;
+};
+
+struct AssetPackMesh {
+  uint64_t dataOffset;
+  uint64_t vertexSize;
+  uint32_t indexCount;
+  uint32_t material;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+struct AssetPackMaterial {
+  uint32_t diffuseTexture;
+};
+
+// Path relative to the source model, packs are expected to sit next to the
+// model they were cooked from
+struct AssetPackTexture {
+  AssetPackString path;
+};
+
+struct AssetPackDependency {
+  AssetPackString path;
+  uint64_t hash;
+};
+
+// Read-only view of a pack mapped into memory, valid while it is open
+class AssetPack {
+public:
+  // Fails on a missing file, a different version or tables that run past the
+  // end of the file
+  bool open(const std::string &path);
+
+  inline const AssetPackHeader &getHeader() const { return *header; }
+
+  std::span<const AssetPackMesh> getMeshes() const;
+  std::span<const AssetPackMaterial> getMaterials() const;
+  std::span<const AssetPackTexture> getTextures() const;
+  std::span<const AssetPackDependency> getDependencies() const;
+
+  std::string_view getString(AssetPackString string) const;
+  inline const char *getData(uint64_t offset) const {
+    return file.data() + offset;
+  }
+
+  // Prefetches the blobs of every mesh ahead of uploading them
+  void adviseMeshData() const;
+
+private:
+  template <typename T>
+  std::span<const T> getTable(uint64_t offset, uint32_t count) const {
+    return {reinterpret_cast<const T *>(file.data() + offset), count};
+  }
+
+  MappedFile file;
+  const AssetPackHeader *header{nullptr};
+};
+
+struct AssetPackSource {
+  std::string path;
+  uint64_t hash;
+};
+
+// Hashes a source file's contents, 0 if it can't be read
+uint64_t hashAssetPackSource(const std::string &path);
+uint64_t hashAssetPackSources(const std::vector<AssetPackSource> &sources,
+                              uint32_t importFlags);
+
+// Writes into a temporary file that is synced to disk and renamed over the
+// old pack, neither a failed cook nor a crash leaves a truncated pack behind
+bool writeAssetPack(const std::string &path, const ImportedModel &model,
+                    uint64_t sourceHash,
+                    const std::vector<AssetPackSource> &sources);
+
+} // namespace Ash
@@ -28,23 +28,23 @@ struct Transform {
   }
 };
 
+// Per-object GPU resources are pooled by the renderer, the slot and the model
+// reference are given back when the component is destroyed
 struct Renderable {
-  std::vector<UniformBuffer> ubos;
-  std::vector<std::vector<vk::DescriptorSet>> descriptorSets;
-
-  Renderable(const std::string &model, const std::string &pipeline)
-      : model(model), pipeline(pipeline) {
-    Renderer::getAPI()->createUniformBuffers(ubos,
-                                             sizeof(RenderableBufferObject));
-    descriptorSets.resize(Renderer::getModel(model).meshes.size());
-    for (uint32_t i = 0; i < Renderer::getModel(model).meshes.size(); i++) {
-      Renderer::getAPI()->createRenderableDescriptorSets(
-          descriptorSets[i], ubos, Renderer::getModel(model).materials[i]);
-    }
+  Renderable(const std::string &model, const std::string &pipeline,
+             uint32_t variant = 0)
+      : Renderable(Renderer::findModel(model),
+                   Renderer::findPipeline(pipeline, variant)) {}
+
+  Renderable(ModelHandle model, PipelineHandle pipeline)
+      : model(model), pipeline(pipeline),
+        resources(Renderer::getAPI()->acquireRenderableResources()) {
+    Renderer::acquireModel(model);
   }
 
-  std::string model;
-  std::string pipeline;
+  ModelHandle model;
+  PipelineHandle pipeline;
+  uint32_t resources;
 };
 
 } // namespace Ash
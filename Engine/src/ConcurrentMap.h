@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Ash {
+
+// Hash map for lookups from any thread that rarely change, like resource
+// names. Keys are spread over shards, each a bucket array of immutable
+// chained nodes published through shared pointers. Writers link a new node
+// in front of its bucket, changing or erasing a key only copies the nodes
+// ahead of it in the chain and the bucket array is rebuilt when it doubles,
+// so a write costs amortized constant time. A reader sees either all or none
+// of a change. Readers don't wait for writers, they only take references to
+// the current array and chain under the standard library's short internal
+// lock for atomic shared_ptr access. Values are returned by copy since their
+// node may be replaced right after
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ConcurrentMap {
+public:
+  bool find(const K &key, V &value) const {
+    size_t hash = Hash{}(key);
+    NodePointer node = findNode(loadChain(getShard(hash), hash), key);
+    if (!node)
+      return false;
+
+    value = node->value;
+    return true;
+  }
+
+  bool contains(const K &key) const {
+    size_t hash = Hash{}(key);
+    return findNode(loadChain(getShard(hash), hash), key) != nullptr;
+  }
+
+  // Keeps the existing value if there is one, returns whichever is stored
+  V insert(const K &key, const V &value) {
+    size_t hash = Hash{}(key);
+    Shard &shard = getShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    NodePointer head = loadChain(shard, hash);
+    if (NodePointer node = findNode(head, key))
+      return node->value;
+
+    link(shard, hash, std::move(head), key, value);
+    return value;
+  }
+
+  void assign(const K &key, const V &value) {
+    size_t hash = Hash{}(key);
+    Shard &shard = getShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    NodePointer head = loadChain(shard, hash);
+    if (!replace(shard, hash, head, key, [&](const Node &node) {
+          return std::make_shared<const Node>(key, value, node.next);
+        }))
+      link(shard, hash, std::move(head), key, value);
+  }
+
+  bool erase(const K &key) {
+    size_t hash = Hash{}(key);
+    Shard &shard = getShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    return unlink(shard, hash, loadChain(shard, hash), key);
+  }
+
+  // Only erases the key while it still maps to value
+  bool erase(const K &key, const V &value) {
+    size_t hash = Hash{}(key);
+    Shard &shard = getShard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    NodePointer head = loadChain(shard, hash);
+    NodePointer node = findNode(head, key);
+    return node && node->value == value &&
+           unlink(shard, hash, std::move(head), key);
+  }
+
+  // Erases every entry for which predicate(key, value) holds
+  template <typename P> void eraseIf(P &&predicate) {
+    for (Shard &shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+
+      std::shared_ptr<Buckets> buckets = shard.buckets;
+      for (NodePointer &bucket : buckets->heads) {
+        NodePointer head = std::atomic_load(&bucket);
+
+        // Chains without a match are left as they are
+        std::vector<const Node *> kept;
+        bool matched = false;
+        for (NodePointer node = head; node; node = node->next) {
+          if (predicate(node->key, node->value))
+            matched = true;
+          else
+            kept.push_back(node.get());
+        }
+        if (!matched)
+          continue;
+
+        NodePointer chain;
+        for (auto it = kept.rbegin(); it != kept.rend(); it++)
+          chain = std::make_shared<const Node>((*it)->key, (*it)->value,
+                                               std::move(chain));
+        shard.size -= countChain(head) - kept.size();
+        std::atomic_store(&bucket, std::move(chain));
+      }
+    }
+  }
+
+private:
+  static constexpr size_t SHARD_COUNT = 16;
+  static constexpr size_t INITIAL_BUCKETS = 8;
+
+  struct Node {
+    Node(const K &key, const V &value, std::shared_ptr<const Node> next)
+        : key(key), value(value), next(std::move(next)) {}
+
+    K key;
+    V value;
+    std::shared_ptr<const Node> next;
+  };
+
+  using NodePointer = std::shared_ptr<const Node>;
+
+  // The array itself never changes size, writers swap in a larger one. Heads
+  // are only accessed through std::atomic_load and std::atomic_store, since
+  // std::atomic<std::shared_ptr> isn't available everywhere yet
+  struct Buckets {
+    explicit Buckets(size_t count) : heads(count) {}
+
+    std::vector<NodePointer> heads;
+  };
+
+  struct Shard {
+    // Only replaced with std::atomic_store, by writers holding the mutex
+    std::shared_ptr<Buckets> buckets{
+        std::make_shared<Buckets>(INITIAL_BUCKETS)};
+    size_t size{0};
+
+    // Serializes writers, readers never take it
+    std::mutex mutex;
+  };
+
+  // The low bits pick the shard, the rest the bucket, counts are powers of 2
+  Shard &getShard(size_t hash) { return shards[hash % SHARD_COUNT]; }
+  const Shard &getShard(size_t hash) const {
+    return shards[hash % SHARD_COUNT];
+  }
+
+  static NodePointer &getBucket(Buckets &buckets, size_t hash) {
+    return buckets.heads[(hash / SHARD_COUNT) & (buckets.heads.size() - 1)];
+  }
+
+  static NodePointer loadChain(const Shard &shard, size_t hash) {
+    std::shared_ptr<Buckets> buckets = std::atomic_load(&shard.buckets);
+    return std::atomic_load(&getBucket(*buckets, hash));
+  }
+
+  static NodePointer findNode(NodePointer node, const K &key) {
+    while (node && !(node->key == key))
+      node = node->next;
+    return node;
+  }
+
+  static size_t countChain(NodePointer node) {
+    size_t count = 0;
+    for (; node; node = node->next)
+      count++;
+    return count;
+  }
+
+  // Adds a key that isn't in head's chain, doubling the buckets once there
+  // are more keys than buckets
+  void link(Shard &shard, size_t hash, NodePointer head, const K &key,
+            const V &value) {
+    Buckets &buckets = *shard.buckets;
+    auto node = std::make_shared<const Node>(key, value, std::move(head));
+    std::atomic_store(&getBucket(buckets, hash), std::move(node));
+
+    if (++shard.size > buckets.heads.size())
+      grow(shard);
+  }
+
+  // Rebuilds every chain into an array twice the size, readers keep using
+  // the old one until the new one is published
+  void grow(Shard &shard) {
+    auto grown = std::make_shared<Buckets>(shard.buckets->heads.size() * 2);
+    for (NodePointer &bucket : shard.buckets->heads) {
+      for (NodePointer node = std::atomic_load(&bucket); node;
+           node = node->next) {
+        NodePointer &head = getBucket(*grown, Hash{}(node->key));
+        head = std::make_shared<const Node>(node->key, node->value, head);
+      }
+    }
+    std::atomic_store(&shard.buckets, std::move(grown));
+  }
+
+  // Swaps the node of key in head's chain for whatever rebuild(node) returns
+  // to continue the chain, copying the nodes in front of it. Returns whether
+  // the key was found
+  template <typename F>
+  bool replace(Shard &shard, size_t hash, NodePointer head, const K &key,
+               F &&rebuild) {
+    std::vector<const Node *> ahead;
+    NodePointer node = head;
+    for (; node && !(node->key == key); node = node->next)
+      ahead.push_back(node.get());
+    if (!node)
+      return false;
+
+    NodePointer chain = rebuild(*node);
+    for (auto it = ahead.rbegin(); it != ahead.rend(); it++)
+      chain = std::make_shared<const Node>((*it)->key, (*it)->value,
+                                           std::move(chain));
+    std::atomic_store(&getBucket(*shard.buckets, hash), std::move(chain));
+    return true;
+  }
+
+  bool unlink(Shard &shard, size_t hash, NodePointer head, const K &key) {
+    if (!replace(shard, hash, std::move(head), key,
+                 [](const Node &node) { return node.next; }))
+      return false;
+
+    shard.size--;
+    return true;
+  }
+
+  std::array<Shard, SHARD_COUNT> shards;
+};
+
+} // namespace Ash
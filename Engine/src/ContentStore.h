@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "SlotMap.h"
+
+namespace Ash {
+
+// Content addressed index of resources in a SlotMap. Keys only narrow down
+// the candidates, a resource is shared once the caller has compared the
+// actual data, so a key collision never aliases different content. Several
+// resources can sit under one key. Only used from the main thread
+template <typename T> class ContentStore {
+public:
+  // First resource under key that matches(handle) confirms, an invalid
+  // handle if there is none
+  template <typename F> Handle<T> find(uint64_t key, F &&matches) const {
+    auto [begin, end] = entries.equal_range(key);
+    for (auto it = begin; it != end; it++)
+      if (matches(it->second))
+        return it->second;
+    return {};
+  }
+
+  inline bool contains(uint64_t key) const { return entries.contains(key); }
+
+  void insert(uint64_t key, Handle<T> handle) { entries.emplace(key, handle); }
+
+  // Other resources under the same key stay
+  void erase(uint64_t key, Handle<T> handle) {
+    auto [begin, end] = entries.equal_range(key);
+    for (auto it = begin; it != end; it++) {
+      if (it->second == handle) {
+        entries.erase(it);
+        return;
+      }
+    }
+  }
+
+  inline size_t size() const { return entries.size(); }
+
+private:
+  std::unordered_multimap<uint64_t, Handle<T>> entries;
+};
+
+} // namespace Ash
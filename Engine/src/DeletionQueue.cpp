@@ -0,0 +1,27 @@
+#include "DeletionQueue.h"
+
+#include <utility>
+
+namespace Ash {
+
+void DeletionQueue::push(uint64_t frame, std::function<void()> deleter) {
+  deleters.push_back({frame, std::move(deleter)});
+}
+
+void DeletionQueue::flush(uint64_t completedFrame) {
+  // Entries are pushed with non-decreasing frames, so the front is always the
+  // oldest
+  while (!deleters.empty() && deleters.front().frame <= completedFrame) {
+    deleters.front().deleter();
+    deleters.pop_front();
+  }
+}
+
+void DeletionQueue::flushAll() {
+  while (!deleters.empty()) {
+    deleters.front().deleter();
+    deleters.pop_front();
+  }
+}
+
+} // namespace Ash
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace Ash {
+
+// Defers destroying GPU objects until the last frame that may still use them
+// has completed on the device
+class DeletionQueue {
+public:
+  // frame is the last submitted frame that can reference the object
+  void push(uint64_t frame, std::function<void()> deleter);
+
+  // Runs the deleters of every frame up to and including completedFrame
+  void flush(uint64_t completedFrame);
+  void flushAll();
+
+  inline size_t size() const { return deleters.size(); }
+
+private:
+  struct Entry {
+    uint64_t frame;
+    std::function<void()> deleter;
+  };
+
+  std::deque<Entry> deleters;
+};
+
+} // namespace Ash
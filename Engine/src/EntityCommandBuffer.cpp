@@ -0,0 +1,186 @@
+#include "EntityCommandBuffer.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "Core.h"
+#include "Log.h"
+#include "MainThread.h"
+#include "ThreadPool.h"
+
+namespace Ash {
+
+static thread_local uint64_t sortKey = 0;
+
+EntityCommandBuffer::EntityCommandBuffer() {
+  for (uint32_t i = 0; i <= ThreadPool::getThreadCount(); i++)
+    threads.push_back(std::make_unique<ThreadCommands>());
+}
+
+EntityCommandBuffer::~EntityCommandBuffer() {}
+
+void EntityCommandBuffer::setSortKey(uint64_t key) { sortKey = key; }
+
+uint64_t EntityCommandBuffer::getSortKey() { return sortKey; }
+
+uint64_t EntityCommandBuffer::beginParallelPass() {
+  constexpr uint64_t pass = 1ull << SORT_KEY_PASS_SHIFT;
+
+  ASH_ASSERT((sortKey & (pass - 1)) == 0,
+             "Parallel passes recording commands can't be nested");
+
+  // The pass sits between what the thread recorded before and after it
+  uint64_t base = sortKey + pass;
+  uint64_t next = base + pass;
+  ASH_ASSERT(next >> SORT_KEY_SYSTEM_SHIFT == sortKey >> SORT_KEY_SYSTEM_SHIFT,
+             "Too many parallel passes in one system");
+
+  sortKey = next;
+  return base;
+}
+
+EntityCommandBuffer::ThreadCommands &EntityCommandBuffer::getThreadCommands() {
+  int32_t worker = ThreadPool::getWorkerIndex();
+  ASH_ASSERT(worker >= 0 || MainThread::isCurrent(),
+             "Entity commands can only be recorded on the main thread or "
+             "the thread pool");
+  ASH_ASSERT(worker + 1 < static_cast<int32_t>(threads.size()),
+             "Command buffer created before the thread pool started");
+  return *threads[worker + 1];
+}
+
+EntityCommandBuffer::Command &
+EntityCommandBuffer::record(ThreadCommands &thread, CommandType type,
+                            entt::entity entity) {
+  Command &command = thread.commands.emplace_back();
+  command.sortKey = sortKey;
+  command.sequence = thread.sequence++;
+  command.type = type;
+  command.entity = entity;
+  command.pending = NOT_PENDING;
+  command.component = NO_COMPONENT;
+  return command;
+}
+
+EntityCommandBuffer::Command &
+EntityCommandBuffer::record(ThreadCommands &thread, CommandType type,
+                            PendingEntity entity) {
+  ASH_ASSERT(entity.playback == playbackCount,
+             "Pending entity used after its command buffer was played back");
+
+  Command &command = record(thread, type, entt::entity{entt::null});
+  command.pending = entity.index;
+  return command;
+}
+
+PendingEntity EntityCommandBuffer::spawn() {
+  PendingEntity entity{pendingCount.fetch_add(1, std::memory_order_relaxed),
+                       playbackCount};
+
+  ThreadCommands &thread = getThreadCommands();
+  record(thread, CommandType::Spawn, entity);
+  return entity;
+}
+
+void EntityCommandBuffer::destroy(Entity entity) {
+  ThreadCommands &thread = getThreadCommands();
+  record(thread, CommandType::Destroy, entity.getHandle());
+}
+
+void EntityCommandBuffer::destroy(PendingEntity entity) {
+  ThreadCommands &thread = getThreadCommands();
+  record(thread, CommandType::Destroy, entity);
+}
+
+bool EntityCommandBuffer::isEmpty() const {
+  return std::all_of(threads.begin(), threads.end(),
+                     [](const std::unique_ptr<ThreadCommands> &thread) {
+                       return thread->commands.empty();
+                     });
+}
+
+void EntityCommandBuffer::playback(entt::registry &registry) {
+  struct Entry {
+    Command *command;
+    ThreadCommands *thread;
+    uint32_t threadIndex;
+  };
+
+  std::vector<Entry> entries;
+  size_t spawnCount = 0;
+  std::unordered_map<ReserveFunction, size_t> componentCounts;
+
+  for (uint32_t i = 0; i < threads.size(); i++) {
+    ThreadCommands &thread = *threads[i];
+    for (Command &command : thread.commands) {
+      entries.push_back({&command, &thread, i});
+      if (command.type == CommandType::Spawn)
+        spawnCount++;
+
+      if (command.component != NO_COMPONENT)
+        if (ReserveFunction reserve =
+                thread.components[command.component].reserve)
+          componentCounts[reserve]++;
+    }
+  }
+
+  if (entries.empty())
+    return;
+
+  // Only commands recorded by plain pool jobs can share a key across
+  // threads, the thread index just keeps the ordering strict for them
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              if (a.command->sortKey != b.command->sortKey)
+                return a.command->sortKey < b.command->sortKey;
+              if (a.threadIndex != b.threadIndex)
+                return a.threadIndex < b.threadIndex;
+              return a.command->sequence < b.command->sequence;
+            });
+
+  // Some of these components replace existing ones, reserving a little too
+  // much is cheaper than growing pools one command at a time
+  registry.reserve(registry.size() + spawnCount);
+  for (auto [reserve, count] : componentCounts)
+    reserve(registry, count);
+
+  std::vector<entt::entity> spawned(spawnCount);
+  registry.create(spawned.begin(), spawned.end());
+
+  // Entities are handed to spawns in playback order, not in the order the
+  // threads happened to reserve their pending indices
+  ASH_ASSERT(pendingCount.load(std::memory_order_relaxed) == spawnCount,
+             "Pending entity count doesn't match the recorded spawns");
+  std::vector<entt::entity> pendingEntities(spawnCount,
+                                           entt::entity{entt::null});
+  size_t nextSpawned = 0;
+  for (const Entry &entry : entries)
+    if (entry.command->type == CommandType::Spawn)
+      pendingEntities[entry.command->pending] = spawned[nextSpawned++];
+
+  for (const Entry &entry : entries) {
+    Command &command = *entry.command;
+    if (command.type == CommandType::Spawn)
+      continue;
+
+    entt::entity entity = command.pending != NOT_PENDING
+                              ? pendingEntities[command.pending]
+                              : command.entity;
+    if (!registry.valid(entity))
+      continue;
+
+    if (command.type == CommandType::Destroy)
+      registry.destroy(entity);
+    else
+      entry.thread->components[command.component].apply(registry, entity);
+  }
+
+  for (std::unique_ptr<ThreadCommands> &thread : threads) {
+    thread->commands.clear();
+    thread->components.clear();
+  }
+  pendingCount.store(0, std::memory_order_relaxed);
+  playbackCount++;
+}
+
+} // namespace Ash
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <entt/entt.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "Entity.h"
+
+namespace Ash {
+
+// Sort keys hold the system in the top 16 bits, the parallel pass of that
+// system in the next 16 and the element of the pass in the low 32
+constexpr uint32_t SORT_KEY_SYSTEM_SHIFT = 48;
+constexpr uint32_t SORT_KEY_PASS_SHIFT = 32;
+
+// Entity spawned by a command buffer that doesn't exist yet. Other commands
+// of the same buffer can target it until the buffer is played back
+struct PendingEntity {
+  uint32_t index;
+  uint32_t playback;
+};
+
+// Records spawns, component changes and destroys from any pool thread and
+// applies them to a registry later, on the main thread. Every thread records
+// into its own buffer without locking. Components are built from their
+// constructor arguments during playback, never on the recording thread.
+//
+// Playback is ordered by sort key, then by the order one thread recorded
+// commands in. The system scheduler keys commands by system and parallelEach
+// by pass and by the entity's position in the view, so the result doesn't
+// depend on which worker ran what. Commands recorded from plain pool jobs
+// inherit whatever key their worker has and aren't ordered. Pools are grown
+// once per component type and new entities are created in one go before
+// anything is applied
+class EntityCommandBuffer {
+public:
+  EntityCommandBuffer();
+  ~EntityCommandBuffer();
+
+  PendingEntity spawn();
+
+  // The component is constructed from args on playback, so components that
+  // talk to the renderer like Renderable are fine. Replaces an existing one
+  template <typename T, typename... Args> void add(Entity entity, Args... args) {
+    ThreadCommands &thread = getThreadCommands();
+    addComponent<T>(thread,
+                    record(thread, CommandType::Add, entity.getHandle()),
+                    std::move(args)...);
+  }
+
+  template <typename T, typename... Args>
+  void add(PendingEntity entity, Args... args) {
+    ThreadCommands &thread = getThreadCommands();
+    addComponent<T>(thread, record(thread, CommandType::Add, entity),
+                    std::move(args)...);
+  }
+
+  template <typename T> void remove(Entity entity) {
+    ThreadCommands &thread = getThreadCommands();
+    removeComponent<T>(thread,
+                       record(thread, CommandType::Remove, entity.getHandle()));
+  }
+
+  template <typename T> void remove(PendingEntity entity) {
+    ThreadCommands &thread = getThreadCommands();
+    removeComponent<T>(thread, record(thread, CommandType::Remove, entity));
+  }
+
+  void destroy(Entity entity);
+  void destroy(PendingEntity entity);
+
+  // Commands for entities destroyed in the meantime are skipped
+  void playback(entt::registry &registry);
+
+  bool isEmpty() const;
+
+  // Key of the commands the calling thread records from now on
+  static void setSortKey(uint64_t key);
+  static uint64_t getSortKey();
+
+  // Reserves the keys of one parallel pass below the calling thread's key.
+  // Element i of the pass records with the returned base + i + 1, commands
+  // the thread records afterwards sort after the whole pass
+  static uint64_t beginParallelPass();
+
+private:
+  enum class CommandType : uint8_t { Spawn, Add, Remove, Destroy };
+
+  static constexpr uint32_t NOT_PENDING = UINT32_MAX;
+
+  using ComponentFunction =
+      std::function<void(entt::registry &, entt::entity)>;
+  using ReserveFunction = void (*)(entt::registry &, size_t);
+
+  struct ComponentCommand {
+    ComponentFunction apply;
+    // Grows the pool by a count of new components, null for removals
+    ReserveFunction reserve;
+  };
+
+  struct Command {
+    uint64_t sortKey;
+    uint64_t sequence;
+    CommandType type;
+
+    // Existing entity, or the index of a pending one
+    entt::entity entity;
+    uint32_t pending;
+
+    // Index in the recording thread's component commands, NO_COMPONENT for
+    // spawns and destroys
+    uint32_t component;
+  };
+
+  static constexpr uint32_t NO_COMPONENT = UINT32_MAX;
+
+  struct ThreadCommands {
+    std::vector<Command> commands;
+    std::vector<ComponentCommand> components;
+    uint64_t sequence{0};
+  };
+
+  template <typename T>
+  static void reserveComponents(entt::registry &registry, size_t count) {
+    registry.reserve<T>(registry.size<T>() + count);
+  }
+
+  template <typename T, typename... Args>
+  void addComponent(ThreadCommands &thread, Command &command, Args... args) {
+    command.component = static_cast<uint32_t>(thread.components.size());
+    thread.components.push_back(
+        {[args = std::make_tuple(std::move(args)...)](
+             entt::registry &registry, entt::entity entity) mutable {
+           std::apply(
+               [&](auto &&...values) {
+                 registry.emplace_or_replace<T>(entity, std::move(values)...);
+               },
+               args);
+         },
+         &reserveComponents<T>});
+  }
+
+  template <typename T>
+  void removeComponent(ThreadCommands &thread, Command &command) {
+    command.component = static_cast<uint32_t>(thread.components.size());
+    thread.components.push_back(
+        {[](entt::registry &registry, entt::entity entity) {
+           registry.remove_if_exists<T>(entity);
+         },
+         nullptr});
+  }
+
+  ThreadCommands &getThreadCommands();
+  Command &record(ThreadCommands &thread, CommandType type,
+                  entt::entity entity);
+  Command &record(ThreadCommands &thread, CommandType type,
+                  PendingEntity entity);
+
+  // Slot 0 is the main thread, worker i records into slot i + 1
+  std::vector<std::unique_ptr<ThreadCommands>> threads;
+
+  // Pending entities handed out since the last playback, and the number of
+  // playbacks so far to catch pending entities kept around for too long
+  std::atomic<uint32_t> pendingCount{0};
+  uint32_t playbackCount{0};
+};
+
+} // namespace Ash
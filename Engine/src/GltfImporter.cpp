@@ -0,0 +1,731 @@
+#include "GltfImporter.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include "Core.h"
+#include "Json.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace Ash::Helper {
+
+static constexpr uint32_t GLB_MAGIC = 0x46546C67;
+static constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+static constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+static constexpr uint32_t MODE_TRIANGLES = 4;
+
+enum ComponentType : uint32_t {
+  Byte = 5120,
+  UnsignedByte = 5121,
+  Short = 5122,
+  UnsignedShort = 5123,
+  UnsignedInt = 5125,
+  Float = 5126,
+};
+
+static uint32_t getComponentSize(uint32_t componentType) {
+  switch (componentType) {
+  case Byte:
+  case UnsignedByte:
+    return 1;
+  case Short:
+  case UnsignedShort:
+    return 2;
+  case UnsignedInt:
+  case Float:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+static uint32_t getComponentCount(const std::string &type) {
+  if (type == "SCALAR")
+    return 1;
+  if (type == "VEC2")
+    return 2;
+  if (type == "VEC3")
+    return 3;
+  if (type == "VEC4" || type == "MAT2")
+    return 4;
+  if (type == "MAT3")
+    return 9;
+  if (type == "MAT4")
+    return 16;
+  return 0;
+}
+
+// Strided view of an accessor's elements inside a mapped buffer
+struct Accessor {
+  const char *data{nullptr};
+  size_t stride{0};
+  uint32_t count{0};
+  uint32_t componentType{0};
+  uint32_t components{0};
+  bool normalized{false};
+
+  inline bool isValid() const { return data; }
+};
+
+static bool isIndexComponentType(uint32_t componentType) {
+  return componentType == UnsignedByte || componentType == UnsignedShort ||
+         componentType == UnsignedInt;
+}
+
+// The accessor has been checked with isIndexComponentType
+static uint32_t readIndex(const Accessor &accessor, uint32_t i) {
+  const char *element = accessor.data + i * accessor.stride;
+  switch (accessor.componentType) {
+  case UnsignedByte:
+    return static_cast<uint8_t>(*element);
+  case UnsignedShort: {
+    uint16_t index;
+    std::memcpy(&index, element, sizeof(index));
+    return index;
+  }
+  default: {
+    uint32_t index;
+    std::memcpy(&index, element, sizeof(index));
+    return index;
+  }
+  }
+}
+
+// Only used for texture coordinates, positions and normals are always floats
+static glm::vec2 readVec2(const Accessor &accessor, uint32_t i) {
+  const char *element = accessor.data + i * accessor.stride;
+  switch (accessor.componentType) {
+  case UnsignedByte:
+    return glm::vec2(static_cast<uint8_t>(element[0]),
+                     static_cast<uint8_t>(element[1])) /
+           255.0f;
+  case UnsignedShort: {
+    uint16_t uv[2];
+    std::memcpy(uv, element, sizeof(uv));
+    return glm::vec2(uv[0], uv[1]) / 65535.0f;
+  }
+  default: {
+    glm::vec2 uv;
+    std::memcpy(&uv, element, sizeof(uv));
+    return uv;
+  }
+  }
+}
+
+static glm::vec3 readVec3(const Accessor &accessor, uint32_t i) {
+  glm::vec3 value;
+  std::memcpy(&value, accessor.data + i * accessor.stride, sizeof(value));
+  return value;
+}
+
+static int decodeBase64Char(char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+static bool decodeBase64(std::string_view text, std::vector<char> &out) {
+  out.reserve(text.size() / 4 * 3);
+
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    if (c == '=')
+      break;
+
+    int value = decodeBase64Char(c);
+    if (value < 0)
+      return false;
+
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back(static_cast<char>((bits >> count) & 0xFF));
+    }
+  }
+
+  return true;
+}
+
+static int decodeHexChar(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// URIs in glTF are percent-encoded, file names with spaces are common
+static std::string decodeUri(const std::string &uri) {
+  std::string decoded;
+  decoded.reserve(uri.size());
+
+  for (size_t i = 0; i < uri.size(); i++) {
+    if (uri[i] == '%' && i + 2 < uri.size()) {
+      int high = decodeHexChar(uri[i + 1]);
+      int low = decodeHexChar(uri[i + 2]);
+      if (high >= 0 && low >= 0) {
+        decoded += static_cast<char>(high * 16 + low);
+        i += 2;
+        continue;
+      }
+    }
+    decoded += uri[i];
+  }
+
+  return decoded;
+}
+
+static glm::mat4 getNodeTransform(const JsonValue &node) {
+  const JsonValue &matrix = node["matrix"];
+  if (matrix.size() == 16) {
+    float values[16];
+    for (uint32_t i = 0; i < 16; i++)
+      values[i] = static_cast<float>(matrix[i].asNumber());
+    return glm::make_mat4(values);
+  }
+
+  const JsonValue &t = node["translation"];
+  const JsonValue &r = node["rotation"];
+  const JsonValue &s = node["scale"];
+
+  glm::vec3 translation(t[0].asNumber(), t[1].asNumber(), t[2].asNumber());
+  glm::quat rotation(static_cast<float>(r[3].asNumber(1.0)),
+                     static_cast<float>(r[0].asNumber()),
+                     static_cast<float>(r[1].asNumber()),
+                     static_cast<float>(r[2].asNumber()));
+  glm::vec3 scale(s[0].asNumber(1.0), s[1].asNumber(1.0), s[2].asNumber(1.0));
+
+  glm::mat4 transform = glm::mat4_cast(rotation);
+  transform[0] *= scale.x;
+  transform[1] *= scale.y;
+  transform[2] *= scale.z;
+  transform[3] = glm::vec4(translation, 1.0f);
+  return transform;
+}
+
+// One primitive to decode, written into its slice of the mesh it belongs to.
+// Flattened primitives are decoded once per node drawing them
+struct PrimitiveInstance {
+  Accessor positions;
+  Accessor normals;
+  Accessor texCoords;
+  Accessor indices;
+
+  glm::mat4 transform;
+  uint32_t mesh;
+  uint32_t firstVertex;
+  uint32_t firstIndex;
+
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+};
+
+class GltfLoader {
+public:
+  GltfLoader(const std::string &file, ImportedModel &model, ImportMode mode)
+      : file(file), directory(getDirectory(file)), model(model), mode(mode) {}
+
+  bool load() {
+    if (!parse() || !loadBuffers())
+      return false;
+
+    loadMaterials();
+
+    if (!collectInstances())
+      return false;
+
+    return decode();
+  }
+
+private:
+  bool parse() {
+    if (!source.open(file))
+      return false;
+
+    model.sourceFiles.push_back(file);
+
+    std::string_view text(source.data(), source.size());
+
+    uint32_t header[3];
+    if (source.size() >= sizeof(header)) {
+      std::memcpy(header, source.data(), sizeof(header));
+      if (header[0] == GLB_MAGIC && !parseBinary(text))
+        return false;
+    }
+
+    std::string error;
+    if (!JsonValue::parse(text, json, &error)) {
+      ASH_WARN("Failed to parse {}: {}", file, error);
+      return false;
+    }
+
+    if (!json["asset"]["version"].asString().starts_with("2")) {
+      ASH_WARN("{} isn't glTF 2.0", file);
+      return false;
+    }
+
+    // Required extensions change how data has to be read, leave them to
+    // Assimp
+    if (json["extensionsRequired"].size() > 0) {
+      ASH_INFO("{} requires glTF extensions", file);
+      return false;
+    }
+
+    return true;
+  }
+
+  // A .glb is a header followed by a JSON chunk and an optional binary chunk
+  // that buffer 0 refers to. text is narrowed to the JSON chunk
+  bool parseBinary(std::string_view &text) {
+    size_t offset = 12;
+    bool foundJson = false;
+
+    while (offset + 8 <= source.size()) {
+      uint32_t chunk[2];
+      std::memcpy(chunk, source.data() + offset, sizeof(chunk));
+      offset += 8;
+
+      if (chunk[0] > source.size() - offset) {
+        ASH_WARN("Truncated chunk in {}", file);
+        return false;
+      }
+
+      if (chunk[1] == GLB_CHUNK_JSON && !foundJson) {
+        text = std::string_view(source.data() + offset, chunk[0]);
+        foundJson = true;
+      } else if (chunk[1] == GLB_CHUNK_BIN && !binaryChunk.data) {
+        binaryChunk = {source.data() + offset, chunk[0]};
+      }
+
+      // Chunks are padded to 4 bytes
+      offset += (chunk[0] + 3) & ~3u;
+    }
+
+    if (!foundJson)
+      ASH_WARN("{} has no JSON chunk", file);
+
+    return foundJson;
+  }
+
+  bool loadBuffers() {
+    for (const JsonValue &buffer : json["buffers"].getValues()) {
+      size_t byteLength = static_cast<size_t>(buffer["byteLength"].asNumber());
+
+      if (!buffer.contains("uri")) {
+        if (!binaryChunk.data || binaryChunk.size < byteLength) {
+          ASH_WARN("Buffer of {} is missing its binary chunk", file);
+          return false;
+        }
+        buffers.push_back(binaryChunk);
+        continue;
+      }
+
+      const std::string &uri = buffer["uri"].asString();
+      if (uri.starts_with("data:")) {
+        size_t comma = uri.find(";base64,");
+        std::vector<char> &data = embedded.emplace_back();
+        if (comma == std::string::npos ||
+            !decodeBase64(std::string_view(uri).substr(comma + 8), data) ||
+            data.size() < byteLength) {
+          ASH_WARN("Invalid data URI in {}", file);
+          return false;
+        }
+        buffers.push_back({data.data(), data.size()});
+        continue;
+      }
+
+      std::string path = directory + decodeUri(uri);
+      MappedFile &mapped = mappedBuffers.emplace_back();
+      if (!mapped.open(path) || mapped.size() < byteLength) {
+        ASH_WARN("Failed to open buffer {} of {}", path, file);
+        return false;
+      }
+
+      model.sourceFiles.push_back(path);
+      buffers.push_back({mapped.data(), mapped.size()});
+    }
+
+    return true;
+  }
+
+  void loadMaterials() {
+    const JsonValue &textures = json["textures"];
+    const JsonValue &images = json["images"];
+
+    for (const JsonValue &material : json["materials"].getValues()) {
+      std::string &diffuse = model.materials.emplace_back();
+
+      const JsonValue &baseColor =
+          material["pbrMetallicRoughness"]["baseColorTexture"];
+      if (baseColor.isNull())
+        continue;
+
+      const JsonValue &image =
+          images[textures[baseColor["index"].asUint(UINT32_MAX)]["source"]
+                     .asUint(UINT32_MAX)];
+      const std::string &uri = image["uri"].asString();
+
+      if (uri.empty() || uri.starts_with("data:")) {
+        ASH_WARN("Embedded images in {} aren't supported, using the fallback",
+                 file);
+      } else {
+        diffuse = decodeUri(uri);
+      }
+    }
+  }
+
+  bool getAccessor(uint32_t index, Accessor &accessor) {
+    const JsonValue &info = json["accessors"][index];
+    if (!info.isObject())
+      return false;
+
+    // Sparse and zero-filled accessors are rare enough to leave to Assimp
+    if (info.contains("sparse") || !info.contains("bufferView"))
+      return false;
+
+    const JsonValue &view =
+        json["bufferViews"][info["bufferView"].asUint(UINT32_MAX)];
+    uint32_t buffer = view["buffer"].asUint(UINT32_MAX);
+    if (!view.isObject() || buffer >= buffers.size())
+      return false;
+
+    accessor.count = info["count"].asUint();
+    accessor.componentType = info["componentType"].asUint();
+    accessor.components = getComponentCount(info["type"].asString());
+    accessor.normalized = info["normalized"].asBool();
+
+    size_t elementSize =
+        getComponentSize(accessor.componentType) * accessor.components;
+    if (elementSize == 0)
+      return false;
+
+    accessor.stride = view["byteStride"].asUint(0);
+    if (accessor.stride == 0)
+      accessor.stride = elementSize;
+
+    size_t viewOffset = view["byteOffset"].asUint();
+    size_t viewLength = view["byteLength"].asUint();
+    size_t offset = info["byteOffset"].asUint();
+
+    if (viewOffset + viewLength > buffers[buffer].size ||
+        accessor.stride < elementSize)
+      return false;
+
+    if (accessor.count > 0 &&
+        offset + accessor.stride * (accessor.count - 1) + elementSize >
+            viewLength)
+      return false;
+
+    accessor.data = buffers[buffer].data + viewOffset + offset;
+    return true;
+  }
+
+  bool getAttribute(const JsonValue &attributes, const char *name,
+                    Accessor &accessor, uint32_t components, bool required) {
+    if (!attributes.contains(name))
+      return !required;
+
+    if (!getAccessor(attributes[name].asUint(UINT32_MAX), accessor) ||
+        accessor.components != components) {
+      ASH_INFO("Unsupported {} accessor in {}", name, file);
+      return false;
+    }
+
+    bool isFloat = accessor.componentType == Float;
+    bool isNormalizedUnsigned = accessor.normalized &&
+                                (accessor.componentType == UnsignedByte ||
+                                 accessor.componentType == UnsignedShort);
+
+    // Quantized texture coordinates are normalized integers, everything else
+    // has to be float
+    if (!isFloat && !(components == 2 && isNormalizedUnsigned)) {
+      ASH_INFO("Unsupported {} accessor in {}", name, file);
+      return false;
+    }
+
+    return true;
+  }
+
+  // mesh is set to the slot the primitive is written to, or left invalid if
+  // it's skipped
+  bool addPrimitive(const JsonValue &primitive, const glm::mat4 &transform,
+                    uint32_t &mesh) {
+    mesh = UINT32_MAX;
+
+    if (primitive["mode"].asUint(MODE_TRIANGLES) != MODE_TRIANGLES) {
+      ASH_WARN("Skipping non-triangle primitive in {}", file);
+      return true;
+    }
+
+    PrimitiveInstance instance;
+    instance.transform = transform;
+
+    const JsonValue &attributes = primitive["attributes"];
+    if (!getAttribute(attributes, "POSITION", instance.positions, 3, true) ||
+        !getAttribute(attributes, "NORMAL", instance.normals, 3, false) ||
+        !getAttribute(attributes, "TEXCOORD_0", instance.texCoords, 2, false))
+      return false;
+
+    uint32_t vertexCount = instance.positions.count;
+    if ((instance.normals.isValid() && instance.normals.count < vertexCount) ||
+        (instance.texCoords.isValid() &&
+         instance.texCoords.count < vertexCount))
+      return false;
+
+    uint32_t indexCount = vertexCount;
+    if (primitive.contains("indices")) {
+      // The spec only allows unsigned indices, readIndex relies on it
+      if (!getAccessor(primitive["indices"].asUint(UINT32_MAX),
+                       instance.indices) ||
+          instance.indices.components != 1 ||
+          !isIndexComponentType(instance.indices.componentType)) {
+        ASH_INFO("Unsupported indices accessor in {}", file);
+        return false;
+      }
+      indexCount = instance.indices.count;
+    }
+
+    // Primitives without a material share a default one after the others
+    uint32_t material = primitive["material"].asUint(UINT32_MAX);
+    if (material >= json["materials"].size()) {
+      if (defaultMaterial == UINT32_MAX) {
+        defaultMaterial = static_cast<uint32_t>(model.materials.size());
+        model.materials.emplace_back();
+      }
+      material = defaultMaterial;
+    }
+
+    // Only flattened primitives can be merged, kept ones get their own mesh
+    uint32_t slot = static_cast<uint32_t>(meshVertexCounts.size());
+    if (mode == ImportMode::Flatten)
+      slot = meshesByMaterial.try_emplace(material, slot).first->second;
+
+    if (slot == meshVertexCounts.size()) {
+      meshVertexCounts.push_back(0);
+      meshIndexCounts.push_back(0);
+      meshMaterials.push_back(material);
+    }
+
+    instance.mesh = slot;
+    instance.firstVertex =
+        static_cast<uint32_t>(meshVertexCounts[instance.mesh]);
+    instance.firstIndex = static_cast<uint32_t>(meshIndexCounts[instance.mesh]);
+
+    meshVertexCounts[instance.mesh] += vertexCount;
+    meshIndexCounts[instance.mesh] += indexCount;
+    if (meshVertexCounts[instance.mesh] > UINT32_MAX ||
+        meshIndexCounts[instance.mesh] > UINT32_MAX)
+      return false;
+
+    instances.push_back(instance);
+    mesh = instance.mesh;
+    return true;
+  }
+
+  // Flattened meshes add their primitives again for every node drawing them,
+  // kept ones add them once and the node as an instance
+  bool addMesh(uint32_t index, const glm::mat4 &transform) {
+    const JsonValue &primitives = json["meshes"][index]["primitives"];
+
+    uint32_t slot;
+    if (mode == ImportMode::Flatten) {
+      for (const JsonValue &primitive : primitives.getValues())
+        if (!addPrimitive(primitive, transform, slot))
+          return false;
+      return true;
+    }
+
+    auto [it, inserted] = meshSlots.try_emplace(index);
+    if (inserted) {
+      for (const JsonValue &primitive : primitives.getValues()) {
+        if (!addPrimitive(primitive, glm::mat4(1.0f), slot))
+          return false;
+        if (slot != UINT32_MAX)
+          it->second.push_back(slot);
+      }
+    }
+
+    if (!it->second.empty())
+      model.instances.push_back({it->second, transform});
+    return true;
+  }
+
+  // Walks the default scene with the world transform of every node
+  bool collectInstances() {
+    const JsonValue &nodes = json["nodes"];
+    const JsonValue &scene = json["scenes"][json["scene"].asUint(0)];
+
+    if (!scene.isObject()) {
+      ASH_WARN("{} has no scene", file);
+      return false;
+    }
+
+    std::vector<bool> visited(nodes.size());
+    std::vector<std::pair<uint32_t, glm::mat4>> stack;
+    for (const JsonValue &root : scene["nodes"].getValues())
+      stack.emplace_back(root.asUint(UINT32_MAX), glm::mat4(1.0f));
+
+    while (!stack.empty()) {
+      auto [index, parent] = stack.back();
+      stack.pop_back();
+
+      // Nodes form trees, anything else is malformed
+      if (index >= nodes.size() || visited[index])
+        return false;
+      visited[index] = true;
+
+      const JsonValue &node = nodes[index];
+      glm::mat4 transform = parent * getNodeTransform(node);
+
+      if (node.contains("mesh") &&
+          !addMesh(node["mesh"].asUint(UINT32_MAX), transform))
+        return false;
+
+      for (const JsonValue &child : node["children"].getValues())
+        stack.emplace_back(child.asUint(UINT32_MAX), transform);
+    }
+
+    return true;
+  }
+
+  static bool decodeInstance(PrimitiveInstance &instance, ImportedMesh &mesh) {
+    const Accessor &positions = instance.positions;
+    const Accessor &normals = instance.normals;
+    const Accessor &texCoords = instance.texCoords;
+
+    bool identity = instance.transform == glm::mat4(1.0f);
+    glm::mat3 normalMatrix =
+        glm::inverseTranspose(glm::mat3(instance.transform));
+
+    instance.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    instance.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+    Vertex *vertices = mesh.vertices.data() + instance.firstVertex;
+    for (uint32_t i = 0; i < positions.count; i++) {
+      Vertex &vertex = vertices[i];
+
+      vertex.pos = readVec3(positions, i);
+      vertex.normal =
+          normals.isValid() ? readVec3(normals, i) : glm::vec3(0.0f);
+      vertex.texCoord =
+          texCoords.isValid() ? readVec2(texCoords, i) : glm::vec2(0.0f);
+
+      if (!identity) {
+        vertex.pos = glm::vec3(instance.transform * glm::vec4(vertex.pos, 1.0f));
+        if (normals.isValid())
+          vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+      }
+
+      // Assimp flips V for glTF and the shaders are written against that
+      vertex.texCoord.y = 1.0f - vertex.texCoord.y;
+
+      instance.boundsMin = glm::min(instance.boundsMin, vertex.pos);
+      instance.boundsMax = glm::max(instance.boundsMax, vertex.pos);
+    }
+
+    uint32_t *indices = mesh.indices.data() + instance.firstIndex;
+    if (!instance.indices.isValid()) {
+      for (uint32_t i = 0; i < positions.count; i++)
+        indices[i] = instance.firstVertex + i;
+      return true;
+    }
+
+    for (uint32_t i = 0; i < instance.indices.count; i++) {
+      uint32_t index = readIndex(instance.indices, i);
+      if (index >= positions.count)
+        return false;
+      indices[i] = instance.firstVertex + index;
+    }
+
+    return true;
+  }
+
+  // Primitives decode in parallel straight into their slice of the merged
+  // meshes, nothing is copied afterwards
+  bool decode() {
+    model.meshes.resize(meshVertexCounts.size());
+    for (uint32_t i = 0; i < model.meshes.size(); i++) {
+      model.meshes[i].vertices.resize(meshVertexCounts[i]);
+      model.meshes[i].indices.resize(meshIndexCounts[i]);
+      model.meshes[i].material = meshMaterials[i];
+      model.meshes[i].boundsMin = glm::vec3(std::numeric_limits<float>::max());
+      model.meshes[i].boundsMax =
+          glm::vec3(std::numeric_limits<float>::lowest());
+    }
+
+    std::atomic<bool> valid{true};
+    ThreadPool::parallelFor(instances.size(), [&](size_t i) {
+      PrimitiveInstance &instance = instances[i];
+      if (!decodeInstance(instance, model.meshes[instance.mesh]))
+        valid = false;
+    });
+
+    if (!valid) {
+      ASH_WARN("Out of range indices in {}", file);
+      return false;
+    }
+
+    for (const PrimitiveInstance &instance : instances) {
+      ImportedMesh &mesh = model.meshes[instance.mesh];
+      mesh.boundsMin = glm::min(mesh.boundsMin, instance.boundsMin);
+      mesh.boundsMax = glm::max(mesh.boundsMax, instance.boundsMax);
+    }
+
+    return true;
+  }
+
+  struct Buffer {
+    const char *data{nullptr};
+    size_t size{0};
+  };
+
+  std::string file;
+  std::string directory;
+  ImportedModel &model;
+  ImportMode mode;
+
+  MappedFile source;
+  JsonValue json;
+  Buffer binaryChunk;
+
+  std::vector<Buffer> buffers;
+  std::vector<MappedFile> mappedBuffers;
+  std::vector<std::vector<char>> embedded;
+
+  std::vector<PrimitiveInstance> instances;
+  std::unordered_map<uint32_t, uint32_t> meshesByMaterial;
+  std::unordered_map<uint32_t, std::vector<uint32_t>> meshSlots;
+  std::vector<uint64_t> meshVertexCounts;
+  std::vector<uint64_t> meshIndexCounts;
+  std::vector<uint32_t> meshMaterials;
+  uint32_t defaultMaterial{UINT32_MAX};
+};
+
+bool importGltf(const std::string &file, ImportedModel &model,
+                ImportMode mode) {
+  GltfLoader loader(file, model, mode);
+  return loader.load();
+}
+
+} // namespace Ash::Helper
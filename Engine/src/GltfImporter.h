@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "Helper.h"
+
+namespace Ash::Helper {
+
+// Reads .gltf and .glb files without Assimp. Accessors are decoded straight
+// from the mapped buffers into the engine's vertex layout on the thread pool.
+// Flattening applies node transforms and merges primitives sharing a
+// material, the same result Assimp gives with pre-transformed vertices. With
+// the hierarchy kept every primitive is decoded once in its mesh's space.
+//
+// Covers triangle primitives with float positions and normals, float or
+// normalized integer texture coordinates and unsigned indices. Returns false
+// for anything outside that so the caller can fall back to Assimp
+bool importGltf(const std::string &file, ImportedModel &model,
+                ImportMode mode = ImportMode::Flatten);
+
+} // namespace Ash::Helper
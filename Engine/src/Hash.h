@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Ash {
+
+// 64-bit MurmurHash2 (MurmurHash64A), fast and well distributed but not
+// cryptographic
+uint64_t hash64(const void *data, size_t size, uint64_t seed = 0);
+
+inline uint64_t hashCombine(uint64_t hash, uint64_t value) {
+  return hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+}
+
+} // namespace Ash
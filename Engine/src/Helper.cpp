@@ -1,140 +1,638 @@
 #include "Helper.h"
 
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
-#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <numeric>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ASH_SSE2
+#endif
+
+#include "AssetPack.h"
+#include "Components.h"
 #include "Core.h"
+#include "GltfImporter.h"
+#include "MainThread.h"
+#include "ObjImporter.h"
 #include "Renderer.h"
+#include "ThreadPool.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
 
 namespace Ash::Helper {
 
-std::vector<char> readBinaryFile(const char *filename) {
-  std::ifstream istream(filename, std::ios::ate | std::ios::binary);
+MappedFile readBinaryFile(const char *filename, MappedFileAccess access) {
+  MappedFile file(filename, access);
 
-  ASH_ASSERT(istream.is_open(), "Failed to open file {}", filename);
+  ASH_ASSERT(file.isOpen(), "Failed to open file {}", filename);
+
+  return file;
+}
 
-  size_t size = (size_t)istream.tellg();
-  std::vector<char> buffer(size);
-  istream.seekg(0);
-  istream.read(buffer.data(), size);
-  istream.close();
+std::string getDirectory(const std::string &file) {
+#ifdef ASH_WINDOWS
+  char separator = '\\';
+#else
+  char separator = '/';
+#endif
 
-  return buffer;
+  return file.substr(0, file.find_last_of(separator) + 1);
 }
 
-void processMesh(aiMesh *mesh, const std::string &name) {
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
+// Remembers every file the importer opens, glTF buffers and OBJ material
+// libraries are dependencies of the model too
+class RecordingIOSystem : public Assimp::DefaultIOSystem {
+public:
+  RecordingIOSystem(std::vector<std::string> &files) : files(files) {}
 
-  vertices.reserve(mesh->mNumVertices);
+  Assimp::IOStream *Open(const char *file, const char *mode) override {
+    Assimp::IOStream *stream = DefaultIOSystem::Open(file, mode);
+    if (stream && std::find(files.begin(), files.end(), file) == files.end())
+      files.push_back(file);
+    return stream;
+  }
 
-  for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
-    Vertex vertex;
-    vertex.pos.x = mesh->mVertices[i].x;
-    vertex.pos.y = mesh->mVertices[i].y;
-    vertex.pos.z = mesh->mVertices[i].z;
-    if (mesh->mTextureCoords[0]) {
-      vertex.texCoord.x = mesh->mTextureCoords[0][i].x;
-      vertex.texCoord.y = mesh->mTextureCoords[0][i].y;
-    }
-    vertex.normal.x = mesh->mNormals[i].x;
-    vertex.normal.y = mesh->mNormals[i].y;
-    vertex.normal.z = mesh->mNormals[i].z;
-    vertices.push_back(vertex);
+private:
+  std::vector<std::string> &files;
+};
+
+// Interleaves assimp's separate position, normal and UV arrays into
+// vertices and computes their bounds. Missing attributes are zero
+static void packVertices(const aiVector3D *positions, const aiVector3D *normals,
+                         const aiVector3D *texCoords, uint32_t count,
+                         Vertex *vertices, glm::vec3 &boundsMin,
+                         glm::vec3 &boundsMax) {
+  static_assert(sizeof(Vertex) == 8 * sizeof(float) &&
+                    sizeof(aiVector3D) == 3 * sizeof(float),
+                "Vertex packing assumes tightly packed floats");
+
+  boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+  uint32_t i = 0;
+
+#ifdef ASH_SSE2
+  // Each vertex is two 16 byte stores, pos.xyz normal.x | normal.yz uv.xy.
+  // Loads read one float past the element, so the last vertex is left to the
+  // scalar loop
+  __m128 minimum = _mm_set1_ps(std::numeric_limits<float>::max());
+  __m128 maximum = _mm_set1_ps(std::numeric_limits<float>::lowest());
+  __m128 zero = _mm_setzero_ps();
+
+  float *out = reinterpret_cast<float *>(vertices);
+  for (; i + 1 < count; i++) {
+    __m128 p = _mm_loadu_ps(&positions[i].x);
+    __m128 n = normals ? _mm_loadu_ps(&normals[i].x) : zero;
+    __m128 uv = texCoords ? _mm_loadu_ps(&texCoords[i].x) : zero;
+
+    __m128 zx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));
+    __m128 first = _mm_shuffle_ps(p, zx, _MM_SHUFFLE(2, 0, 1, 0));
+    __m128 second = _mm_shuffle_ps(n, uv, _MM_SHUFFLE(1, 0, 2, 1));
+
+    _mm_storeu_ps(out + i * 8, first);
+    _mm_storeu_ps(out + i * 8 + 4, second);
+
+    minimum = _mm_min_ps(minimum, p);
+    maximum = _mm_max_ps(maximum, p);
   }
 
-  size_t numIndices = 0;
-  for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
-    numIndices += face.mNumIndices;
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, minimum);
+  boundsMin = glm::vec3(lanes[0], lanes[1], lanes[2]);
+  _mm_store_ps(lanes, maximum);
+  boundsMax = glm::vec3(lanes[0], lanes[1], lanes[2]);
+#endif
+
+  for (; i < count; i++) {
+    Vertex &vertex = vertices[i];
+    vertex.pos = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+    vertex.normal = normals ? glm::vec3(normals[i].x, normals[i].y, normals[i].z)
+                            : glm::vec3(0.0f);
+    vertex.texCoord = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y)
+                                : glm::vec2(0.0f);
+
+    boundsMin = glm::min(boundsMin, vertex.pos);
+    boundsMax = glm::max(boundsMax, vertex.pos);
   }
+}
+
+void processMesh(const aiMesh *mesh, ImportedMesh &imported) {
+  std::vector<Vertex> &vertices = imported.vertices;
+  std::vector<uint32_t> &indices = imported.indices;
+
+  vertices.resize(mesh->mNumVertices);
+  packVertices(mesh->mVertices, mesh->mNormals, mesh->mTextureCoords[0],
+               mesh->mNumVertices, vertices.data(), imported.boundsMin,
+               imported.boundsMax);
+
+  size_t numIndices = 0;
+  for (uint32_t i = 0; i < mesh->mNumFaces; i++)
+    numIndices += mesh->mFaces[i].mNumIndices;
 
   indices.reserve(numIndices);
   for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
-    for (uint32_t j = 0; j < face.mNumIndices; j++) {
-      indices.push_back(face.mIndices[j]);
-    }
+    const aiFace &face = mesh->mFaces[i];
+    indices.insert(indices.end(), face.mIndices,
+                   face.mIndices + face.mNumIndices);
   }
 
-  Renderer::loadMesh(name, vertices, indices);
+  imported.material = mesh->mMaterialIndex;
 }
 
-std::vector<std::string> loadTextures(const std::string &directory,
-                                      aiMaterial *mat, aiTextureType type) {
-  std::vector<std::string> textures;
-  for (uint32_t i = 0; i < mat->GetTextureCount(type); i++) {
+static void collectInstances(const aiNode *node, const glm::mat4 &parent,
+                             ImportedModel &model) {
+  // Assimp matrices are row major
+  glm::mat4 transform =
+      parent * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+
+  if (node->mNumMeshes > 0)
+    model.instances.push_back(
+        {std::vector<uint32_t>(node->mMeshes, node->mMeshes + node->mNumMeshes),
+         transform});
+
+  for (uint32_t i = 0; i < node->mNumChildren; i++)
+    collectInstances(node->mChildren[i], transform, model);
+}
+
+// Meshes convert on the thread pool, onMesh is called on this thread in mesh
+// order as soon as each one is ready so uploads overlap the conversion of
+// later meshes
+static bool
+importAssimp(const std::string &file, uint32_t flags, ImportedModel &model,
+             ImportMode mode,
+             const std::function<void(uint32_t, ImportedMesh &)> &onMesh) {
+  Assimp::Importer importer;
+  importer.SetIOHandler(new RecordingIOSystem(model.sourceFiles));
+
+  flags |= aiProcess_Triangulate;
+  if (mode == ImportMode::Flatten)
+    flags |= aiProcess_PreTransformVertices | aiProcess_OptimizeMeshes;
+
+  const aiScene *scene = importer.ReadFile(file, flags);
+
+  if (!scene) {
+    ASH_WARN("Failed to import mesh {}: {}", file, importer.GetErrorString());
+    return false;
+  }
+
+  model.materials.resize(scene->mNumMaterials);
+  for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
     aiString path;
-    mat->GetTexture(type, i, &path);
-    Renderer::loadTexture(directory + std::string(path.C_Str()),
-                          directory + std::string(path.C_Str()));
-    textures.push_back(directory + std::string(path.C_Str()));
+    if (scene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &path) ==
+        AI_SUCCESS)
+      model.materials[i] = path.C_Str();
+  }
+
+  // Pre-transforming flattens the hierarchy, every mesh is drawn once.
+  // Otherwise meshes are in the space of the nodes drawing them
+  model.meshes.resize(scene->mNumMeshes);
+
+  std::vector<std::future<void>> conversions;
+  conversions.reserve(scene->mNumMeshes);
+  for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+    conversions.push_back(ThreadPool::submit(
+        [&, i]() { processMesh(scene->mMeshes[i], model.meshes[i]); }));
+
+  for (uint32_t i = 0; i < scene->mNumMeshes; i++) {
+    ThreadPool::wait(conversions[i]);
+    if (onMesh)
+      onMesh(i, model.meshes[i]);
   }
 
-  return textures;
+  if (mode == ImportMode::Hierarchy)
+    collectInstances(scene->mRootNode, glm::mat4(1.0f), model);
+
+  return true;
 }
 
-void processNode(const aiNode *node, const aiScene *scene,
-                 const std::string &name, const std::string &directory,
-                 std::vector<std::string> &meshes,
-                 std::vector<std::string> &diffuseTextures) {
-  for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-    std::string mesh_name = name + "_" + std::to_string(node->mMeshes[i]);
-    if (Renderer::hasMesh(mesh_name))
-      continue;
+// Returns false without touching the model if there's no native importer
+// for the file
+static bool importNative(const std::string &file, ImportedModel &model,
+                         ImportMode mode, bool &supported) {
+  std::string extension = std::filesystem::path(file).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
 
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    processMesh(mesh, mesh_name);
-    meshes.push_back(mesh_name);
-    aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+  supported = true;
+  if (extension == ".gltf" || extension == ".glb")
+    return importGltf(file, model, mode);
+  if (extension == ".obj")
+    return importObj(file, model);
 
-    std::vector<std::string> texs =
-        loadTextures(directory, material, aiTextureType_DIFFUSE);
-    diffuseTextures.insert(diffuseTextures.end(), texs.begin(), texs.end());
+  supported = false;
+  return false;
+}
+
+static bool
+importScene(const std::string &file, uint32_t flags, ImportedModel &model,
+            ImportBackend backend, ImportMode mode,
+            const std::function<void(uint32_t, ImportedMesh &)> &onMesh) {
+  // Assimp post-processing has no native equivalent
+  if (backend == ImportBackend::Native ||
+      (backend == ImportBackend::Auto && flags == 0)) {
+    bool supported;
+    if (importNative(file, model, mode, supported)) {
+      // Native importers convert everything up front, so there's nothing
+      // left to overlap with
+      if (onMesh)
+        for (uint32_t i = 0; i < model.meshes.size(); i++)
+          onMesh(i, model.meshes[i]);
+      return true;
+    }
+
+    if (backend == ImportBackend::Native) {
+      ASH_WARN("No native importer could read {}", file);
+      return false;
+    }
 
-    if (texs.empty()) {
-      ASH_INFO("Using backup texture");
-      diffuseTextures.push_back("white");
+    if (supported) {
+      ASH_INFO("Falling back to Assimp for {}", file);
+      model = ImportedModel();
     }
   }
 
-  for (uint32_t i = 0; i < node->mNumChildren; i++)
-    processNode(node->mChildren[i], scene, name, directory, meshes, diffuseTextures);
+  return importAssimp(file, flags, model, mode, onMesh);
+}
+
+bool importScene(const std::string &file, uint32_t flags, ImportedModel &model,
+                 ImportBackend backend, ImportMode mode) {
+  return importScene(file, flags, model, backend, mode, nullptr);
+}
+
+// Uploads are submitted in chunks of roughly this many staged bytes, so the
+// GPU copies earlier meshes while later ones are still converting
+static constexpr uint64_t UPLOAD_CHUNK_SIZE = 16ull * 1024 * 1024;
+
+// Counts bytes into the open upload batch, submitting it and starting the
+// next one once a chunk is full
+static void stageUpload(uint64_t &staged, uint64_t bytes) {
+  staged += bytes;
+  if (staged < UPLOAD_CHUNK_SIZE)
+    return;
+
+  Renderer::getAPI()->submitUploadBatch();
+  Renderer::getAPI()->beginUploadBatch();
+  staged = 0;
+}
+
+// Materials are created the first time a mesh uses them, textures are
+// relative to directory
+static MaterialHandle loadMaterial(std::vector<MaterialHandle> &materials,
+                                   uint32_t index, const std::string &directory,
+                                   const std::string &diffuse) {
+  if (materials[index].isValid())
+    return materials[index];
+
+  TextureHandle texture;
+  if (diffuse.empty()) {
+    ASH_INFO("Using backup texture");
+    texture = Renderer::findTexture("white");
+  } else {
+    texture = Renderer::loadTexture(directory + diffuse, directory + diffuse);
+  }
+
+  materials[index] = Renderer::loadMaterial({texture});
+  return materials[index];
 }
 
 bool importModel(const std::string &name, const std::string &file,
                  uint32_t flags) {
-  Assimp::Importer importer;
+  if (Renderer::findModel(name).isValid())
+    return true;
 
-  const aiScene *scene = importer.ReadFile(
-      file, flags | aiProcess_Triangulate | aiProcess_PreTransformVertices |
-                aiProcess_OptimizeMeshes);
+  std::vector<MeshHandle> meshes;
+  std::vector<MaterialHandle> meshMaterials;
 
-#ifdef ASH_WINDOWS
-  char separator = '\\';
-#else
-  char separator = '/';
-#endif
+  std::string directory = getDirectory(file);
+  std::vector<MaterialHandle> materials;
+  uint64_t staged = 0;
+
+  // Uploads are recorded into batches, later frames are ordered behind them
+  // on the graphics queue
+  Renderer::getAPI()->beginUploadBatch();
+
+  ImportedModel imported;
+  bool success = importScene(
+      file, flags, imported, ImportBackend::Auto, ImportMode::Flatten,
+      [&](uint32_t i, ImportedMesh &mesh) {
+        if (materials.empty())
+          materials.resize(imported.materials.size());
+
+        meshes.push_back(Renderer::loadMesh(name + "_" + std::to_string(i),
+                                            mesh.vertices, mesh.indices));
+        meshMaterials.push_back(loadMaterial(materials, mesh.material,
+                                             directory,
+                                             imported.materials[mesh.material]));
+        Renderer::acquireResources(meshes.back(), meshMaterials.back());
+
+        stageUpload(staged, mesh.vertices.size() * sizeof(Vertex) +
+                                mesh.indices.size() * sizeof(uint32_t));
+
+        // The staging copy is all the GPU needs
+        mesh.vertices = {};
+        mesh.indices = {};
+      });
 
-  std::string directory = file.substr(0, file.find_last_of(separator) + 1);
+  Renderer::getAPI()->submitUploadBatch();
 
-  ASH_ASSERT(scene, "Failed to import mesh {}", file);
+  if (success)
+    Renderer::loadModel(name, meshes, meshMaterials);
 
-  std::vector<std::string> meshes;
+  // Frees the meshes and materials of an import that failed halfway
+  for (size_t i = 0; i < meshes.size(); i++)
+    Renderer::releaseResources(meshes[i], meshMaterials[i]);
+
+  return success;
+}
+
+bool importModelInstances(const std::string &name, const std::string &file,
+                          std::vector<ModelInstance> &instances,
+                          uint32_t flags) {
+  ImportedModel imported;
+  if (!importScene(file, flags, imported, ImportBackend::Auto,
+                   ImportMode::Hierarchy, nullptr))
+    return false;
+
+  // Formats without a node graph are one instance of everything
+  if (imported.instances.empty()) {
+    ImportedInstance &instance = imported.instances.emplace_back();
+    instance.meshes.resize(imported.meshes.size());
+    std::iota(instance.meshes.begin(), instance.meshes.end(), 0);
+    instance.transform = glm::mat4(1.0f);
+  }
+
+  std::string directory = getDirectory(file);
+  std::vector<MaterialHandle> materials(imported.materials.size());
+  std::vector<MeshHandle> meshes(imported.meshes.size());
+  uint64_t staged = 0;
+
+  // Nodes drawing the same meshes share a model, meshes no node draws are
+  // never uploaded
+  std::map<std::vector<uint32_t>, ModelHandle> models;
+
+  Renderer::getAPI()->beginUploadBatch();
+
+  for (const ImportedInstance &instance : imported.instances) {
+    auto [it, inserted] = models.try_emplace(instance.meshes);
+    if (inserted) {
+      std::vector<MeshHandle> modelMeshes;
+      std::vector<MaterialHandle> modelMaterials;
+
+      for (uint32_t index : instance.meshes) {
+        ImportedMesh &mesh = imported.meshes[index];
+
+        if (!meshes[index].isValid()) {
+          meshes[index] =
+              Renderer::loadMesh(name + "_" + std::to_string(index),
+                                 mesh.vertices, mesh.indices);
+          stageUpload(staged, mesh.vertices.size() * sizeof(Vertex) +
+                                  mesh.indices.size() * sizeof(uint32_t));
+        }
+
+        modelMeshes.push_back(meshes[index]);
+        modelMaterials.push_back(loadMaterial(materials, mesh.material,
+                                              directory,
+                                              imported.materials[mesh.material]));
+      }
+
+      it->second = Renderer::loadModel(
+          name + "_" + std::to_string(models.size() - 1), modelMeshes,
+          modelMaterials);
+    }
+
+    instances.push_back({it->second, instance.transform});
+  }
+
+  Renderer::getAPI()->submitUploadBatch();
+
+  ASH_INFO("Imported {} as {} models drawn by {} instances", file,
+           models.size(), imported.instances.size());
+
+  return true;
+}
+
+void spawnModelInstances(Scene &scene,
+                         const std::vector<ModelInstance> &instances,
+                         PipelineHandle pipeline, const glm::mat4 &root) {
+  for (const ModelInstance &instance : instances) {
+    glm::vec3 scale;
+    glm::quat rotation;
+    glm::vec3 translation;
+    glm::vec3 skew;
+    glm::vec4 perspective;
+    glm::decompose(root * instance.transform, scale, rotation, translation,
+                   skew, perspective);
+
+    Transform transform(translation);
+    transform.rotation = glm::eulerAngles(rotation);
+    transform.scale = scale;
+
+    Entity entity = scene.spawn();
+    scene.addComponent<Renderable>(entity, instance.model, pipeline);
+    scene.addComponent<Transform>(entity, transform);
+  }
+}
+
+static std::vector<std::string> getDiffuseTextures(const AssetPack &pack) {
   std::vector<std::string> diffuseTextures;
-  Helper::processNode(scene->mRootNode, scene, name, directory, meshes,
-                      diffuseTextures);
+  for (const AssetPackMaterial &material : pack.getMaterials()) {
+    if (material.diffuseTexture == ASSET_PACK_NO_TEXTURE ||
+        material.diffuseTexture >= pack.getTextures().size())
+      diffuseTextures.emplace_back();
+    else
+      diffuseTextures.emplace_back(
+          pack.getString(pack.getTextures()[material.diffuseTexture].path));
+  }
+  return diffuseTextures;
+}
+
+bool loadAssetPack(const std::string &name, const std::string &path) {
+  if (Renderer::findModel(name).isValid())
+    return true;
+
+  AssetPack pack;
+  if (!pack.open(path))
+    return false;
+
+  // Mesh blobs are read front to back while the textures decode
+  pack.adviseMeshData();
+
+  std::vector<std::string> diffuseTextures = getDiffuseTextures(pack);
+
+  std::vector<MeshHandle> meshes;
+  std::vector<MaterialHandle> meshMaterials;
+
+  std::string directory = getDirectory(path);
+  std::vector<MaterialHandle> materials(diffuseTextures.size());
+  uint64_t staged = 0;
+
+  Renderer::getAPI()->beginUploadBatch();
+
+  std::span<const AssetPackMesh> packMeshes = pack.getMeshes();
+  for (uint32_t i = 0; i < packMeshes.size(); i++) {
+    const AssetPackMesh &mesh = packMeshes[i];
+    const char *data = pack.getData(mesh.dataOffset);
+
+    meshes.push_back(Renderer::loadMesh(
+        name + "_" + std::to_string(i), data, mesh.vertexSize,
+        reinterpret_cast<const uint32_t *>(data + mesh.vertexSize),
+        mesh.indexCount));
+    meshMaterials.push_back(loadMaterial(materials, mesh.material, directory,
+                                         diffuseTextures[mesh.material]));
 
-  std::vector<Material> materials(diffuseTextures.size());
-  for (uint32_t i = 0; i < diffuseTextures.size(); i++)
-    materials[i].diffuse = diffuseTextures[i];
+    stageUpload(staged,
+                mesh.vertexSize + mesh.indexCount * sizeof(uint32_t));
+  }
+
+  Renderer::getAPI()->submitUploadBatch();
+
+  Renderer::loadModel(name, meshes, meshMaterials);
 
-  Renderer::loadModel(name, meshes, materials);
+  ASH_INFO("Loaded {} meshes of {} from {}", packMeshes.size(), name, path);
 
   return true;
 }
 
+// Loads mesh i into the open upload batch, returning its material and the
+// bytes it staged
+using AsyncMeshLoader =
+    std::function<MeshHandle(uint32_t i, uint32_t &material, uint64_t &bytes)>;
+
+// Main thread half of the asynchronous loads. Each chunk is queued without
+// waiting for its texture decodes and a frame renders before the next one
+static Task<ModelHandle>
+uploadModelAsync(std::string name, std::string directory,
+                 std::vector<std::string> diffuseTextures, uint32_t meshCount,
+                 AsyncMeshLoader loadMesh) {
+  std::vector<MeshHandle> meshes;
+  std::vector<MaterialHandle> meshMaterials;
+  std::vector<MaterialHandle> materials(diffuseTextures.size());
+  uint64_t staged = 0;
+  uint64_t serial = 0;
+  bool batchOpen = false;
+
+  Renderer::beginAsyncLoad();
+
+  for (uint32_t i = 0; i < meshCount; i++) {
+    if (!batchOpen) {
+      Renderer::getAPI()->beginUploadBatch();
+      batchOpen = true;
+    }
+
+    uint32_t material;
+    uint64_t bytes;
+    meshes.push_back(loadMesh(i, material, bytes));
+    meshMaterials.push_back(loadMaterial(materials, material, directory,
+                                         diffuseTextures[material]));
+    Renderer::acquireResources(meshes.back(), meshMaterials.back());
+
+    staged += bytes;
+    if (staged < UPLOAD_CHUNK_SIZE && i + 1 < meshCount)
+      continue;
+
+    serial = Renderer::getAPI()->queueUploadBatch();
+    batchOpen = false;
+    staged = 0;
+
+    co_await MainThread::nextFrame();
+  }
+
+  co_await Renderer::waitForUpload(serial);
+
+  // Another load may have finished the same name in the meantime, whatever
+  // this one created then goes with its references
+  ModelHandle model = Renderer::findModel(name);
+  if (!model.isValid())
+    model = Renderer::loadModel(name, meshes, meshMaterials);
+
+  for (size_t i = 0; i < meshes.size(); i++)
+    Renderer::releaseResources(meshes[i], meshMaterials[i]);
+
+  Renderer::endAsyncLoad();
+
+  co_return model;
+}
+
+Task<ModelHandle> importModelAsync(std::string name, std::string file,
+                                   uint32_t flags) {
+  if (ModelHandle model = Renderer::findModel(name); model.isValid())
+    co_return model;
+
+  ImportedModel imported;
+  co_await ThreadPool::schedule();
+  bool success = importScene(file, flags, imported);
+  co_await MainThread::schedule();
+
+  if (!success)
+    co_return ModelHandle();
+
+  auto loadMesh = [&](uint32_t i, uint32_t &material, uint64_t &bytes) {
+    ImportedMesh &mesh = imported.meshes[i];
+    MeshHandle handle = Renderer::loadMesh(name + "_" + std::to_string(i),
+                                           mesh.vertices, mesh.indices);
+
+    material = mesh.material;
+    bytes = mesh.vertices.size() * sizeof(Vertex) +
+            mesh.indices.size() * sizeof(uint32_t);
+
+    // The staging copy is all the GPU needs
+    mesh.vertices = {};
+    mesh.indices = {};
+    return handle;
+  };
+
+  co_return co_await uploadModelAsync(
+      name, getDirectory(file), imported.materials,
+      static_cast<uint32_t>(imported.meshes.size()), loadMesh);
+}
+
+Task<ModelHandle> loadAssetPackAsync(std::string name, std::string path) {
+  if (ModelHandle model = Renderer::findModel(name); model.isValid())
+    co_return model;
+
+  AssetPack pack;
+  co_await ThreadPool::schedule();
+  bool success = pack.open(path);
+  if (success)
+    pack.adviseMeshData();
+  co_await MainThread::schedule();
+
+  if (!success)
+    co_return ModelHandle();
+
+  std::span<const AssetPackMesh> packMeshes = pack.getMeshes();
+  auto loadMesh = [&](uint32_t i, uint32_t &material, uint64_t &bytes) {
+    const AssetPackMesh &mesh = packMeshes[i];
+    const char *data = pack.getData(mesh.dataOffset);
+
+    material = mesh.material;
+    bytes = mesh.vertexSize + mesh.indexCount * sizeof(uint32_t);
+
+    return Renderer::loadMesh(
+        name + "_" + std::to_string(i), data, mesh.vertexSize,
+        reinterpret_cast<const uint32_t *>(data + mesh.vertexSize),
+        mesh.indexCount);
+  };
+
+  ModelHandle model = co_await uploadModelAsync(
+      name, getDirectory(path), getDiffuseTextures(pack),
+      static_cast<uint32_t>(packMeshes.size()), loadMesh);
+
+  ASH_INFO("Loaded {} meshes of {} from {}", packMeshes.size(), name, path);
+
+  co_return model;
+}
+
 } // namespace Ash::Helper
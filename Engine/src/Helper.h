@@ -6,8 +6,15 @@
 #include <glm/glm.hpp>
 
 #include <array>
+#include <filesystem>
+#include <string>
 #include <vector>
 
+#include "MappedFile.h"
+#include "Pipeline.h"
+#include "SlotMap.h"
+#include "Task.h"
+
 namespace Ash {
 
 struct UniformBuffer {
@@ -61,41 +68,164 @@ struct IndexedVertexBuffer {
 
   vk::Buffer buffer;
   VmaAllocation bufferAllocation;
+
+  // Batch copying the data in and the staging copy it reads from, which is
+  // only valid until that batch completes. Host visible buffers aren't staged
+  uint64_t uploadSerial{0};
+  const char *staged{nullptr};
 };
 
+// refCount counts the models, materials or renderables using a resource.
+// Unreferenced resources stay loaded until unloaded or evicted. contentHash
+// and the texture's source file narrow down loads of identical data, which
+// then share one resource
 struct Mesh {
   std::string name;
 
   IndexedVertexBuffer ivb;
+  uint32_t refCount{0};
+  uint64_t contentHash{0};
 };
 
+using MeshHandle = Handle<Mesh>;
+
 struct Texture {
   std::string name;
+  uint32_t width;
+  uint32_t height;
 
   vk::Image image;
   VmaAllocation imageAllocation;
   vk::ImageView imageView;
+  uint32_t refCount{0};
+
+  // Encoded file the texture was loaded from and its state at the time
+  std::string path;
+  uint64_t fileSize{0};
+  std::filesystem::file_time_type modified;
+
+  // Batch copying the pixels in
+  uint64_t uploadSerial{0};
 };
 
+using TextureHandle = Handle<Texture>;
+
 struct Material {
-  std::string diffuse;
+  TextureHandle diffuse;
 
   std::vector<vk::DescriptorSet> sets;
+  uint32_t refCount{0};
+  uint64_t contentHash{0};
 };
 
+using MaterialHandle = Handle<Material>;
+
+// Meshes and materials pair up by index
 struct Model {
   std::string name;
 
-  std::vector<std::string> meshes;
-  std::vector<Material> materials;
+  std::vector<MeshHandle> meshes;
+  std::vector<MaterialHandle> materials;
+  uint32_t refCount{0};
+
+  // Last frame that drew the model, eviction drops the oldest first
+  uint64_t lastUsedFrame{0};
+};
+
+using ModelHandle = Handle<Model>;
+
+// CPU side result of importing a model file, before anything is uploaded
+struct ImportedMesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  uint32_t material;
+
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+};
+
+// A node of the source file drawing meshes, transform is its world transform
+struct ImportedInstance {
+  std::vector<uint32_t> meshes;
+  glm::mat4 transform;
 };
 
+struct ImportedModel {
+  std::vector<ImportedMesh> meshes;
+
+  // Only filled when the hierarchy is kept, otherwise the meshes are already
+  // in world space and drawn once
+  std::vector<ImportedInstance> instances;
+
+  // Diffuse texture of each material relative to the model's directory,
+  // empty uses the fallback texture
+  std::vector<std::string> materials;
+
+  // Every file the importer read, used to invalidate cooked packs
+  std::vector<std::string> sourceFiles;
+};
+
+// Placement of a model imported with its hierarchy kept
+struct ModelInstance {
+  ModelHandle model;
+  glm::mat4 transform;
+};
+
+class Scene;
+
 namespace Helper {
 
-std::vector<char> readBinaryFile(const char *filename);
+MappedFile readBinaryFile(const char *filename,
+                          MappedFileAccess access = MappedFileAccess::Sequential);
+
+std::string getDirectory(const std::string &file);
+
+// glTF and OBJ files are read by the native importers unless Assimp flags
+// are given, anything they don't cover falls back to Assimp. Native and Assimp
+// force one path, used to compare them
+enum class ImportBackend { Auto, Native, Assimp };
+
+// Flatten bakes node transforms into the vertices and merges what it can,
+// Hierarchy keeps each mesh once in its local space and lists the nodes
+// drawing it
+enum class ImportMode { Flatten, Hierarchy };
+
+// Runs the importer without touching the renderer, shared with ash-cook
+bool importScene(const std::string &file, uint32_t flags, ImportedModel &model,
+                 ImportBackend backend = ImportBackend::Auto,
+                 ImportMode mode = ImportMode::Flatten);
+
 bool importModel(const std::string &name, const std::string &file,
                  uint32_t flags = 0);
 
+// Imports with the hierarchy kept. Each distinct set of meshes drawn by a
+// node becomes a model named name_<n>, and every node drawing it an instance.
+// Meshes are uploaded once however many nodes draw them
+bool importModelInstances(const std::string &name, const std::string &file,
+                          std::vector<ModelInstance> &instances,
+                          uint32_t flags = 0);
+
+// Spawns an entity with a Renderable and Transform per instance, placed
+// relative to root. Shear in the node transforms is dropped
+void spawnModelInstances(Scene &scene,
+                         const std::vector<ModelInstance> &instances,
+                         PipelineHandle pipeline,
+                         const glm::mat4 &root = glm::mat4(1.0f));
+
+// Loads a pack written by ash-cook, uploading mesh data straight from the
+// mapped file. Returns false if the pack is missing or invalid so callers can
+// fall back to importModel. Sources aren't hashed here, keeping packs up to
+// date is left to the cook target
+bool loadAssetPack(const std::string &name, const std::string &path);
+
+// Asynchronous importModel and loadAssetPack. Files are read on the thread
+// pool and uploaded one chunk per frame, so the frame loop keeps going. The
+// task finishes on the main thread once the model is GPU resident, with an
+// invalid handle if loading failed. Must be started on the main thread
+Task<ModelHandle> importModelAsync(std::string name, std::string file,
+                                   uint32_t flags = 0);
+Task<ModelHandle> loadAssetPackAsync(std::string name, std::string path);
+
 } // namespace Helper
 
 } // namespace Ash
@@ -0,0 +1,108 @@
+#include "ImageDecoder.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace Ash::Helper {
+
+namespace {
+
+// Memory the next output sized allocation on this thread is redirected to
+struct DecodeTarget {
+  void *memory;
+  size_t size;
+  bool claimed;
+};
+
+thread_local DecodeTarget target{};
+
+// stb_image takes the encoded size as an int and has nothing to read from an
+// empty mapping, whose data is null
+bool isDecodable(const void *data, size_t size) {
+  return data && size > 0 && size <= static_cast<size_t>(INT_MAX);
+}
+
+} // namespace
+
+namespace detail {
+
+void *stbiMalloc(size_t size) {
+  // The JPEG decoder asks for one byte more than the pixels it writes
+  if (target.memory && !target.claimed &&
+      (size == target.size || size == target.size + 1)) {
+    target.claimed = true;
+    return target.memory;
+  }
+
+  return std::malloc(size);
+}
+
+void *stbiRealloc(void *ptr, size_t size) {
+  if (!ptr || ptr != target.memory)
+    return std::realloc(ptr, size);
+
+  // Output buffers aren't resized in practice, move it to the heap if it is
+  void *heap = std::malloc(size);
+  if (heap)
+    std::memcpy(heap, ptr, std::min(size, target.size));
+  target.claimed = false;
+
+  return heap;
+}
+
+void stbiFree(void *ptr) {
+  if (ptr && ptr == target.memory) {
+    target.claimed = false;
+    return;
+  }
+
+  std::free(ptr);
+}
+
+} // namespace detail
+
+bool getImageInfo(const void *data, size_t size, int &width, int &height) {
+  if (!isDecodable(data, size))
+    return false;
+
+  int channels;
+  return stbi_info_from_memory(static_cast<const stbi_uc *>(data),
+                               static_cast<int>(size), &width, &height,
+                               &channels);
+}
+
+bool decodeImage(const void *data, size_t size, void *dst, size_t pixelSize) {
+  if (!isDecodable(data, size))
+    return false;
+
+  target = {dst, pixelSize, false};
+
+  int width, height, channels;
+  stbi_uc *pixels = stbi_load_from_memory(static_cast<const stbi_uc *>(data),
+                                          static_cast<int>(size), &width,
+                                          &height, &channels, STBI_rgb_alpha);
+
+  target = {};
+
+  if (!pixels)
+    return false;
+
+  if (static_cast<size_t>(width) * height * 4 != pixelSize) {
+    if (pixels != dst)
+      stbi_image_free(pixels);
+    return false;
+  }
+
+  if (pixels != dst) {
+    std::memcpy(dst, pixels, pixelSize);
+    stbi_image_free(pixels);
+  }
+
+  return true;
+}
+
+} // namespace Ash::Helper
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Ash::Helper {
+
+// Reads the dimensions of an encoded image without decoding it. Both
+// functions reject empty input and input over 2 GiB
+bool getImageInfo(const void *data, size_t size, int &width, int &height);
+
+// Decodes an image as RGBA8 into caller provided memory holding
+// width * height * 4 bytes plus one byte of slack the JPEG decoder reserves.
+// stb_image is steered into using that memory as its output buffer so pixels
+// are written once, formats that decode through an intermediate buffer fall
+// back to a single copy
+bool decodeImage(const void *data, size_t size, void *dst, size_t pixelSize);
+
+namespace detail {
+
+// Allocation hooks stb_image is compiled with, see LibImplementations.cpp
+void *stbiMalloc(size_t size);
+void *stbiRealloc(void *ptr, size_t size);
+void stbiFree(void *ptr);
+
+} // namespace detail
+
+} // namespace Ash::Helper
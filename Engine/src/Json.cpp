@@ -0,0 +1,301 @@
+#include "Json.h"
+
+#include <charconv>
+#include <cmath>
+
+namespace Ash {
+
+static const JsonValue nullValue;
+
+// Deeper documents are rejected instead of overflowing the stack
+static constexpr uint32_t MAX_DEPTH = 256;
+
+class JsonParser {
+public:
+  JsonParser(std::string_view text) : text(text) {}
+
+  bool parseDocument(JsonValue &value) {
+    if (!parseValue(value, 0))
+      return false;
+
+    skipWhitespace();
+    if (position != text.size())
+      return fail("Unexpected trailing characters");
+
+    return true;
+  }
+
+  std::string error;
+
+private:
+  bool fail(const char *message) {
+    error = std::string(message) + " at offset " + std::to_string(position);
+    return false;
+  }
+
+  void skipWhitespace() {
+    while (position < text.size() &&
+           (text[position] == ' ' || text[position] == '\t' ||
+            text[position] == '\n' || text[position] == '\r'))
+      position++;
+  }
+
+  bool consume(std::string_view literal) {
+    if (text.substr(position, literal.size()) != literal)
+      return false;
+    position += literal.size();
+    return true;
+  }
+
+  bool parseValue(JsonValue &value, uint32_t depth) {
+    if (depth > MAX_DEPTH)
+      return fail("Document nested too deeply");
+
+    skipWhitespace();
+    if (position >= text.size())
+      return fail("Unexpected end of document");
+
+    switch (text[position]) {
+    case '{':
+      return parseObject(value, depth);
+    case '[':
+      return parseArray(value, depth);
+    case '"':
+      value.type = JsonValue::Type::String;
+      return parseString(value.string);
+    case 't':
+    case 'f':
+      value.type = JsonValue::Type::Bool;
+      value.boolean = text[position] == 't';
+      if (!consume(value.boolean ? "true" : "false"))
+        return fail("Invalid literal");
+      return true;
+    case 'n':
+      if (!consume("null"))
+        return fail("Invalid literal");
+      return true;
+    default:
+      return parseNumber(value);
+    }
+  }
+
+  bool parseObject(JsonValue &value, uint32_t depth) {
+    value.type = JsonValue::Type::Object;
+    position++;
+
+    skipWhitespace();
+    if (position < text.size() && text[position] == '}') {
+      position++;
+      return true;
+    }
+
+    while (true) {
+      skipWhitespace();
+      if (position >= text.size() || text[position] != '"')
+        return fail("Expected object key");
+
+      std::string &key = value.keys.emplace_back();
+      if (!parseString(key))
+        return false;
+
+      skipWhitespace();
+      if (position >= text.size() || text[position] != ':')
+        return fail("Expected ':'");
+      position++;
+
+      if (!parseValue(value.values.emplace_back(), depth + 1))
+        return false;
+
+      skipWhitespace();
+      if (position < text.size() && text[position] == ',') {
+        position++;
+      } else if (position < text.size() && text[position] == '}') {
+        position++;
+        return true;
+      } else {
+        return fail("Expected ',' or '}'");
+      }
+    }
+  }
+
+  bool parseArray(JsonValue &value, uint32_t depth) {
+    value.type = JsonValue::Type::Array;
+    position++;
+
+    skipWhitespace();
+    if (position < text.size() && text[position] == ']') {
+      position++;
+      return true;
+    }
+
+    while (true) {
+      if (!parseValue(value.values.emplace_back(), depth + 1))
+        return false;
+
+      skipWhitespace();
+      if (position < text.size() && text[position] == ',') {
+        position++;
+      } else if (position < text.size() && text[position] == ']') {
+        position++;
+        return true;
+      } else {
+        return fail("Expected ',' or ']'");
+      }
+    }
+  }
+
+  bool parseNumber(JsonValue &value) {
+    // from_chars doesn't take a leading '+', which JSON doesn't allow either
+    const char *begin = text.data() + position;
+    const char *end = text.data() + text.size();
+
+    auto [last, result] = std::from_chars(begin, end, value.number);
+    if (result != std::errc() || !std::isfinite(value.number))
+      return fail("Invalid number");
+
+    value.type = JsonValue::Type::Number;
+    position += last - begin;
+    return true;
+  }
+
+  bool parseHex(uint32_t &code) {
+    if (position + 4 > text.size())
+      return fail("Truncated escape");
+
+    const char *begin = text.data() + position;
+    auto [last, result] = std::from_chars(begin, begin + 4, code, 16);
+    if (result != std::errc() || last != begin + 4)
+      return fail("Invalid escape");
+
+    position += 4;
+    return true;
+  }
+
+  static void appendUtf8(std::string &string, uint32_t code) {
+    if (code < 0x80) {
+      string += static_cast<char>(code);
+    } else if (code < 0x800) {
+      string += static_cast<char>(0xC0 | (code >> 6));
+      string += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      string += static_cast<char>(0xE0 | (code >> 12));
+      string += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      string += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      string += static_cast<char>(0xF0 | (code >> 18));
+      string += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      string += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      string += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  bool parseString(std::string &string) {
+    position++;
+
+    while (true) {
+      // Copy runs without escapes in one go
+      size_t start = position;
+      while (position < text.size() && text[position] != '"' &&
+             text[position] != '\\')
+        position++;
+      string.append(text.substr(start, position - start));
+
+      if (position >= text.size())
+        return fail("Unterminated string");
+
+      if (text[position++] == '"')
+        return true;
+
+      if (position >= text.size())
+        return fail("Unterminated string");
+
+      char escape = text[position++];
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        string += escape;
+        break;
+      case 'b':
+        string += '\b';
+        break;
+      case 'f':
+        string += '\f';
+        break;
+      case 'n':
+        string += '\n';
+        break;
+      case 'r':
+        string += '\r';
+        break;
+      case 't':
+        string += '\t';
+        break;
+      case 'u': {
+        uint32_t code;
+        if (!parseHex(code))
+          return false;
+
+        // Characters outside the BMP are escaped as surrogate pairs
+        if (code >= 0xD800 && code < 0xDC00 && consume("\\u")) {
+          uint32_t low;
+          if (!parseHex(low))
+            return false;
+          if (low >= 0xDC00 && low < 0xE000)
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        appendUtf8(string, code);
+        break;
+      }
+      default:
+        return fail("Invalid escape");
+      }
+    }
+  }
+
+  std::string_view text;
+  size_t position{0};
+};
+
+bool JsonValue::parse(std::string_view text, JsonValue &value,
+                      std::string *error) {
+  value = JsonValue();
+
+  JsonParser parser(text);
+  if (parser.parseDocument(value))
+    return true;
+
+  if (error)
+    *error = parser.error;
+  return false;
+}
+
+uint32_t JsonValue::asUint(uint32_t fallback) const {
+  if (type != Type::Number || number < 0.0 || number > UINT32_MAX ||
+      number != std::floor(number))
+    return fallback;
+  return static_cast<uint32_t>(number);
+}
+
+bool JsonValue::contains(std::string_view key) const {
+  for (const std::string &k : keys)
+    if (k == key)
+      return true;
+  return false;
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const {
+  if (type != Type::Array || index >= values.size())
+    return nullValue;
+  return values[index];
+}
+
+const JsonValue &JsonValue::operator[](std::string_view key) const {
+  for (size_t i = 0; i < keys.size(); i++)
+    if (keys[i] == key)
+      return values[i];
+  return nullValue;
+}
+
+} // namespace Ash
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ash {
+
+// Read-only JSON document, enough for glTF. Objects keep their keys in file
+// order and are searched linearly, they are small in every format we read.
+// Missing keys and out of range indices return a shared null value so lookups
+// can be chained
+class JsonValue {
+public:
+  enum class Type { Null, Bool, Number, String, Array, Object };
+
+  static bool parse(std::string_view text, JsonValue &value,
+                    std::string *error = nullptr);
+
+  inline Type getType() const { return type; }
+  inline bool isNull() const { return type == Type::Null; }
+  inline bool isNumber() const { return type == Type::Number; }
+  inline bool isString() const { return type == Type::String; }
+  inline bool isArray() const { return type == Type::Array; }
+  inline bool isObject() const { return type == Type::Object; }
+
+  inline bool asBool(bool fallback = false) const {
+    return type == Type::Bool ? boolean : fallback;
+  }
+
+  inline double asNumber(double fallback = 0.0) const {
+    return type == Type::Number ? number : fallback;
+  }
+
+  uint32_t asUint(uint32_t fallback = 0) const;
+
+  inline const std::string &asString() const { return string; }
+
+  // Elements of an array or values of an object
+  inline size_t size() const { return values.size(); }
+  inline const std::vector<JsonValue> &getValues() const { return values; }
+  inline const std::vector<std::string> &getKeys() const { return keys; }
+
+  bool contains(std::string_view key) const;
+
+  const JsonValue &operator[](size_t index) const;
+  const JsonValue &operator[](std::string_view key) const;
+
+private:
+  friend class JsonParser;
+
+  Type type{Type::Null};
+  bool boolean{false};
+  double number{0.0};
+  std::string string;
+
+  std::vector<std::string> keys;
+  std::vector<JsonValue> values;
+};
+
+} // namespace Ash
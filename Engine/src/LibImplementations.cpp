@@ -1,6 +1,11 @@
+#include "ImageDecoder.h"
+
 #ifndef ASH_DEBUG
 #define STBI_NO_SIMD
 #endif
+#define STBI_MALLOC(size) Ash::Helper::detail::stbiMalloc(size)
+#define STBI_REALLOC(ptr, size) Ash::Helper::detail::stbiRealloc(ptr, size)
+#define STBI_FREE(ptr) Ash::Helper::detail::stbiFree(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -0,0 +1,29 @@
+#include "MainThread.h"
+
+namespace Ash {
+
+std::thread::id MainThread::id;
+std::vector<std::function<void()>> MainThread::jobs;
+std::mutex MainThread::mutex;
+
+void MainThread::init() { id = std::this_thread::get_id(); }
+
+bool MainThread::isCurrent() { return std::this_thread::get_id() == id; }
+
+void MainThread::post(std::function<void()> job) {
+  std::lock_guard<std::mutex> lock(mutex);
+  jobs.push_back(std::move(job));
+}
+
+void MainThread::update() {
+  std::vector<std::function<void()>> current;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    current.swap(jobs);
+  }
+
+  for (std::function<void()> &job : current)
+    job();
+}
+
+} // namespace Ash
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <coroutine>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Ash {
+
+// Jobs for the thread running the frame loop, which owns the renderer and the
+// scene. App::run drains them once per frame before updating layers
+class MainThread {
+public:
+  static void init();
+
+  static bool isCurrent();
+
+  // Safe from any thread, the job runs during the next update
+  static void post(std::function<void()> job);
+
+  // Runs what was posted before the call, jobs posted while it runs wait for
+  // the next frame
+  static void update();
+
+  // co_await MainThread::schedule() continues the coroutine on the main
+  // thread, right away if it's already there
+  struct ScheduleAwaiter {
+    bool await_ready() const { return isCurrent(); }
+    void await_suspend(std::coroutine_handle<> handle) const {
+      post([handle]() { handle.resume(); });
+    }
+    void await_resume() const {}
+  };
+
+  static ScheduleAwaiter schedule() { return {}; }
+
+  // co_await MainThread::nextFrame() lets a frame render before continuing
+  struct NextFrameAwaiter {
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const {
+      post([handle]() { handle.resume(); });
+    }
+    void await_resume() const {}
+  };
+
+  static NextFrameAwaiter nextFrame() { return {}; }
+
+private:
+  static std::thread::id id;
+  static std::vector<std::function<void()>> jobs;
+  static std::mutex mutex;
+};
+
+} // namespace Ash
@@ -0,0 +1,208 @@
+#include "MappedFile.h"
+
+#ifdef ASH_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+namespace Ash {
+
+MappedFile::MappedFile(const std::string &path, MappedFileAccess access) {
+  open(path, access);
+}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  close();
+
+  mapping = std::exchange(other.mapping, nullptr);
+  length = std::exchange(other.length, 0);
+  opened = std::exchange(other.opened, false);
+#ifdef ASH_WINDOWS
+  fileHandle = std::exchange(other.fileHandle, nullptr);
+  mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+
+  return *this;
+}
+
+#ifdef ASH_WINDOWS
+
+bool MappedFile::open(const std::string &path, MappedFileAccess access) {
+  close();
+
+  DWORD flags = access == MappedFileAccess::Random ? FILE_FLAG_RANDOM_ACCESS
+                                                   : FILE_FLAG_SEQUENTIAL_SCAN;
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, flags, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  fileHandle = file;
+  length = static_cast<size_t>(fileSize.QuadPart);
+  opened = true;
+
+  // Empty files can't be mapped but are still valid
+  if (length == 0)
+    return true;
+
+  mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mappingHandle)
+    mapping = static_cast<const char *>(
+        MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+  if (!mapping) {
+    close();
+    return false;
+  }
+
+  if (access == MappedFileAccess::WillNeed)
+    advise(access, 0, length);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (mapping)
+    UnmapViewOfFile(mapping);
+  if (mappingHandle)
+    CloseHandle(mappingHandle);
+  if (fileHandle)
+    CloseHandle(fileHandle);
+
+  mapping = nullptr;
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+  length = 0;
+  opened = false;
+}
+
+void MappedFile::advise(MappedFileAccess access, size_t offset,
+                        size_t length) const {
+  if (!mapping || access != MappedFileAccess::WillNeed)
+    return;
+
+  WIN32_MEMORY_RANGE_ENTRY range{const_cast<char *>(mapping) + offset, length};
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+bool syncFile(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  bool synced = FlushFileBuffers(file);
+  CloseHandle(file);
+  return synced;
+}
+
+#else
+
+static int toAdvice(MappedFileAccess access) {
+  switch (access) {
+  case MappedFileAccess::Random:
+    return MADV_RANDOM;
+  case MappedFileAccess::WillNeed:
+    return MADV_WILLNEED;
+  case MappedFileAccess::Sequential:
+  default:
+    return MADV_SEQUENTIAL;
+  }
+}
+
+bool MappedFile::open(const std::string &path, MappedFileAccess access) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  length = static_cast<size_t>(st.st_size);
+  opened = true;
+
+  // Empty files can't be mapped but are still valid
+  if (length == 0) {
+    ::close(fd);
+    return true;
+  }
+
+  void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+
+  if (addr == MAP_FAILED) {
+    length = 0;
+    opened = false;
+    return false;
+  }
+
+  mapping = static_cast<const char *>(addr);
+  advise(access, 0, length);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (mapping)
+    munmap(const_cast<char *>(mapping), length);
+
+  mapping = nullptr;
+  length = 0;
+  opened = false;
+}
+
+void MappedFile::advise(MappedFileAccess access, size_t offset,
+                        size_t length) const {
+  if (!mapping)
+    return;
+
+  // madvise wants a page aligned start
+  static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t alignedOffset = offset & ~(pageSize - 1);
+
+  madvise(const_cast<char *>(mapping) + alignedOffset,
+          length + (offset - alignedOffset), toAdvice(access));
+}
+
+bool syncFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  bool synced = fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+#endif
+
+} // namespace Ash
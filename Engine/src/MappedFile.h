@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Ash {
+
+// How a mapping is going to be read, forwarded to the OS as a paging hint
+enum class MappedFileAccess { Sequential, Random, WillNeed };
+
+// Read-only view of a whole file mapped into memory. Moving transfers the
+// mapping, it is unmapped when the last owner is destroyed
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const std::string &path,
+             MappedFileAccess access = MappedFileAccess::Sequential);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  bool open(const std::string &path,
+            MappedFileAccess access = MappedFileAccess::Sequential);
+  void close();
+
+  // Re-hints a byte range, e.g. to prefetch a region that is about to be read
+  void advise(MappedFileAccess access, size_t offset, size_t length) const;
+
+  inline bool isOpen() const { return opened; }
+  inline const char *data() const { return mapping; }
+  inline size_t size() const { return length; }
+
+private:
+  const char *mapping{nullptr};
+  size_t length{0};
+  bool opened{false};
+
+#ifdef ASH_WINDOWS
+  void *fileHandle{nullptr};
+  void *mappingHandle{nullptr};
+#endif
+};
+
+// Flushes a file that was written and closed to disk, so renaming it over
+// another file can't leave an empty or torn file behind after a crash
+bool syncFile(const std::string &path);
+
+} // namespace Ash
@@ -0,0 +1,22 @@
+#include "MemoryStats.h"
+
+namespace Ash {
+
+const char *getMemoryCategoryName(MemoryCategory category) {
+  switch (category) {
+  case MemoryCategory::Geometry:
+    return "Geometry";
+  case MemoryCategory::Textures:
+    return "Textures";
+  case MemoryCategory::Uniforms:
+    return "Uniforms";
+  case MemoryCategory::Staging:
+    return "Staging";
+  case MemoryCategory::Attachments:
+    return "Attachments";
+  default:
+    return "Unknown";
+  }
+}
+
+} // namespace Ash
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Ash {
+
+// What an allocation is used for, tagged on every VMA allocation the
+// renderer makes
+enum class MemoryCategory : uint32_t {
+  Geometry,
+  Textures,
+  Uniforms,
+  Staging,
+  Attachments,
+  Count
+};
+
+const char *getMemoryCategoryName(MemoryCategory category);
+
+struct HeapMemoryStats {
+  uint32_t heapIndex;
+  bool deviceLocal;
+
+  // Bytes in use by this process and how much it can use before the driver
+  // starts evicting or failing, estimated from heap sizes without
+  // VK_EXT_memory_budget
+  uint64_t usage;
+  uint64_t budget;
+
+  // VkDeviceMemory blocks VMA allocated and the bytes handed out from them
+  uint32_t blockCount;
+  uint32_t allocationCount;
+  uint64_t blockBytes;
+  uint64_t allocationBytes;
+};
+
+struct CategoryMemoryStats {
+  uint32_t allocationCount = 0;
+  uint64_t allocationBytes = 0;
+
+  // Lifetime totals, for comparing allocation strategies
+  uint64_t peakAllocationBytes = 0;
+  uint64_t totalAllocationCount = 0;
+  uint64_t allocationNanoseconds = 0;
+};
+
+struct MemoryStats {
+  std::vector<HeapMemoryStats> heaps;
+  std::array<CategoryMemoryStats, static_cast<size_t>(MemoryCategory::Count)>
+      categories{};
+};
+
+} // namespace Ash
@@ -0,0 +1,326 @@
+#include "ObjImporter.h"
+
+#include <charconv>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+#include "Hash.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace Ash::Helper {
+
+// Zero based position, texture coordinate and normal of a face corner, -1
+// when the attribute is missing
+struct ObjCorner {
+  int32_t position;
+  int32_t texCoord;
+  int32_t normal;
+
+  bool operator==(const ObjCorner &other) const = default;
+};
+
+struct ObjCornerHash {
+  size_t operator()(const ObjCorner &corner) const {
+    uint64_t hash = static_cast<uint32_t>(corner.position);
+    hash = hashCombine(hash, static_cast<uint32_t>(corner.texCoord));
+    return hashCombine(hash, static_cast<uint32_t>(corner.normal));
+  }
+};
+
+// Cursor over one line of the file
+class ObjLine {
+public:
+  ObjLine(std::string_view text) : text(text) {}
+
+  std::string_view nextToken() {
+    skipWhitespace();
+    size_t start = position;
+    while (position < text.size() && text[position] != ' ' &&
+           text[position] != '\t')
+      position++;
+    return text.substr(start, position - start);
+  }
+
+  // The remainder of the line, file names may contain spaces
+  std::string_view rest() {
+    skipWhitespace();
+    std::string_view remainder = text.substr(position);
+    while (!remainder.empty() &&
+           (remainder.back() == ' ' || remainder.back() == '\t'))
+      remainder.remove_suffix(1);
+    return remainder;
+  }
+
+  float nextFloat() {
+    std::string_view token = nextToken();
+    float value = 0.0f;
+    std::from_chars(token.data(), token.data() + token.size(), value);
+    return value;
+  }
+
+private:
+  void skipWhitespace() {
+    while (position < text.size() &&
+           (text[position] == ' ' || text[position] == '\t'))
+      position++;
+  }
+
+  std::string_view text;
+  size_t position{0};
+};
+
+// Calls f(line) for every line with comments and carriage returns stripped
+template <typename F> static void forEachLine(const MappedFile &file, F &&f) {
+  std::string_view text(file.data(), file.size());
+
+  size_t position = 0;
+  while (position < text.size()) {
+    size_t end = text.find('\n', position);
+    if (end == std::string_view::npos)
+      end = text.size();
+
+    std::string_view line = text.substr(position, end - position);
+    position = end + 1;
+
+    size_t comment = line.find('#');
+    if (comment != std::string_view::npos)
+      line = line.substr(0, comment);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+
+    f(line);
+  }
+}
+
+class ObjLoader {
+public:
+  ObjLoader(const std::string &file, ImportedModel &model)
+      : file(file), directory(getDirectory(file)), model(model) {}
+
+  bool load() {
+    if (!parse())
+      return false;
+
+    build();
+    return true;
+  }
+
+private:
+  void loadMaterialLibrary(const std::string &path) {
+    MappedFile library;
+    if (!library.open(path)) {
+      ASH_WARN("Failed to open material library {}", path);
+      return;
+    }
+
+    model.sourceFiles.push_back(path);
+
+    forEachLine(library, [&](std::string_view text) {
+      ObjLine line(text);
+      std::string_view keyword = line.nextToken();
+
+      if (keyword == "newmtl") {
+        materialIndices[std::string(line.rest())] =
+            static_cast<uint32_t>(model.materials.size());
+        model.materials.emplace_back();
+      } else if (keyword == "map_Kd" && !model.materials.empty()) {
+        // Texture options come before the path, which is then the last token
+        std::string_view path = line.rest();
+        if (path.starts_with("-"))
+          path = path.substr(path.find_last_of(" \t") + 1);
+        model.materials.back() = std::string(path);
+      }
+    });
+  }
+
+  uint32_t getGroup(uint32_t material) {
+    auto [it, inserted] = groupsByMaterial.try_emplace(
+        material, static_cast<uint32_t>(groups.size()));
+    if (inserted) {
+      groups.emplace_back();
+      groupMaterials.push_back(material);
+    }
+    return it->second;
+  }
+
+  uint32_t getDefaultMaterial() {
+    if (defaultMaterial == UINT32_MAX) {
+      defaultMaterial = static_cast<uint32_t>(model.materials.size());
+      model.materials.emplace_back();
+    }
+    return defaultMaterial;
+  }
+
+  // Indices are one based, negative ones count back from the latest element
+  static bool resolveIndex(std::string_view token, size_t count,
+                           int32_t &index) {
+    if (token.empty()) {
+      index = -1;
+      return true;
+    }
+
+    int64_t value = 0;
+    auto [last, result] =
+        std::from_chars(token.data(), token.data() + token.size(), value);
+    if (result != std::errc() || value == 0)
+      return false;
+
+    value = value < 0 ? static_cast<int64_t>(count) + value : value - 1;
+    if (value < 0 || value >= static_cast<int64_t>(count))
+      return false;
+
+    index = static_cast<int32_t>(value);
+    return true;
+  }
+
+  bool parseCorner(std::string_view token, ObjCorner &corner) {
+    size_t first = token.find('/');
+    size_t second = first == std::string_view::npos
+                        ? std::string_view::npos
+                        : token.find('/', first + 1);
+
+    std::string_view position = token.substr(0, first);
+    std::string_view texCoord =
+        first == std::string_view::npos
+            ? std::string_view()
+            : token.substr(first + 1, second - first - 1);
+    std::string_view normal = second == std::string_view::npos
+                                  ? std::string_view()
+                                  : token.substr(second + 1);
+
+    return !position.empty() &&
+           resolveIndex(position, positions.size(), corner.position) &&
+           resolveIndex(texCoord, texCoords.size(), corner.texCoord) &&
+           resolveIndex(normal, normals.size(), corner.normal);
+  }
+
+  bool parse() {
+    MappedFile source;
+    if (!source.open(file))
+      return false;
+
+    model.sourceFiles.push_back(file);
+
+    uint32_t group = UINT32_MAX;
+    std::vector<ObjCorner> face;
+    bool valid = true;
+
+    forEachLine(source, [&](std::string_view text) {
+      if (!valid)
+        return;
+
+      ObjLine line(text);
+      std::string_view keyword = line.nextToken();
+
+      if (keyword == "v") {
+        float x = line.nextFloat();
+        float y = line.nextFloat();
+        float z = line.nextFloat();
+        positions.emplace_back(x, y, z);
+      } else if (keyword == "vn") {
+        float x = line.nextFloat();
+        float y = line.nextFloat();
+        float z = line.nextFloat();
+        normals.emplace_back(x, y, z);
+      } else if (keyword == "vt") {
+        float u = line.nextFloat();
+        float v = line.nextFloat();
+        texCoords.emplace_back(u, v);
+      } else if (keyword == "f") {
+        face.clear();
+        for (std::string_view token = line.nextToken(); !token.empty();
+             token = line.nextToken()) {
+          if (!parseCorner(token, face.emplace_back())) {
+            ASH_WARN("Invalid face in {}", file);
+            valid = false;
+            return;
+          }
+        }
+
+        if (group == UINT32_MAX)
+          group = getGroup(getDefaultMaterial());
+
+        // Polygons are triangulated as fans
+        std::vector<ObjCorner> &corners = groups[group];
+        for (size_t i = 2; i < face.size(); i++) {
+          corners.push_back(face[0]);
+          corners.push_back(face[i - 1]);
+          corners.push_back(face[i]);
+        }
+      } else if (keyword == "usemtl") {
+        auto it = materialIndices.find(std::string(line.rest()));
+        group = getGroup(it == materialIndices.end() ? getDefaultMaterial()
+                                                     : it->second);
+      } else if (keyword == "mtllib") {
+        loadMaterialLibrary(directory + std::string(line.rest()));
+      }
+    });
+
+    return valid;
+  }
+
+  // Each material becomes one mesh, corners with identical attributes share
+  // a vertex
+  void buildMesh(const std::vector<ObjCorner> &corners, ImportedMesh &mesh) {
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertexIndices;
+    vertexIndices.reserve(corners.size() / 2);
+
+    mesh.indices.reserve(corners.size());
+    mesh.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    mesh.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+    for (const ObjCorner &corner : corners) {
+      auto [it, inserted] = vertexIndices.try_emplace(
+          corner, static_cast<uint32_t>(mesh.vertices.size()));
+
+      if (inserted) {
+        Vertex &vertex = mesh.vertices.emplace_back();
+        vertex.pos = positions[corner.position];
+        vertex.normal =
+            corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+        vertex.texCoord = corner.texCoord >= 0 ? texCoords[corner.texCoord]
+                                               : glm::vec2(0.0f);
+
+        mesh.boundsMin = glm::min(mesh.boundsMin, vertex.pos);
+        mesh.boundsMax = glm::max(mesh.boundsMax, vertex.pos);
+      }
+
+      mesh.indices.push_back(it->second);
+    }
+  }
+
+  void build() {
+    model.meshes.resize(groups.size());
+    for (uint32_t i = 0; i < groups.size(); i++)
+      model.meshes[i].material = groupMaterials[i];
+
+    ThreadPool::parallelFor(groups.size(), [&](size_t i) {
+      buildMesh(groups[i], model.meshes[i]);
+    });
+  }
+
+  std::string file;
+  std::string directory;
+  ImportedModel &model;
+
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> texCoords;
+
+  std::unordered_map<std::string, uint32_t> materialIndices;
+  uint32_t defaultMaterial{UINT32_MAX};
+
+  std::vector<std::vector<ObjCorner>> groups;
+  std::unordered_map<uint32_t, uint32_t> groupsByMaterial;
+  std::vector<uint32_t> groupMaterials;
+};
+
+bool importObj(const std::string &file, ImportedModel &model) {
+  ObjLoader loader(file, model);
+  return loader.load();
+}
+
+} // namespace Ash::Helper
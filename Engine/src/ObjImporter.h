@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+#include "Helper.h"
+
+namespace Ash::Helper {
+
+// Reads .obj files and their material libraries without Assimp. The file is
+// parsed in one pass, then each material's faces are turned into an indexed
+// mesh on the thread pool, sharing vertices with identical attributes.
+// Returns false on malformed files so the caller can fall back to Assimp
+bool importObj(const std::string &file, ImportedModel &model);
+
+} // namespace Ash::Helper
@@ -1,5 +1,10 @@
 #include "Pipeline.h"
 
+#include <algorithm>
+
+#include "Core.h"
+#include "Log.h"
+
 namespace Ash {
 
 Pipeline::Pipeline(const std::string& vert, const std::string& frag,
@@ -15,4 +20,65 @@ Pipeline::Pipeline(const std::string& vert, const std::string& frag,
 
 Pipeline::~Pipeline() {}
 
+Pipeline& Pipeline::specialize(const std::string& constant,
+                               const std::vector<uint32_t>& values) {
+    ASH_ASSERT(!values.empty(), "Specialization constant {} has no values",
+               constant);
+
+    constants.push_back({constant, values});
+    return *this;
+}
+
+// Variants are mixed radix numbers with one digit per constant, the first
+// constant being the least significant
+uint32_t Pipeline::getVariantCount() const {
+    uint32_t count = 1;
+    for (const SpecializationConstant& constant : constants)
+        count *= static_cast<uint32_t>(constant.values.size());
+    return count;
+}
+
+uint32_t Pipeline::getVariant(
+    const std::vector<std::pair<std::string, uint32_t>>& values) const {
+    uint32_t variant = 0;
+    for (const auto& [constantName, value] : values) {
+        uint32_t stride = 1;
+        bool found = false;
+
+        for (const SpecializationConstant& constant : constants) {
+            if (constant.name == constantName) {
+                auto it = std::find(constant.values.begin(),
+                                    constant.values.end(), value);
+                ASH_ASSERT(it != constant.values.end(),
+                           "Pipeline {} has no variant with {} = {}", name,
+                           constantName, value);
+
+                variant += stride * static_cast<uint32_t>(
+                                        it - constant.values.begin());
+                found = true;
+                break;
+            }
+            stride *= static_cast<uint32_t>(constant.values.size());
+        }
+
+        ASH_ASSERT(found, "Pipeline {} has no specialization constant {}",
+                   name, constantName);
+    }
+
+    return variant;
+}
+
+std::vector<uint32_t> Pipeline::getConstants(uint32_t variant) const {
+    std::vector<uint32_t> result;
+    result.reserve(constants.size());
+
+    for (const SpecializationConstant& constant : constants) {
+        uint32_t count = static_cast<uint32_t>(constant.values.size());
+        result.push_back(constant.values[variant % count]);
+        variant /= count;
+    }
+
+    return result;
+}
+
 }  // namespace Ash
@@ -1,21 +1,52 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "SlotMap.h"
+
 namespace Ash {
 
 enum ShaderStages { VERTEX_SHADER_STAGE, FRAGMENT_SHADER_STAGE };
 
+// A specialization constant and the values to compile variants for, its
+// constant_id is the order it was declared in
+struct SpecializationConstant {
+    std::string name;
+    std::vector<uint32_t> values;
+};
+
 class Pipeline {
    public:
     Pipeline(const std::string& vert, const std::string& frag,
              const std::string& name);
     ~Pipeline();
 
+    // Declares the next constant_id, one variant is compiled for every
+    // combination of values and the first value is the default
+    Pipeline& specialize(const std::string& constant,
+                         const std::vector<uint32_t>& values);
+
+    uint32_t getVariantCount() const;
+
+    // Variant with the given constants set, the rest keep their default
+    uint32_t getVariant(
+        const std::vector<std::pair<std::string, uint32_t>>& values) const;
+
+    // Constant values of a variant in constant_id order
+    std::vector<uint32_t> getConstants(uint32_t variant) const;
+
     std::vector<std::string> paths;
     std::vector<Ash::ShaderStages> stages;
+    std::vector<SpecializationConstant> constants;
     std::string name;
 };
 
+// Names one compiled variant, its index is the slot in the renderer's
+// pipeline array. Pipelines live as long as the renderer so the generation
+// stays 0
+using PipelineHandle = Handle<Pipeline>;
+
 }  // namespace Ash
@@ -1,45 +1,503 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Hash.h"
+#include "MainThread.h"
+
 namespace Ash {
 
 std::shared_ptr<VulkanAPI> Renderer::api = std::make_shared<VulkanAPI>();
 std::vector<Pipeline> Renderer::pipelines;
-std::unordered_map<std::string, Mesh> Renderer::meshes;
+RendererConfig Renderer::config;
 std::shared_ptr<Scene> Renderer::scene;
-std::unordered_map<std::string, Texture> Renderer::textures;
-std::unordered_map<std::string, Model> Renderer::models;
+SlotMap<Mesh> Renderer::meshes;
+SlotMap<Texture> Renderer::textures;
+SlotMap<Material> Renderer::materials;
+SlotMap<Model> Renderer::models;
+ConcurrentMap<std::string, MeshHandle> Renderer::meshNames;
+ConcurrentMap<std::string, TextureHandle> Renderer::textureNames;
+ConcurrentMap<std::string, ModelHandle> Renderer::modelNames;
+std::vector<Renderer::PendingName<Mesh>> Renderer::pendingMeshNames;
+std::vector<Renderer::PendingName<Texture>> Renderer::pendingTextureNames;
+ContentStore<Mesh> Renderer::meshContents;
+ContentStore<Texture> Renderer::textureContents;
+ConcurrentMap<uint64_t, MaterialHandle> Renderer::materialContents;
 Camera Renderer::camera;
+uint64_t Renderer::evictionFrame = 0;
+bool Renderer::evictionExhausted = false;
+uint32_t Renderer::asyncLoads = 0;
+
+template <typename K, typename T>
+static Handle<T> findHandle(const ConcurrentMap<K, Handle<T>> &handles,
+                            const K &key) {
+  Handle<T> handle;
+  handles.find(key, handle);
+  return handle;
+}
+
+// Also sees names still waiting for their upload, so the main thread doesn't
+// load them twice
+template <typename T, typename Pending>
+static Handle<T> findLoaded(const ConcurrentMap<std::string, Handle<T>> &names,
+                            const Pending &pending, const std::string &name) {
+  for (const auto &entry : pending)
+    if (entry.name == name)
+      return entry.handle;
+  return findHandle(names, name);
+}
+
+MeshHandle Renderer::findMesh(const std::string &name) {
+  return findHandle(meshNames, name);
+}
 
-void Renderer::loadModel(const std::string &name,
-                         const std::vector<std::string> &meshes,
-                         const std::vector<Material> &materials) {
-  models[name] = {name, meshes, materials};
+ModelHandle Renderer::findModel(const std::string &name) {
+  return findHandle(modelNames, name);
+}
+
+TextureHandle Renderer::findTexture(const std::string &name) {
+  return findHandle(textureNames, name);
+}
+
+PipelineHandle Renderer::findPipeline(const std::string &name,
+                                      uint32_t variant) {
+  return {api->getPipelineID(name, variant), 0};
+}
+
+ModelHandle Renderer::loadModel(const std::string &name,
+                                const std::vector<MeshHandle> &meshes,
+                                const std::vector<MaterialHandle> &materials) {
+  ASH_ASSERT(meshes.size() == materials.size(),
+             "Model {} needs one material per mesh", name);
+
+  if (ModelHandle existing = findModel(name); existing.isValid()) {
+    ASH_WARN("Model ID {} already exists, aborting model loading", name);
+    return existing;
+  }
+
+  for (MeshHandle mesh : meshes)
+    Renderer::meshes.get(mesh).refCount++;
+  for (MaterialHandle material : materials)
+    Renderer::materials.get(material).refCount++;
+
+  // Counts as drawn now so a fresh load isn't the first thing evicted
+  ModelHandle handle =
+      models.insert({name, meshes, materials, 0, api->getFrameNumber()});
+  modelNames.assign(name, handle);
+  return handle;
 }
 
 void Renderer::loadPipeline(const Pipeline &pipeline) {
   pipelines.push_back(pipeline);
 }
 
-void Renderer::loadMesh(const std::string &name,
-                        const std::vector<Vertex> &verts,
-                        const std::vector<uint32_t> &indices) {
-  meshes[name] = {name, api->createIndexedVertexArray(verts, indices)};
+void Renderer::setConfig(const RendererConfig &config) {
+  Renderer::config = config;
+}
+
+MeshHandle Renderer::loadMesh(const std::string &name,
+                              const std::vector<Vertex> &verts,
+                              const std::vector<uint32_t> &indices) {
+  return loadMesh(name, verts.data(), verts.size() * sizeof(Vertex),
+                  indices.data(), static_cast<uint32_t>(indices.size()));
+}
+
+MeshHandle Renderer::loadMesh(const std::string &name, const void *vertices,
+                              uint64_t vertSize, const uint32_t *indices,
+                              uint32_t indexCount) {
+  if (MeshHandle existing = findLoaded(meshNames, pendingMeshNames, name);
+      existing.isValid()) {
+    ASH_WARN("Mesh ID {} already exists, aborting mesh loading", name);
+    return existing;
+  }
+
+  // Vertex and index data are hashed separately so the split between them
+  // is part of the key
+  uint64_t contentHash =
+      hash64(vertices, vertSize,
+             hash64(indices, indexCount * sizeof(uint32_t), vertSize));
+
+  // Only shared once the bytes compare equal, a hash match alone could alias
+  // different geometry
+  MeshHandle shared =
+      meshContents.find(contentHash, [&](MeshHandle candidate) {
+        return api->matchesIndexedVertexArray(meshes.get(candidate).ivb,
+                                              vertices, vertSize, indices,
+                                              indexCount);
+      });
+  if (shared.isValid()) {
+    ASH_TRACE("Mesh {} has the same data as {}", name,
+              meshes.get(shared).name);
+    publishName(meshNames, pendingMeshNames, name, shared,
+                meshes.get(shared).ivb.uploadSerial);
+    return shared;
+  }
+
+  if (meshContents.contains(contentHash))
+    ASH_WARN("Content hash of mesh {} collides with a different mesh", name);
+
+  MeshHandle handle = meshes.insert(
+      {name,
+       api->createIndexedVertexArray(vertices, vertSize, indices, indexCount),
+       0, contentHash});
+  publishName(meshNames, pendingMeshNames, name, handle,
+              meshes.get(handle).ivb.uploadSerial);
+  meshContents.insert(contentHash, handle);
+  return handle;
+}
+
+// Compares against the file a texture was loaded from, as long as it hasn't
+// been written since
+static bool isSameTextureFile(const Texture &texture, const MappedFile &file) {
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(texture.path, error);
+  if (error || modified != texture.modified)
+    return false;
+
+  MappedFile source;
+  return source.open(texture.path) && source.size() == file.size() &&
+         std::memcmp(source.data(), file.data(), file.size()) == 0;
+}
+
+TextureHandle Renderer::loadTexture(const std::string &name,
+                                    const std::string &path) {
+  if (TextureHandle existing =
+          findLoaded(textureNames, pendingTextureNames, name);
+      existing.isValid())
+    return existing;
+
+  MappedFile file = Helper::readBinaryFile(path.c_str());
+
+  // Keyed by the size of the encoded file, which mapping it already tells.
+  // Files are only read here when one of the same size is loaded, anything
+  // else is first touched by the decode job
+  TextureHandle shared =
+      textureContents.find(file.size(), [&](TextureHandle candidate) {
+        return isSameTextureFile(textures.get(candidate), file);
+      });
+  if (shared.isValid()) {
+    ASH_TRACE("Texture {} has the same data as {}", name,
+              textures.get(shared).name);
+    publishName(textureNames, pendingTextureNames, name, shared,
+                textures.get(shared).uploadSerial);
+    return shared;
+  }
+
+  // Filled in before the slot is published
+  Texture texture{name};
+  texture.path = path;
+  texture.fileSize = file.size();
+  std::error_code error;
+  texture.modified = std::filesystem::last_write_time(path, error);
+  api->createTextureImage(std::move(file), path, texture);
+
+  uint64_t fileSize = texture.fileSize;
+  uint64_t uploadSerial = texture.uploadSerial;
+  TextureHandle handle = textures.insert(std::move(texture));
+  publishName(textureNames, pendingTextureNames, name, handle, uploadSerial);
+  textureContents.insert(fileSize, handle);
+  return handle;
+}
+
+MaterialHandle Renderer::loadMaterial(const Material &material) {
+  // A material is only its texture, equal ones share descriptor sets
+  uint64_t contentHash =
+      (static_cast<uint64_t>(material.diffuse.generation) << 32) |
+      material.diffuse.index;
+  if (MaterialHandle shared = findHandle(materialContents, contentHash);
+      shared.isValid())
+    return shared;
+
+  textures.get(material.diffuse).refCount++;
+
+  // Shared by every renderable drawing the material
+  Material inserted = material;
+  inserted.contentHash = contentHash;
+  api->createMaterialDescriptorSets(inserted);
+
+  MaterialHandle handle = materials.insert(std::move(inserted));
+  materialContents.assign(contentHash, handle);
+  return handle;
+}
+
+void Renderer::acquireModel(ModelHandle handle) {
+  if (Model *model = models.find(handle))
+    model->refCount++;
+  else
+    ASH_WARN("Acquiring a model that isn't loaded");
+}
+
+void Renderer::acquireResources(MeshHandle mesh, MaterialHandle material) {
+  meshes.get(mesh).refCount++;
+  materials.get(material).refCount++;
+}
+
+uint64_t Renderer::releaseResources(MeshHandle mesh, MaterialHandle material) {
+  uint64_t freed = 0;
+  if (--meshes.get(mesh).refCount == 0)
+    freed += freeMesh(mesh);
+  return freed + releaseMaterial(material);
+}
+
+void Renderer::releaseModel(ModelHandle handle) {
+  if (Model *model = models.find(handle))
+    model->refCount--;
+}
+
+bool Renderer::unloadModel(ModelHandle handle) {
+  Model *model = models.find(handle);
+  if (!model)
+    return false;
+
+  if (model->refCount > 0) {
+    ASH_WARN("Model {} is still used by {} renderables, not unloading",
+             model->name, model->refCount);
+    return false;
+  }
+
+  freeModel(handle);
+  return true;
+}
+
+bool Renderer::unloadModel(const std::string &name) {
+  return unloadModel(findModel(name));
+}
+
+bool Renderer::unloadMesh(MeshHandle handle) {
+  Mesh *mesh = meshes.find(handle);
+  if (!mesh)
+    return false;
+
+  if (mesh->refCount > 0) {
+    ASH_WARN("Mesh {} is still used by {} models, not unloading", mesh->name,
+             mesh->refCount);
+    return false;
+  }
+
+  freeMesh(handle);
+  return true;
+}
+
+bool Renderer::unloadTexture(TextureHandle handle) {
+  Texture *texture = textures.find(handle);
+  if (!texture)
+    return false;
+
+  if (texture->refCount > 0) {
+    ASH_WARN("Texture {} is still used by {} materials, not unloading",
+             texture->name, texture->refCount);
+    return false;
+  }
+
+  freeTexture(handle);
+  return true;
+}
+
+uint64_t Renderer::freeModel(ModelHandle handle) {
+  Model &model = models.get(handle);
+  uint64_t freed = 0;
+
+  for (size_t i = 0; i < model.meshes.size(); i++)
+    freed += releaseResources(model.meshes[i], model.materials[i]);
+
+  modelNames.erase(model.name, handle);
+  models.erase(handle);
+
+  return freed;
+}
+
+uint64_t Renderer::freeMesh(MeshHandle handle) {
+  Mesh &mesh = meshes.get(handle);
+  uint64_t size = api->getAllocationSize(mesh.ivb.bufferAllocation);
+
+  api->destroyIndexedVertexArray(mesh.ivb);
+  // Unpublished before the slot goes
+  meshContents.erase(mesh.contentHash, handle);
+  meshNames.eraseIf([&](const std::string &, MeshHandle name) {
+    return name == handle;
+  });
+  std::erase_if(pendingMeshNames,
+                [&](const auto &pending) { return pending.handle == handle; });
+  meshes.erase(handle);
+
+  return size;
 }
 
-void Renderer::loadTexture(const std::string &name, const std::string &path) {
-  if (textures.contains(name)) {
-    ASH_WARN("Texture ID {} already exists, aborting texture loading", name);
+uint64_t Renderer::freeTexture(TextureHandle handle) {
+  Texture &texture = textures.get(handle);
+  uint64_t size = api->getAllocationSize(texture.imageAllocation);
+
+  api->destroyTexture(texture);
+  textureContents.erase(texture.fileSize, handle);
+  textureNames.eraseIf([&](const std::string &, TextureHandle name) {
+    return name == handle;
+  });
+  std::erase_if(pendingTextureNames,
+                [&](const auto &pending) { return pending.handle == handle; });
+  textures.erase(handle);
+
+  return size;
+}
+
+// Materials are owned by the models using them and go with the last one
+uint64_t Renderer::releaseMaterial(MaterialHandle handle) {
+  Material &material = materials.get(handle);
+  if (--material.refCount > 0)
+    return 0;
+
+  api->releaseMaterialDescriptorSets(std::move(material.sets));
+  uint64_t freed = releaseTexture(material.diffuse);
+  materialContents.erase(material.contentHash, handle);
+  materials.erase(handle);
+  return freed;
+}
+
+uint64_t Renderer::releaseTexture(TextureHandle handle) {
+  if (--textures.get(handle).refCount > 0)
+    return 0;
+  return freeTexture(handle);
+}
+
+template <typename T>
+void Renderer::publishName(ConcurrentMap<std::string, Handle<T>> &names,
+                           std::vector<PendingName<T>> &pending,
+                           const std::string &name, Handle<T> handle,
+                           uint64_t uploadSerial) {
+  if (api->isUploadComplete(uploadSerial))
+    names.assign(name, handle);
+  else
+    pending.push_back({name, handle, uploadSerial});
+}
+
+void Renderer::publishUploadedNames() {
+  auto publish = [](auto &names, auto &pending) {
+    std::erase_if(pending, [&](const auto &entry) {
+      if (!api->isUploadComplete(entry.uploadSerial))
+        return false;
+      names.assign(entry.name, entry.handle);
+      return true;
+    });
+  };
+  publish(meshNames, pendingMeshNames);
+  publish(textureNames, pendingTextureNames);
+}
+
+void Renderer::evictUnusedResources() {
+  if (config.evictionThreshold <= 0.0f && config.memoryBudget == 0)
+    return;
+
+  if (asyncLoads > 0)
     return;
+
+  // Frees from the last round only show up once their frames retire
+  if (api->getCompletedFrameNumber() < evictionFrame)
+    return;
+
+  uint64_t usage = 0;
+  uint64_t budget = 0;
+  for (const HeapMemoryStats &heap : api->getMemoryStats().heaps) {
+    if (!heap.deviceLocal)
+      continue;
+    usage += heap.allocationBytes;
+    budget += heap.budget;
+  }
+
+  if (config.memoryBudget > 0)
+    budget = config.memoryBudget;
+  else
+    budget = static_cast<uint64_t>(budget * config.evictionThreshold);
+
+  if (usage <= budget) {
+    evictionExhausted = false;
+    return;
+  }
+
+  uint64_t excess = usage - budget;
+  uint64_t freed = 0;
+
+  std::vector<std::pair<uint64_t, ModelHandle>> candidates;
+  models.forEach([&](ModelHandle handle, Model &model) {
+    if (model.refCount == 0)
+      candidates.push_back({model.lastUsedFrame, handle});
+  });
+  std::sort(candidates.begin(), candidates.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  for (auto &[lastUsedFrame, handle] : candidates) {
+    if (freed >= excess)
+      break;
+
+    ASH_INFO("Evicting model {}, last drawn in frame {}",
+             models.get(handle).name, lastUsedFrame);
+    freed += freeModel(handle);
+  }
+
+  // Then anything loaded on its own that no model uses
+  std::vector<MeshHandle> unusedMeshes;
+  meshes.forEach([&](MeshHandle handle, Mesh &mesh) {
+    if (mesh.refCount == 0)
+      unusedMeshes.push_back(handle);
+  });
+  for (MeshHandle handle : unusedMeshes) {
+    if (freed >= excess)
+      break;
+    freed += freeMesh(handle);
+  }
+
+  std::vector<TextureHandle> unusedTextures;
+  textures.forEach([&](TextureHandle handle, Texture &texture) {
+    if (texture.refCount == 0)
+      unusedTextures.push_back(handle);
+  });
+  for (TextureHandle handle : unusedTextures) {
+    if (freed >= excess)
+      break;
+    freed += freeTexture(handle);
+  }
+
+  if (freed > 0) {
+    ASH_INFO("Evicted {} MiB to get under the {} MiB budget", freed >> 20,
+             budget >> 20);
+    evictionExhausted = false;
+  } else if (!evictionExhausted) {
+    ASH_WARN("Over the {} MiB memory budget with nothing left to evict",
+             budget >> 20);
+    evictionExhausted = true;
   }
-  api->createTextureImage(path, textures[name]);
+
+  evictionFrame = api->getFrameNumber();
 }
 
 void Renderer::init() {
-  api->init(pipelines);
-  loadTexture("white", "assets/textures/white.png");
+  api->init(pipelines, config);
+  // The fallback texture stays loaded for as long as the renderer
+  textures.get(loadTexture("white", "assets/textures/white.png")).refCount++;
 }
 
-void Renderer::render() { api->render(); }
+bool Renderer::UploadAwaiter::await_ready() const {
+  ASH_ASSERT(MainThread::isCurrent(),
+             "Uploads can only be awaited on the main thread");
+  return api->isUploadComplete(serial);
+}
+
+void Renderer::UploadAwaiter::await_suspend(
+    std::coroutine_handle<> handle) const {
+  MainThread::post([serial = serial, handle]() {
+    if (api->isUploadComplete(serial))
+      handle.resume();
+    else
+      UploadAwaiter{serial}.await_suspend(handle);
+  });
+}
+
+void Renderer::render() {
+  publishUploadedNames();
+  evictUnusedResources();
+  api->render();
+}
 
 void Renderer::cleanup() { api->cleanup(); }
 
@@ -47,6 +505,21 @@ void Renderer::setClearColor(const glm::vec4 &clearColor) {
   api->setClearColor(clearColor);
 }
 
+void Renderer::setVSync(bool vsync) { api->setVSync(vsync); }
+
+bool Renderer::dumpMemoryStats(const std::string &path, bool detailed) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    ASH_WARN("Failed to open {} for the memory statistics", path);
+    return false;
+  }
+
+  file << api->buildMemoryStatsJson(detailed);
+
+  ASH_INFO("Wrote memory statistics to {}", path);
+  return true;
+}
+
 void Renderer::setScene(std::shared_ptr<Scene> scene) {
   Renderer::scene = scene;
 }
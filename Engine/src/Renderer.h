@@ -2,12 +2,17 @@
 
 #include <glm/glm.hpp>
 
+#include <coroutine>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 #include "Camera.h"
+#include "ConcurrentMap.h"
+#include "ContentStore.h"
 #include "Helper.h"
 #include "Pipeline.h"
+#include "RendererConfig.h"
 #include "Scene.h"
 #include "VulkanAPI.h"
 
@@ -19,35 +24,109 @@ public:
   ~Renderer();
 
   static void loadPipeline(const Pipeline &pipeline);
-
-  static inline Mesh &getMesh(const std::string &name) { return meshes[name]; }
-  static inline bool hasMesh(const std::string &name) {
-    return meshes.count(name);
+  static void setConfig(const RendererConfig &config);
+
+  // Names are resolved to handles once at load time, draws only index.
+  // Lookups by handle or name are safe from any thread, loading and freeing
+  // happen on the main thread, which owns the GPU resources. Names are only
+  // found once the upload behind them has completed
+  static inline Mesh &getMesh(MeshHandle handle) { return meshes.get(handle); }
+  static inline Model &getModel(ModelHandle handle) {
+    return models.get(handle);
   }
-
-  static inline Model &getModel(const std::string &name) {
-    return models[name];
+  static inline Texture &getTexture(TextureHandle handle) {
+    return textures.get(handle);
   }
-
-  static inline Texture &getTexture(const std::string &name) {
-    return textures[name];
+  static inline Material &getMaterial(MaterialHandle handle) {
+    return materials.get(handle);
   }
 
-  static void loadModel(const std::string &name,
-                        const std::vector<std::string> &meshes,
-                        const std::vector<Material> &materials);
+  // Invalid handles are returned for unknown names
+  static MeshHandle findMesh(const std::string &name);
+  static ModelHandle findModel(const std::string &name);
+  static TextureHandle findTexture(const std::string &name);
+  static PipelineHandle findPipeline(const std::string &name,
+                                     uint32_t variant = 0);
+
+  static inline bool hasMesh(const std::string &name) {
+    return meshNames.contains(name);
+  }
 
-  static void loadMesh(const std::string &name,
-                       const std::vector<Vertex> &verts,
-                       const std::vector<uint32_t> &indices);
+  static inline SlotMap<Mesh> &getMeshes() { return meshes; }
+  static inline SlotMap<Texture> &getTextures() { return textures; }
+  static inline SlotMap<Material> &getMaterials() { return materials; }
+  static inline SlotMap<Model> &getModels() { return models; }
+
+  static ModelHandle loadModel(const std::string &name,
+                               const std::vector<MeshHandle> &meshes,
+                               const std::vector<MaterialHandle> &materials);
+
+  // Meshes, textures and materials are content addressed: loading data that
+  // is already resident under another name returns the existing resource,
+  // which the new name then refers to as well. Meshes are matched by hash and
+  // textures by file size, either way the bytes are compared before sharing
+  static MeshHandle loadMesh(const std::string &name,
+                             const std::vector<Vertex> &verts,
+                             const std::vector<uint32_t> &indices);
+  // Vertices already in GPU layout, e.g. straight from a mapped asset pack
+  static MeshHandle loadMesh(const std::string &name, const void *vertices,
+                             uint64_t vertSize, const uint32_t *indices,
+                             uint32_t indexCount);
+
+  // Loading a name twice returns the texture that is already loaded
+  static TextureHandle loadTexture(const std::string &name,
+                                   const std::string &path);
+
+  static MaterialHandle loadMaterial(const Material &material);
+
+  // Renderables hold a reference to their model for as long as they exist
+  static void acquireModel(ModelHandle handle);
+  static void releaseModel(ModelHandle handle);
+
+  // Loads reference the meshes and materials they create until a model takes
+  // them over, so another load finishing first can't free them. Releasing
+  // frees whatever ended up unused
+  static void acquireResources(MeshHandle mesh, MaterialHandle material);
+  static uint64_t releaseResources(MeshHandle mesh, MaterialHandle material);
+
+  // Asynchronous loads hold resources that no model references until their
+  // uploads finish, eviction waits while any are in flight
+  static inline void beginAsyncLoad() { asyncLoads++; }
+  static inline void endAsyncLoad() { asyncLoads--; }
+
+  // co_await Renderer::waitForUpload(serial) continues on the main thread
+  // once the upload batch has executed, checked once per frame
+  struct UploadAwaiter {
+    uint64_t serial;
+
+    bool await_ready() const;
+    void await_suspend(std::coroutine_handle<> handle) const;
+    void await_resume() const {}
+  };
+
+  static inline UploadAwaiter waitForUpload(uint64_t serial) {
+    return {serial};
+  }
 
-  static void loadTexture(const std::string &name, const std::string &path);
+  // Frees a resource that nothing references anymore, along with the meshes,
+  // materials and textures only it was using. GPU memory is returned once
+  // the frames in flight retire
+  static bool unloadModel(ModelHandle handle);
+  static bool unloadModel(const std::string &name);
+  static bool unloadMesh(MeshHandle handle);
+  static bool unloadTexture(TextureHandle handle);
 
   static void init();
   static void render();
   static void cleanup();
 
   static void setClearColor(const glm::vec4 &clearColor);
+  static void setVSync(bool vsync);
+
+  static inline MemoryStats getMemoryStats() { return api->getMemoryStats(); }
+  static inline void logMemoryStats() { api->logMemoryStats(); }
+  // Writes VMA's JSON statistics, detailed includes every allocation
+  static bool dumpMemoryStats(const std::string &path, bool detailed = true);
   static void setScene(std::shared_ptr<Scene> scene);
   static void setCamera(const Camera &camera);
 
@@ -59,14 +138,61 @@ private:
   static std::shared_ptr<VulkanAPI> api;
 
   static std::vector<Pipeline> pipelines;
+  static RendererConfig config;
 
   static std::shared_ptr<Scene> scene;
 
-  static std::unordered_map<std::string, Mesh> meshes;
-  static std::unordered_map<std::string, Texture> textures;
-  static std::unordered_map<std::string, Model> models;
+  static SlotMap<Mesh> meshes;
+  static SlotMap<Texture> textures;
+  static SlotMap<Material> materials;
+  static SlotMap<Model> models;
+
+  // A name is published after its resource is in the slot map, so whoever
+  // finds it can use the handle right away
+  static ConcurrentMap<std::string, MeshHandle> meshNames;
+  static ConcurrentMap<std::string, TextureHandle> textureNames;
+  static ConcurrentMap<std::string, ModelHandle> modelNames;
+
+  // Mesh and texture names wait here until their upload batch completes,
+  // like model names wait for waitForUpload. Main thread only
+  template <typename T> struct PendingName {
+    std::string name;
+    Handle<T> handle;
+    uint64_t uploadSerial;
+  };
+
+  static std::vector<PendingName<Mesh>> pendingMeshNames;
+  static std::vector<PendingName<Texture>> pendingTextureNames;
+
+  // Meshes by content hash and textures by encoded file size, see loadMesh
+  static ContentStore<Mesh> meshContents;
+  static ContentStore<Texture> textureContents;
+  static ConcurrentMap<uint64_t, MaterialHandle> materialContents;
 
   static Camera camera;
+
+  // Frame whose completion makes the last eviction visible in the budget
+  static uint64_t evictionFrame;
+  static bool evictionExhausted;
+  static uint32_t asyncLoads;
+
+  static uint64_t freeModel(ModelHandle handle);
+  static uint64_t freeMesh(MeshHandle handle);
+  static uint64_t freeTexture(TextureHandle handle);
+  static uint64_t releaseMaterial(MaterialHandle handle);
+  static uint64_t releaseTexture(TextureHandle handle);
+
+  // Publishes right away if the upload already completed
+  template <typename T>
+  static void publishName(ConcurrentMap<std::string, Handle<T>> &names,
+                          std::vector<PendingName<T>> &pending,
+                          const std::string &name, Handle<T> handle,
+                          uint64_t uploadSerial);
+  static void publishUploadedNames();
+
+  // Evicts unreferenced resources, least recently drawn models first, while
+  // device local memory is over budget
+  static void evictUnusedResources();
 };
 
 } // namespace Ash
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Ash {
+
+// Startup settings for the renderer, set with Renderer::setConfig before
+// App::init
+struct RendererConfig {
+  // Size of the persistently mapped ring that uploads stage through, uploads
+  // that don't fit get a dedicated staging allocation
+  uint64_t stagingRingSize = 64ull * 1024 * 1024;
+
+  // Where compiled pipelines are persisted between runs, empty disables it
+  std::string pipelineCachePath = "pipeline_cache.bin";
+
+  // Present with FIFO instead of the lowest latency mode available, can be
+  // toggled at runtime with Renderer::setVSync
+  bool vsync = false;
+
+  // Frames the CPU may record ahead of the GPU, 1 gives the lowest latency
+  // and 3 the highest throughput. Per-frame resources are sized from it
+  uint32_t framesInFlight = 2;
+
+  // Allocations are grouped into VMA pools by category: a linear pool for
+  // uniforms, a linear ring for overflow staging and block pools for geometry
+  // and textures. Disabling falls back to VMA's default placement, which is
+  // useful to compare against
+  bool useMemoryPools = true;
+  uint64_t uniformPoolBlockSize = 4ull * 1024 * 1024;
+  uint64_t stagingPoolSize = 32ull * 1024 * 1024;
+  uint64_t geometryPoolBlockSize = 64ull * 1024 * 1024;
+  uint64_t texturePoolBlockSize = 128ull * 1024 * 1024;
+
+  // Geometry and texture pools are compacted in the background once this
+  // fraction of their blocks is free, moving at most the given budget per
+  // pass. Requires memory pools
+  bool defragmentation = true;
+  float defragmentationThreshold = 0.25f;
+  uint64_t defragmentationBytesPerPass = 16ull * 1024 * 1024;
+  uint32_t defragmentationMovesPerPass = 64;
+
+  // Unreferenced models, meshes and textures are evicted, least recently
+  // drawn first, once device local allocations pass this fraction of the
+  // heap budget. memoryBudget sets an absolute limit in bytes instead, both
+  // at 0 disables eviction
+  float evictionThreshold = 0.9f;
+  uint64_t memoryBudget = 0;
+
+  // Seconds between memory statistics logs, 0 disables periodic logging
+  uint32_t memoryStatsLogInterval = 0;
+};
+
+} // namespace Ash
@@ -1,14 +1,185 @@
 #include "Scene.h"
 
+#include <algorithm>
+#include <chrono>
+
+#include "Components.h"
+
 namespace Ash {
 
-Scene::Scene() {}
+// Also runs when the component is removed on its own
+static void onRenderableDestroyed(entt::registry& registry,
+                                  entt::entity entity) {
+    Renderable& renderable = registry.get<Renderable>(entity);
+    Renderer::releaseModel(renderable.model);
+    Renderer::getAPI()->releaseRenderableResources(renderable.resources);
+}
+
+Scene::Scene() {
+    registry.on_destroy<Renderable>().connect<&onRenderableDestroyed>();
+}
 Scene::~Scene() {}
 
-Entity Scene::spawn() { return Entity(registry.create()); }
+Entity Scene::spawn() {
+    ASH_ASSERT(MainThread::isCurrent(),
+               "Spawn from systems through getCommands()");
+    return Entity(registry.create());
+}
 
 void Scene::destroyEntity(Entity entity) {
+    ASH_ASSERT(MainThread::isCurrent(),
+               "Destroy entities from systems through getCommands()");
     registry.destroy(entity.getHandle());
 }
 
+void Scene::addExclusiveSystem(const std::string& name,
+                               SystemFunction function) {
+    addSystem(name, {}, {}, true, std::move(function));
+}
+
+void Scene::addSystem(const std::string& name,
+                      std::vector<std::type_index> reads,
+                      std::vector<std::type_index> writes, bool exclusive,
+                      SystemFunction function) {
+    System& system = systems.emplace_back();
+    system.name = name;
+    system.reads = std::move(reads);
+    system.writes = std::move(writes);
+    system.exclusive = exclusive;
+    system.function = std::move(function);
+
+    systemGraphDirty = true;
+}
+
+static bool intersects(const std::vector<std::type_index>& a,
+                       const std::vector<std::type_index>& b) {
+    for (const std::type_index& type : a)
+        if (std::find(b.begin(), b.end(), type) != b.end()) return true;
+    return false;
+}
+
+// Exclusive systems split the list into phases, within a phase every system
+// depends on the earlier ones it conflicts with
+void Scene::buildSystemGraph() {
+    for (System& system : systems) {
+        system.dependents.clear();
+        system.dependencyCount = 0;
+    }
+
+    for (uint32_t j = 0; j < systems.size(); j++) {
+        System& later = systems[j];
+        if (later.exclusive) continue;
+
+        for (uint32_t i = j; i-- > 0;) {
+            System& earlier = systems[i];
+            if (earlier.exclusive) break;
+
+            if (intersects(earlier.writes, later.reads) ||
+                intersects(earlier.writes, later.writes) ||
+                intersects(earlier.reads, later.writes)) {
+                earlier.dependents.push_back(j);
+                later.dependencyCount++;
+            }
+        }
+    }
+
+    remainingDependencies =
+        std::make_unique<std::atomic<uint32_t>[]>(systems.size());
+    systemGraphDirty = false;
+}
+
+void Scene::runSystem(uint32_t index) {
+    System& system = systems[index];
+
+    // The worker goes on to run unrelated jobs afterwards
+    uint64_t previousKey = EntityCommandBuffer::getSortKey();
+    EntityCommandBuffer::setSortKey(static_cast<uint64_t>(index + 1)
+                                    << SORT_KEY_SYSTEM_SHIFT);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    system.function(*this);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    EntityCommandBuffer::setSortKey(previousKey);
+
+    system.totalMilliseconds +=
+        std::chrono::duration<double, std::milli>(end - start).count();
+    system.runs++;
+}
+
+void Scene::runSystemPhase(uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++)
+        remainingDependencies[i] = systems[i].dependencyCount;
+
+    // A system finishing queues the dependents it was the last one holding up
+    JobGroup group;
+    std::function<void(uint32_t)> launch = [&](uint32_t index) {
+        group.run([&, index]() {
+            runSystem(index);
+            for (uint32_t dependent : systems[index].dependents)
+                if (remainingDependencies[dependent].fetch_sub(1) == 1)
+                    launch(dependent);
+        });
+    };
+
+    for (uint32_t i = begin; i < end; i++)
+        if (systems[i].dependencyCount == 0) launch(i);
+
+    group.wait();
+}
+
+void Scene::updateSystems() {
+    if (systemGraphDirty) buildSystemGraph();
+
+    // Commands recorded since the last update, e.g. by layers, go first
+    commands.playback(registry);
+
+    uint32_t begin = 0;
+    while (begin < systems.size()) {
+        if (systems[begin].exclusive) {
+            runSystem(begin++);
+            commands.playback(registry);
+            continue;
+        }
+
+        uint32_t end = begin;
+        while (end < systems.size() && !systems[end].exclusive) end++;
+
+        // Sync point, no system is running while commands are applied
+        runSystemPhase(begin, end);
+        commands.playback(registry);
+        begin = end;
+    }
+}
+
+std::vector<SystemTiming> Scene::getSystemTimings() const {
+    std::vector<SystemTiming> timings;
+    for (const System& system : systems)
+        timings.push_back(
+            {system.name,
+             system.runs > 0 ? system.totalMilliseconds / system.runs : 0.0,
+             system.runs});
+    return timings;
+}
+
+void Scene::resetSystemTimings() {
+    for (System& system : systems) {
+        system.totalMilliseconds = 0.0;
+        system.runs = 0;
+    }
+}
+
+void Scene::logSystemTimings() {
+    if (systems.empty()) return;
+
+    std::string line;
+    for (const SystemTiming& timing : getSystemTimings()) {
+        if (!line.empty()) line += ", ";
+        line += fmt::format("{} {:.3f} ms", timing.name, timing.milliseconds);
+    }
+    ASH_INFO("Average system times: {}", line);
+
+    resetSystemTimings();
+}
+
 }  // namespace Ash
@@ -2,12 +2,52 @@
 
 #include <entt/entt.hpp>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <vector>
+
 #include "Core.h"
 #include "Entity.h"
+#include "EntityCommandBuffer.h"
 #include "Log.h"
+#include "MainThread.h"
+#include "ThreadPool.h"
 
 namespace Ash {
 
+class Scene;
+
+// Component access of a system, e.g. addSystem<Read<Spin>, Write<Transform>>
+template <typename... Components> struct Read {
+  static std::vector<std::type_index> getTypes() {
+    return {typeid(Components)...};
+  }
+  static void prepare(entt::registry &registry) {
+    (registry.prepare<Components>(), ...);
+  }
+};
+
+template <typename... Components> struct Write {
+  static std::vector<std::type_index> getTypes() {
+    return {typeid(Components)...};
+  }
+  static void prepare(entt::registry &registry) {
+    (registry.prepare<Components>(), ...);
+  }
+};
+
+using SystemFunction = std::function<void(Scene &)>;
+
+// Average run time of a system since timings were last reset
+struct SystemTiming {
+  std::string name;
+  double milliseconds;
+  uint32_t runs;
+};
+
 class Scene {
 public:
   Scene();
@@ -22,6 +62,8 @@ public:
 
   template <typename T, typename... Args>
   T &addComponent(Entity entity, Args &&...args) {
+    ASH_ASSERT(MainThread::isCurrent(),
+               "Add components from systems through getCommands()");
     ASH_ASSERT(!hasComponent<T>(entity), "Entity already has component");
     T &comp =
         registry.emplace<T>(entity.getHandle(), std::forward<Args>(args)...);
@@ -29,6 +71,8 @@ public:
   }
 
   template <typename T> void removeComponent(Entity entity) {
+    ASH_ASSERT(MainThread::isCurrent(),
+               "Remove components from systems through getCommands()");
     if (!hasComponent<T>(entity))
       return;
     registry.remove<T>(entity.getHandle());
@@ -37,9 +81,96 @@ public:
     };
   }
 
-  // TODO: Systems?
+  // Systems run once per updateSystems, in registration order unless they
+  // can overlap. Two systems conflict when one writes a component the other
+  // reads or writes, conflicting systems never run at the same time and
+  // keep their order. The rest run concurrently on the thread pool, so a
+  // system may only touch the components it declares
+  template <typename Reads, typename Writes>
+  void addSystem(const std::string &name, SystemFunction function) {
+    // Pools are created up front, views made by systems on workers then
+    // only look them up
+    Reads::prepare(registry);
+    Writes::prepare(registry);
+
+    addSystem(name, Reads::getTypes(), Writes::getTypes(), false,
+              std::move(function));
+  }
+
+  // Systems without declared access run alone on the main thread and may
+  // spawn or destroy entities and add or remove components
+  void addExclusiveSystem(const std::string &name, SystemFunction function);
+
+  // Structural changes from systems on the thread pool go here. They are
+  // applied when updateSystems starts and after each group of systems
+  // between exclusive ones, in the same order whatever the scheduling
+  EntityCommandBuffer &getCommands() { return commands; }
+
+  void updateSystems();
+
+  std::vector<SystemTiming> getSystemTimings() const;
+  void resetSystemTimings();
+  // Logs every system's average time on one line and resets them
+  void logSystemTimings();
+
+  // Calls function(entity, components &...) for every entity with the
+  // components, split into chunks of grainSize on the thread pool. Meant for
+  // large views inside systems, each entity is visited by one thread
+  template <typename... Components, typename F>
+  void parallelEach(F &&function, size_t grainSize = 1024) {
+    auto view = registry.view<Components...>();
+    std::vector<entt::entity> entities(view.begin(), view.end());
+
+    // Commands are keyed by the entity's place in the view rather than by
+    // the thread that happened to visit it, each call gets its own range
+    ASH_ASSERT(entities.size() < (1ull << SORT_KEY_PASS_SHIFT),
+               "Too many entities for one parallel pass");
+    uint64_t sortKey = EntityCommandBuffer::beginParallelPass();
+
+    ThreadPool::parallelFor(
+        entities.size(), grainSize, [&](size_t begin, size_t end) {
+          uint64_t previousKey = EntityCommandBuffer::getSortKey();
+          for (size_t i = begin; i < end; i++) {
+            EntityCommandBuffer::setSortKey(sortKey + i + 1);
+            function(entities[i],
+                     view.template get<Components>(entities[i])...);
+          }
+          EntityCommandBuffer::setSortKey(previousKey);
+        });
+  }
 
   entt::registry registry;
+
+private:
+  struct System {
+    std::string name;
+    std::vector<std::type_index> reads;
+    std::vector<std::type_index> writes;
+    bool exclusive;
+    SystemFunction function;
+
+    // Later systems of the same phase waiting on this one
+    std::vector<uint32_t> dependents;
+    uint32_t dependencyCount{0};
+
+    double totalMilliseconds{0.0};
+    uint32_t runs{0};
+  };
+
+  void addSystem(const std::string &name, std::vector<std::type_index> reads,
+                 std::vector<std::type_index> writes, bool exclusive,
+                 SystemFunction function);
+  void buildSystemGraph();
+  void runSystem(uint32_t index);
+  void runSystemPhase(uint32_t begin, uint32_t end);
+
+  std::vector<System> systems;
+  bool systemGraphDirty{false};
+
+  // Dependencies left per system while a phase runs
+  std::unique_ptr<std::atomic<uint32_t>[]> remainingDependencies;
+
+  EntityCommandBuffer commands;
 };
 
 } // namespace Ash
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Core.h"
+#include "Log.h"
+
+namespace Ash {
+
+// Generational reference into a SlotMap. A handle goes stale when its slot is
+// erased, even if the slot is reused afterwards
+template <typename T> struct Handle {
+  static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+  uint32_t index{InvalidIndex};
+  uint32_t generation{0};
+
+  inline bool isValid() const { return index != InvalidIndex; }
+  bool operator==(const Handle &other) const = default;
+};
+
+// Stores values in stable slots addressed by handles, a lookup is a
+// generation check and an array index. Erased slots are reused.
+//
+// Slots live in fixed pages that never move, so lookups don't lock and are
+// safe from any thread while another inserts. A value becomes visible in one
+// step once it is fully written. Erasing a slot that another thread is still
+// reading is up to the caller to prevent
+template <typename T> class SlotMap {
+public:
+  SlotMap() = default;
+  SlotMap(const SlotMap &) = delete;
+  SlotMap &operator=(const SlotMap &) = delete;
+
+  ~SlotMap() {
+    for (std::atomic<Slot *> &page : pages)
+      delete[] page.load(std::memory_order_relaxed);
+  }
+
+  Handle<T> insert(T value) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t index;
+    if (freeList.empty()) {
+      index = slotCount.load(std::memory_order_relaxed);
+      ASH_ASSERT(index < PAGE_SIZE * MAX_PAGES, "Slot map is full");
+
+      std::atomic<Slot *> &page = pages[index / PAGE_SIZE];
+      if (!page.load(std::memory_order_relaxed))
+        page.store(new Slot[PAGE_SIZE], std::memory_order_release);
+    } else {
+      index = freeList.back();
+      freeList.pop_back();
+    }
+
+    Slot &slot = getSlot(index);
+    slot.value = std::move(value);
+    slot.occupied.store(true, std::memory_order_release);
+
+    if (index == slotCount.load(std::memory_order_relaxed))
+      slotCount.store(index + 1, std::memory_order_release);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    return {index, slot.generation.load(std::memory_order_relaxed)};
+  }
+
+  void erase(Handle<T> handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!contains(handle))
+      return;
+
+    Slot &slot = getSlot(handle.index);
+    slot.occupied.store(false, std::memory_order_release);
+    slot.generation.fetch_add(1, std::memory_order_release);
+    slot.value = T{};
+    freeList.push_back(handle.index);
+    count.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  inline bool contains(Handle<T> handle) const {
+    if (handle.index >= slotCount.load(std::memory_order_acquire))
+      return false;
+
+    const Slot &slot = getSlot(handle.index);
+    return slot.occupied.load(std::memory_order_acquire) &&
+           slot.generation.load(std::memory_order_acquire) ==
+               handle.generation;
+  }
+
+  // Aborts on stale or invalid handles in every build, use find for handles
+  // that may have gone away
+  inline T &get(Handle<T> handle) {
+    if (!contains(handle)) {
+      ASH_ERROR("Stale or invalid handle {}", handle.index);
+      std::abort();
+    }
+    return getSlot(handle.index).value;
+  }
+
+  inline T *find(Handle<T> handle) {
+    return contains(handle) ? &getSlot(handle.index).value : nullptr;
+  }
+
+  // Calls f(handle, value) for every occupied slot, f may insert or erase
+  template <typename F> void forEach(F &&f) {
+    uint32_t end = slotCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < end; i++) {
+      Slot &slot = getSlot(i);
+      if (slot.occupied.load(std::memory_order_acquire))
+        f(Handle<T>{i, slot.generation.load(std::memory_order_acquire)},
+          slot.value);
+    }
+  }
+
+  inline size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr uint32_t PAGE_SIZE = 1024;
+  static constexpr uint32_t MAX_PAGES = 4096;
+
+  struct Slot {
+    T value{};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<bool> occupied{false};
+  };
+
+  // Only called for indices below slotCount, whose page is published
+  inline Slot &getSlot(uint32_t index) const {
+    return pages[index / PAGE_SIZE].load(
+        std::memory_order_acquire)[index % PAGE_SIZE];
+  }
+
+  std::array<std::atomic<Slot *>, MAX_PAGES> pages{};
+  std::atomic<uint32_t> slotCount{0};
+  std::atomic<size_t> count{0};
+
+  // Writers only
+  std::mutex mutex;
+  std::vector<uint32_t> freeList;
+};
+
+} // namespace Ash
@@ -0,0 +1,74 @@
+#include "StagingRing.h"
+
+namespace Ash {
+
+void StagingRing::init(vk::Buffer buffer, void *mapped, vk::DeviceSize size) {
+  this->buffer = buffer;
+  this->mapped = static_cast<char *>(mapped);
+  this->size = size;
+
+  head = tail = used = pendingBytes = 0;
+  regions.clear();
+}
+
+bool StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment,
+                           StagingAllocation &allocation) {
+  if (size > this->size)
+    return false;
+
+  // Start over from the beginning whenever the ring drains to keep large
+  // requests from being split by the wrap point
+  if (used == 0)
+    head = tail = 0;
+
+  vk::DeviceSize start = (head + alignment - 1) & ~(alignment - 1);
+  vk::DeviceSize consumed;
+
+  if (head > tail || used == 0) {
+    // Free space is [head, size) followed by [0, tail)
+    if (start + size <= this->size) {
+      consumed = start + size - head;
+    } else if (size <= tail) {
+      start = 0;
+      consumed = this->size - head + size;
+    } else {
+      return false;
+    }
+  } else if (head < tail) {
+    // Free space is [head, tail)
+    if (start + size > tail)
+      return false;
+    consumed = start + size - head;
+  } else {
+    // head == tail with bytes in use, the ring is full
+    return false;
+  }
+
+  head = start + size;
+  used += consumed;
+  pendingBytes += consumed;
+
+  allocation.buffer = buffer;
+  allocation.offset = start;
+  allocation.mapped = mapped + start;
+
+  return true;
+}
+
+void StagingRing::submit(uint64_t serial) {
+  if (pendingBytes == 0)
+    return;
+
+  regions.push_back({serial, head, pendingBytes});
+  pendingBytes = 0;
+}
+
+void StagingRing::release(uint64_t completedSerial) {
+  while (!regions.empty() && regions.front().serial <= completedSerial) {
+    tail = regions.front().end;
+    used -= regions.front().bytes;
+    regions.pop_front();
+  }
+}
+
+} // namespace Ash
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <deque>
+
+namespace Ash {
+
+struct StagingAllocation {
+  vk::Buffer buffer;
+  vk::DeviceSize offset;
+  void *mapped;
+};
+
+// Sub-allocates upload staging memory from one persistently mapped buffer.
+// Regions are handed out in order and tagged with the serial of the
+// submission that consumes them, they are reclaimed once that serial
+// completes
+class StagingRing {
+public:
+  void init(vk::Buffer buffer, void *mapped, vk::DeviceSize size);
+
+  // Returns false if the request can't fit until older regions are released
+  bool allocate(vk::DeviceSize size, vk::DeviceSize alignment,
+                StagingAllocation &allocation);
+
+  // Tags every region allocated since the last submit with the serial
+  void submit(uint64_t serial);
+  void release(uint64_t completedSerial);
+
+  inline vk::DeviceSize getSize() const { return size; }
+  inline vk::DeviceSize getUsed() const { return used; }
+
+private:
+  struct Region {
+    uint64_t serial;
+    vk::DeviceSize end;
+    vk::DeviceSize bytes;
+  };
+
+  vk::Buffer buffer;
+  char *mapped{nullptr};
+  vk::DeviceSize size{0};
+
+  vk::DeviceSize head{0};
+  vk::DeviceSize tail{0};
+  vk::DeviceSize used{0};
+  vk::DeviceSize pendingBytes{0};
+
+  std::deque<Region> regions;
+};
+
+} // namespace Ash
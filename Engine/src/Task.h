@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "Core.h"
+#include "Log.h"
+
+namespace Ash {
+
+template <typename T> class Task;
+
+namespace detail {
+
+// A task's coroutine is running, done, orphaned by its Task, or holds the
+// address of the coroutine awaiting it
+inline constexpr uintptr_t TASK_RUNNING = 0;
+inline constexpr uintptr_t TASK_DONE = 1;
+inline constexpr uintptr_t TASK_DETACHED = 2;
+
+class TaskPromiseBase {
+public:
+  std::suspend_never initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<P> handle) noexcept {
+      TaskPromiseBase &promise = handle.promise();
+      uintptr_t state =
+          promise.state.exchange(TASK_DONE, std::memory_order_acq_rel);
+
+      if (state == TASK_DETACHED) {
+        handle.destroy();
+        return std::noop_coroutine();
+      }
+
+      if (state == TASK_RUNNING)
+        return std::noop_coroutine();
+
+      // Resume whoever awaits the task right here
+      return std::coroutine_handle<>::from_address(
+          reinterpret_cast<void *>(state));
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { exception = std::current_exception(); }
+
+  std::atomic<uintptr_t> state{TASK_RUNNING};
+  std::exception_ptr exception;
+};
+
+template <typename T> class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object();
+  void return_value(T result) { value.emplace(std::move(result)); }
+
+  T &result() {
+    if (exception)
+      std::rethrow_exception(exception);
+    return *value;
+  }
+
+private:
+  std::optional<T> value;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object();
+  void return_void() {}
+
+  void result() {
+    if (exception)
+      std::rethrow_exception(exception);
+  }
+};
+
+} // namespace detail
+
+// Coroutine that starts running as soon as it's called and can be awaited
+// once or polled from a frame loop. Dropping the Task doesn't cancel the
+// coroutine, it cleans up after itself when it finishes
+template <typename T = void> class Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+
+  Task() = default;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      release();
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { release(); }
+
+  bool isValid() const { return static_cast<bool>(handle); }
+
+  bool isReady() const {
+    return handle && handle.promise().state.load(std::memory_order_acquire) ==
+                         detail::TASK_DONE;
+  }
+
+  // Result of a finished task, rethrows what the coroutine threw
+  decltype(auto) get() {
+    ASH_ASSERT(isReady(), "Getting the result of an unfinished task");
+    return handle.promise().result();
+  }
+
+  struct Awaiter {
+    std::coroutine_handle<promise_type> handle;
+
+    bool await_ready() const {
+      return handle.promise().state.load(std::memory_order_acquire) ==
+             detail::TASK_DONE;
+    }
+
+    // Returning false resumes straight away, the task finished in between
+    bool await_suspend(std::coroutine_handle<> awaiting) const {
+      uintptr_t expected = detail::TASK_RUNNING;
+      return handle.promise().state.compare_exchange_strong(
+          expected, reinterpret_cast<uintptr_t>(awaiting.address()),
+          std::memory_order_acq_rel);
+    }
+
+    decltype(auto) await_resume() const { return handle.promise().result(); }
+  };
+
+  Awaiter operator co_await() const {
+    ASH_ASSERT(handle, "Awaiting an empty task");
+    return Awaiter{handle};
+  }
+
+private:
+  void release() {
+    if (!handle)
+      return;
+
+    uintptr_t state = handle.promise().state.exchange(
+        detail::TASK_DETACHED, std::memory_order_acq_rel);
+    if (state == detail::TASK_DONE)
+      handle.destroy();
+
+    handle = {};
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+} // namespace Ash
@@ -0,0 +1,243 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#include "Core.h"
+#include "Log.h"
+
+namespace Ash {
+
+std::vector<std::thread> ThreadPool::threads;
+std::vector<std::unique_ptr<ThreadPool::Worker>> ThreadPool::workers;
+std::deque<std::function<void()>> ThreadPool::sharedJobs;
+std::mutex ThreadPool::sharedMutex;
+std::atomic<size_t> ThreadPool::queuedJobs{0};
+std::mutex ThreadPool::sleepMutex;
+std::condition_variable ThreadPool::condition;
+bool ThreadPool::stopping = false;
+
+static thread_local int32_t workerIndex = -1;
+
+void ThreadPool::init(uint32_t threadCount) {
+  // hardware_concurrency is 0 when it can't be determined
+  if (threadCount == 0) {
+    unsigned hardwareThreads = std::thread::hardware_concurrency();
+    threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+  }
+
+  ASH_INFO("Starting thread pool with {} workers", threadCount);
+
+  stopping = false;
+
+  // Every deque exists before any worker starts stealing
+  for (uint32_t i = 0; i < threadCount; i++)
+    workers.push_back(std::make_unique<Worker>());
+  for (uint32_t i = 0; i < threadCount; i++)
+    threads.emplace_back(workerLoop, static_cast<int32_t>(i));
+}
+
+void ThreadPool::cleanup() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  // Workers drain the queues before they exit
+  for (std::thread &thread : threads)
+    thread.join();
+
+  threads.clear();
+  workers.clear();
+}
+
+void ThreadPool::enqueue(std::function<void()> job) {
+  // Counted first so a worker that sees no jobs can't miss this one
+  queuedJobs.fetch_add(1, std::memory_order_release);
+
+  if (workerIndex >= 0) {
+    Worker &worker = *workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  } else {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    sharedJobs.push_back(std::move(job));
+  }
+
+  // Taking the lock orders this against a worker about to sleep
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  condition.notify_one();
+}
+
+bool ThreadPool::takeJob(std::function<void()> &job) {
+  // The newest job of our own is the one whose data is still in cache
+  if (workerIndex >= 0) {
+    Worker &worker = *workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.jobs.empty()) {
+      job = std::move(worker.jobs.back());
+      worker.jobs.pop_back();
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    if (!sharedJobs.empty()) {
+      job = std::move(sharedJobs.front());
+      sharedJobs.pop_front();
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  // Steal the oldest job of another worker, starting after ourselves so
+  // thieves spread out
+  size_t count = workers.size();
+  for (size_t i = 1; i <= count; i++) {
+    size_t victim = (workerIndex + i) % count;
+    if (static_cast<int32_t>(victim) == workerIndex)
+      continue;
+
+    Worker &worker = *workers[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.jobs.empty()) {
+      job = std::move(worker.jobs.front());
+      worker.jobs.pop_front();
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ThreadPool::runPendingJob() {
+  std::function<void()> job;
+  if (!takeJob(job))
+    return false;
+
+  job();
+  return true;
+}
+
+void ThreadPool::workerLoop(int32_t index) {
+  workerIndex = index;
+
+  while (true) {
+    if (runPendingJob())
+      continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    condition.wait(lock, [] {
+      return stopping || queuedJobs.load(std::memory_order_acquire) > 0;
+    });
+
+    if (stopping && queuedJobs.load(std::memory_order_acquire) == 0)
+      return;
+  }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const std::function<void(size_t)> &function) {
+  parallelFor(count, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      function(i);
+  });
+}
+
+void ThreadPool::parallelFor(
+    size_t count, size_t grainSize,
+    const std::function<void(size_t, size_t)> &function) {
+  if (count == 0)
+    return;
+
+  grainSize = std::max<size_t>(grainSize, 1);
+  size_t chunks = (count + grainSize - 1) / grainSize;
+
+  std::atomic<size_t> next{0};
+  auto run = [&]() {
+    for (size_t chunk = next++; chunk < chunks; chunk = next++)
+      function(chunk * grainSize, std::min(count, (chunk + 1) * grainSize));
+  };
+
+  // Helpers only pull chunks, so it's fine if some start after the work is
+  // gone
+  size_t helperCount = std::min(chunks - 1, workers.size());
+  std::vector<std::future<void>> helpers;
+  helpers.reserve(helperCount);
+  for (size_t i = 0; i < helperCount; i++)
+    helpers.push_back(submit(run));
+
+  run();
+
+  for (std::future<void> &helper : helpers)
+    wait(helper);
+}
+
+uint32_t ThreadPool::getThreadCount() {
+  return static_cast<uint32_t>(threads.size());
+}
+
+bool ThreadPool::isWorkerThread() { return workerIndex >= 0; }
+
+int32_t ThreadPool::getWorkerIndex() { return workerIndex; }
+
+JobGroup::JobGroup() : state(std::make_shared<State>()) {}
+
+void JobGroup::run(std::function<void()> job) {
+  state->pending.fetch_add(1, std::memory_order_relaxed);
+  ThreadPool::enqueue([state = state, job = std::move(job)]() {
+    job();
+    finish(state);
+  });
+}
+
+void JobGroup::then(std::function<void()> continuation) {
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->pending.load(std::memory_order_acquire) > 0) {
+      state->continuations.push_back(std::move(continuation));
+      return;
+    }
+  }
+
+  ThreadPool::enqueue(std::move(continuation));
+}
+
+bool JobGroup::isDone() const {
+  return state->pending.load(std::memory_order_acquire) == 0;
+}
+
+void JobGroup::wait() const {
+  while (ThreadPool::isWorkerThread() && !isDone()) {
+    if (!ThreadPool::runPendingJob()) {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->done.wait_for(lock, std::chrono::microseconds(100),
+                           [&] { return isDone(); });
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&] { return isDone(); });
+}
+
+void JobGroup::finish(const std::shared_ptr<State> &state) {
+  if (state->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+
+  std::vector<std::function<void()>> continuations;
+  {
+    // Jobs run after the count hit zero may have started a new round
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->pending.load(std::memory_order_acquire) == 0)
+      continuations.swap(state->continuations);
+  }
+  state->done.notify_all();
+
+  for (std::function<void()> &continuation : continuations)
+    ThreadPool::enqueue(std::move(continuation));
+}
+
+} // namespace Ash
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Ash {
+
+// Engine wide work-stealing pool, started by App::init and shared by the
+// renderer, the importers and gameplay code. Each worker pushes and pops the
+// jobs it spawns at the back of its own deque and steals from the front of
+// the others' when it runs dry. Jobs from other threads go through a shared
+// queue. Anything touching GLFW stays on the main thread, see MainThread
+class ThreadPool {
+public:
+  // Zero picks one worker per hardware thread besides the main thread
+  static void init(uint32_t threadCount = 0);
+  static void cleanup();
+
+  template <typename F>
+  static std::future<std::invoke_result_t<F>> submit(F &&function) {
+    using Result = std::invoke_result_t<F>;
+
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<F>(function));
+    std::future<Result> future = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return future;
+  }
+
+  // Runs function(i) for every i in [0, count) and returns once all are done,
+  // the calling thread helps out
+  static void parallelFor(size_t count,
+                          const std::function<void(size_t)> &function);
+
+  // Same over ranges, function(begin, end) is called for consecutive chunks
+  // of at most grainSize indices. Cheap items should be batched like this
+  static void parallelFor(size_t count, size_t grainSize,
+                          const std::function<void(size_t, size_t)> &function);
+
+  // Waits for a job from this pool. Workers run queued jobs meanwhile, jobs
+  // that wait on other jobs would otherwise leave every worker blocked on
+  // work that is still queued. Other threads never pick up unrelated jobs in
+  // the middle of their own work
+  template <typename T> static T wait(std::future<T> &future) {
+    while (isWorkerThread() && future.wait_for(std::chrono::seconds(0)) !=
+                                   std::future_status::ready) {
+      if (!runPendingJob())
+        future.wait_for(std::chrono::microseconds(100));
+    }
+    return future.get();
+  }
+
+  // co_await ThreadPool::schedule() continues the coroutine on a worker
+  struct ScheduleAwaiter {
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const {
+      enqueue([handle]() { handle.resume(); });
+    }
+    void await_resume() const {}
+  };
+
+  static ScheduleAwaiter schedule() { return {}; }
+
+  static uint32_t getThreadCount();
+  static bool isWorkerThread();
+
+  // Index of the calling worker in [0, getThreadCount()), or -1 on any other
+  // thread. Lets jobs keep per worker scratch data without locking. Workers
+  // run other queued jobs inside wait, parallelFor and JobGroup::wait, and
+  // those may use the same scratch. Don't hold on to it across such calls
+  static int32_t getWorkerIndex();
+
+private:
+  friend class JobGroup;
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> jobs;
+  };
+
+  static void enqueue(std::function<void()> job);
+  static bool takeJob(std::function<void()> &job);
+  static bool runPendingJob();
+  static void workerLoop(int32_t index);
+
+  static std::vector<std::thread> threads;
+  static std::vector<std::unique_ptr<Worker>> workers;
+
+  // Jobs enqueued from outside the pool
+  static std::deque<std::function<void()>> sharedJobs;
+  static std::mutex sharedMutex;
+
+  // Queued jobs across all queues, idle workers sleep while it's zero
+  static std::atomic<size_t> queuedJobs;
+  static std::mutex sleepMutex;
+  static std::condition_variable condition;
+  static bool stopping;
+};
+
+// Jobs that later work can depend on. Continuations added with then() are
+// queued once every job run in the group so far has finished, straight away
+// if none are left. A group can be reused once it's done
+class JobGroup {
+public:
+  JobGroup();
+
+  void run(std::function<void()> job);
+  void then(std::function<void()> continuation);
+
+  bool isDone() const;
+
+  // Helps with queued jobs when called from a worker
+  void wait() const;
+
+private:
+  struct State {
+    std::atomic<uint32_t> pending{0};
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<std::function<void()>> continuations;
+  };
+
+  static void finish(const std::shared_ptr<State> &state);
+
+  // Jobs keep the state alive, the group can go before they finish
+  std::shared_ptr<State> state;
+};
+
+} // namespace Ash
@@ -5,14 +5,32 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
 
 #include "App.h"
 #include "Components.h"
+#include "ImageDecoder.h"
 #include "Renderer.h"
+#include "ThreadPool.h"
 
 namespace Ash {
 
+// Geometry and textures are also copy sources so defragmentation can move them
+static constexpr vk::BufferUsageFlags geometryBufferUsage =
+    vk::BufferUsageFlagBits::eTransferSrc |
+    vk::BufferUsageFlagBits::eTransferDst |
+    vk::BufferUsageFlagBits::eVertexBuffer |
+    vk::BufferUsageFlagBits::eIndexBuffer;
+
+static constexpr vk::ImageUsageFlags textureImageUsage =
+    vk::ImageUsageFlagBits::eTransferSrc |
+    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+
 vk::CommandBuffer VulkanAPI::beginSingleTimeCommands() {
   vk::CommandBufferAllocateInfo allocInfo(commandPool,
                                           vk::CommandBufferLevel::ePrimary, 1);
@@ -39,6 +57,185 @@ void VulkanAPI::endSingleTimeCommands(vk::CommandBuffer commandBuffer) {
   device.freeCommandBuffers(commandPool, commandBuffer);
 }
 
+void VulkanAPI::beginUploadBatch() {
+  ASH_ASSERT(!uploadBatch, "An upload batch is already open");
+
+  collectUploadBatches();
+
+  UploadBatch batch{};
+  batch.serial = nextUploadSerial++;
+
+  vk::CommandBufferAllocateInfo allocInfo(transferCommandPool,
+                                          vk::CommandBufferLevel::ePrimary, 1);
+  batch.commandBuffer = device.allocateCommandBuffers(allocInfo).front();
+  batch.commandBuffer.begin(vk::CommandBufferBeginInfo(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+  uploadBatch = std::move(batch);
+}
+
+uint64_t VulkanAPI::submitUploadBatch() {
+  uint64_t serial = queueUploadBatch();
+  submitQueuedUploadBatches(true);
+  return serial;
+}
+
+uint64_t VulkanAPI::queueUploadBatch() {
+  ASH_ASSERT(uploadBatch, "No upload batch to submit");
+
+  UploadBatch &batch = *uploadBatch;
+
+  // Make every buffer copy visible to vertex input and hand all textures over
+  // to the fragment shader with a single barrier
+  vk::MemoryBarrier memoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                                  vk::AccessFlagBits::eVertexAttributeRead |
+                                      vk::AccessFlagBits::eIndexRead);
+  batch.commandBuffer.pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eVertexInput |
+          vk::PipelineStageFlagBits::eFragmentShader,
+      {}, memoryBarrier, {}, batch.imageBarriers);
+
+  batch.commandBuffer.end();
+
+  // Staging handed out so far belongs to this batch even though decodes may
+  // still be writing to it
+  stagingRing.submit(batch.serial);
+
+  uint64_t serial = batch.serial;
+  queuedUploadBatches.push_back(std::move(batch));
+  uploadBatch.reset();
+
+  return serial;
+}
+
+void VulkanAPI::submitQueuedUploadBatches(bool wait) {
+  // Batches go out in serial order, completion order depends on it
+  while (!queuedUploadBatches.empty()) {
+    UploadBatch &batch = queuedUploadBatches.front();
+
+    if (!wait &&
+        std::any_of(batch.decodes.begin(), batch.decodes.end(),
+                    [](const std::future<bool> &decode) {
+                      return decode.wait_for(std::chrono::seconds(0)) !=
+                             std::future_status::ready;
+                    }))
+      return;
+
+    for (std::future<bool> &decode : batch.decodes)
+      ASH_ASSERT(ThreadPool::wait(decode), "Failed to load image from disk");
+    batch.decodes.clear();
+
+    // Cached staging memory isn't necessarily coherent
+    vmaFlushAllocation(allocator, stagingRingAllocation, 0, VK_WHOLE_SIZE);
+    for (DedicatedStaging &staging : batch.dedicatedStaging)
+      vmaFlushAllocation(allocator, staging.allocation, 0, VK_WHOLE_SIZE);
+
+    batch.fence = device.createFence({});
+
+    vk::SubmitInfo submitInfo(nullptr, nullptr, batch.commandBuffer);
+    graphicsQueue.submit(submitInfo, batch.fence);
+
+    pendingUploadBatches.push_back(std::move(batch));
+    queuedUploadBatches.pop_front();
+  }
+}
+
+bool VulkanAPI::isUploadComplete(uint64_t serial) {
+  collectUploadBatches();
+  return serial <= completedUploadSerial;
+}
+
+void VulkanAPI::waitForUpload(uint64_t serial) {
+  ASH_ASSERT(!uploadBatch || uploadBatch->serial != serial,
+             "Waiting on an upload batch that was never submitted");
+
+  if (!queuedUploadBatches.empty() &&
+      queuedUploadBatches.front().serial <= serial)
+    submitQueuedUploadBatches(true);
+
+  // Batches complete in submission order, so waiting on the last one up to
+  // the serial covers the rest
+  for (auto it = pendingUploadBatches.rbegin();
+       it != pendingUploadBatches.rend(); it++) {
+    if (it->serial > serial)
+      continue;
+
+    ASH_ASSERT(device.waitForFences(it->fence, vk::True, UINT64_MAX) ==
+                   vk::Result::eSuccess,
+               "Error while waiting for upload fence");
+    break;
+  }
+
+  collectUploadBatches();
+}
+
+void VulkanAPI::collectUploadBatches() {
+  auto it = pendingUploadBatches.begin();
+  for (; it != pendingUploadBatches.end(); it++) {
+    if (device.getFenceStatus(it->fence) != vk::Result::eSuccess)
+      break;
+
+    for (DedicatedStaging &staging : it->dedicatedStaging)
+      destroyBuffer(staging.buffer, staging.allocation);
+
+    device.freeCommandBuffers(transferCommandPool, it->commandBuffer);
+    device.destroyFence(it->fence);
+
+    completedUploadSerial = it->serial;
+  }
+
+  pendingUploadBatches.erase(pendingUploadBatches.begin(), it);
+
+  stagingRing.release(completedUploadSerial);
+}
+
+void VulkanAPI::createStagingRing() {
+  ASH_INFO("Creating {} MiB staging ring", config.stagingRingSize >> 20);
+
+  // Image decoders read back rows they have already written, so staging is
+  // kept in cached memory rather than write-combined memory
+  VmaAllocationInfo allocationInfo;
+  createBuffer(config.stagingRingSize, VMA_MEMORY_USAGE_AUTO,
+               vk::BufferUsageFlagBits::eTransferSrc, stagingRingBuffer,
+               stagingRingAllocation, MemoryCategory::Staging,
+               VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                   VMA_ALLOCATION_CREATE_MAPPED_BIT,
+               &allocationInfo);
+
+  stagingRing.init(stagingRingBuffer, allocationInfo.pMappedData,
+                   config.stagingRingSize);
+}
+
+StagingAllocation VulkanAPI::allocateStaging(vk::DeviceSize size) {
+  ASH_ASSERT(uploadBatch, "Staging an upload without an open upload batch");
+
+  // Offsets stay aligned for buffer to image copies
+  StagingAllocation staging;
+  if (stagingRing.allocate(size, 16, staging))
+    return staging;
+
+  collectUploadBatches();
+  if (stagingRing.allocate(size, 16, staging))
+    return staging;
+
+  // Too large for the ring or the ring is still busy with earlier uploads
+  DedicatedStaging dedicated;
+  VmaAllocationInfo allocationInfo;
+  createBuffer(size, VMA_MEMORY_USAGE_AUTO,
+               vk::BufferUsageFlagBits::eTransferSrc, dedicated.buffer,
+               dedicated.allocation, MemoryCategory::Staging,
+               VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                   VMA_ALLOCATION_CREATE_MAPPED_BIT,
+               &allocationInfo);
+  uploadBatch->dedicatedStaging.push_back(dedicated);
+
+  staging.buffer = dedicated.buffer;
+  staging.offset = 0;
+  staging.mapped = allocationInfo.pMappedData;
+  return staging;
+}
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debugCallBack(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
               VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -128,6 +325,10 @@ vk::SurfaceFormatKHR VulkanAPI::chooseSwapSurfaceFormat(
 
 vk::PresentModeKHR VulkanAPI::chooseSwapPresentMode(
     const std::vector<vk::PresentModeKHR> &availablePresentModes) {
+  // FIFO is always supported
+  if (config.vsync)
+    return vk::PresentModeKHR::eFifo;
+
   for (const auto &availablePresentMode : availablePresentModes) {
     // vsync : VK_PRESENT_MODE_MAILBOX_KHR
     if (availablePresentMode == vk::PresentModeKHR::eImmediate)
@@ -200,6 +401,15 @@ bool VulkanAPI::checkDeviceExtensionSupport(vk::PhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool VulkanAPI::hasDeviceExtension(vk::PhysicalDevice device,
+                                   const char *extension) {
+  for (const auto &properties : device.enumerateDeviceExtensionProperties())
+    if (std::strcmp(properties.extensionName, extension) == 0)
+      return true;
+
+  return false;
+}
+
 bool VulkanAPI::isDeviceSuitable(vk::PhysicalDevice device) {
   VulkanAPI::QueueFamilyIndices indices = findQueueFamilies(device);
 
@@ -212,10 +422,15 @@ bool VulkanAPI::isDeviceSuitable(vk::PhysicalDevice device) {
                         !swapChainSupport.presentModes.empty();
   }
 
-  vk::PhysicalDeviceFeatures supportedFeatures = device.getFeatures();
+  auto supportedFeatures =
+      device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                          vk::PhysicalDeviceVulkan12Features>();
 
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.get<vk::PhysicalDeviceFeatures2>()
+             .features.samplerAnisotropy &&
+         supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>()
+             .timelineSemaphore;
 }
 
 void VulkanAPI::pickPhysicalDevice() {
@@ -315,8 +530,22 @@ void VulkanAPI::createLogicalDevice() {
   vk::PhysicalDeviceFeatures deviceFeatures{};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
-  vk::DeviceCreateInfo createInfo({}, queueCreateInfos, {}, deviceExtensions,
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{};
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+
+  std::vector<const char *> enabledExtensions = deviceExtensions;
+
+  memoryBudgetSupported =
+      hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudgetSupported)
+    enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  else
+    ASH_WARN("{} is not supported, memory budgets are estimated",
+             VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+  vk::DeviceCreateInfo createInfo({}, queueCreateInfos, {}, enabledExtensions,
                                   &deviceFeatures);
+  createInfo.setPNext(&vulkan12Features);
   if (enableValidationLayers) {
     createInfo.setPEnabledLayerNames(validationLayers);
   }
@@ -334,8 +563,29 @@ void VulkanAPI::createAllocator() {
   allocInfo.physicalDevice = physicalDevice;
   allocInfo.instance = instance;
 
+  if (memoryBudgetSupported)
+    allocInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
   ASH_ASSERT(vmaCreateAllocator(&allocInfo, &allocator) == VK_SUCCESS,
              "Failed to create allocator");
+
+  const VkPhysicalDeviceMemoryProperties *memProperties;
+  vmaGetMemoryProperties(allocator, &memProperties);
+
+  for (uint32_t i = 0; i < memProperties->memoryTypeCount; i++) {
+    VkMemoryPropertyFlags flags = memProperties->memoryTypes[i].propertyFlags;
+    if ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
+        (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+      hostVisibleDeviceMemory = true;
+      ASH_INFO("Found host visible device memory in heap {} ({} MiB), "
+               "writing geometry directly",
+               memProperties->memoryTypes[i].heapIndex,
+               memProperties->memoryHeaps[memProperties->memoryTypes[i].heapIndex]
+                       .size >>
+                   20);
+      break;
+    }
+  }
 }
 
 void VulkanAPI::createSwapchain() {
@@ -373,10 +623,18 @@ void VulkanAPI::createSwapchain() {
   createInfo.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
   createInfo.setPresentMode(presentMode);
   createInfo.setClipped(VK_TRUE);
-  createInfo.setOldSwapchain(VK_NULL_HANDLE);
+  // Handing over the old swapchain lets the driver reuse its resources and
+  // keep presenting its images while the new one is created
+  vk::SwapchainKHR oldSwapchain = swapchain;
+  createInfo.setOldSwapchain(oldSwapchain);
 
   swapchain = device.createSwapchainKHR(createInfo);
 
+  if (oldSwapchain)
+    deletionQueue.push(frameNumber, [this, oldSwapchain]() {
+      device.destroySwapchainKHR(oldSwapchain);
+    });
+
   swapchainImages = device.getSwapchainImagesKHR(swapchain);
   swapchainImageFormat = surfaceFormat.format;
   swapchainExtent = extent;
@@ -486,33 +744,160 @@ void VulkanAPI::createDescriptorSetLayouts() {
       descriptorLayoutCache.create_descriptor_layout(objectLayoutInfo));
 }
 
+// Prefixed to the driver's cache data on disk. The driver's own header only
+// identifies the device, the driver version is checked on top of it
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  uint32_t reserved;
+  uint64_t dataSize;
+};
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505341; // "ASPC"
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+static PipelineCacheFileHeader
+createPipelineCacheFileHeader(const vk::PhysicalDeviceProperties &properties,
+                              uint64_t dataSize) {
+  PipelineCacheFileHeader header{};
+  header.magic = PIPELINE_CACHE_MAGIC;
+  header.version = PIPELINE_CACHE_VERSION;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(),
+              VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  return header;
+}
+
 void VulkanAPI::createPipelineCache() {
   ASH_INFO("Creating pipeline cache");
-  pipelineCache = device.createPipelineCache({});
+
+  vk::PipelineCacheCreateInfo createInfo{};
+
+  MappedFile file;
+  if (!config.pipelineCachePath.empty())
+    file.open(config.pipelineCachePath);
+
+  if (file.isOpen() && file.size() >= sizeof(PipelineCacheFileHeader)) {
+    PipelineCacheFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    PipelineCacheFileHeader expected = createPipelineCacheFileHeader(
+        physicalDevice.getProperties(),
+        file.size() - sizeof(PipelineCacheFileHeader));
+
+    if (std::memcmp(&header, &expected, sizeof(header)) == 0) {
+      createInfo.initialDataSize = header.dataSize;
+      createInfo.pInitialData = file.data() + sizeof(header);
+      ASH_INFO("Loaded {} bytes of pipeline cache from {}", header.dataSize,
+               config.pipelineCachePath);
+    } else {
+      ASH_WARN("Discarding pipeline cache {}, it was written by a different "
+               "device or driver",
+               config.pipelineCachePath);
+    }
+  }
+
+  pipelineCache = device.createPipelineCache(createInfo);
+}
+
+void VulkanAPI::savePipelineCache() {
+  if (config.pipelineCachePath.empty())
+    return;
+
+  std::vector<uint8_t> data = device.getPipelineCacheData(pipelineCache);
+  PipelineCacheFileHeader header =
+      createPipelineCacheFileHeader(physicalDevice.getProperties(), data.size());
+
+  // Written next to the cache, synced and renamed over it so neither an
+  // interrupted write nor a crash leaves a truncated cache behind
+  std::string tempPath = config.pipelineCachePath + ".tmp";
+  {
+    std::ofstream ostream(tempPath, std::ios::binary | std::ios::trunc);
+    if (!ostream.is_open()) {
+      ASH_WARN("Failed to open {} for writing the pipeline cache", tempPath);
+      return;
+    }
+
+    ostream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ostream.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+    if (!ostream.flush()) {
+      ASH_WARN("Failed to write the pipeline cache to {}", tempPath);
+      return;
+    }
+  }
+
+  std::error_code error;
+  if (!syncFile(tempPath)) {
+    ASH_WARN("Failed to sync the pipeline cache to {}", tempPath);
+    std::filesystem::remove(tempPath, error);
+    return;
+  }
+
+  std::filesystem::rename(tempPath, config.pipelineCachePath, error);
+  if (error) {
+    ASH_WARN("Failed to replace pipeline cache {}: {}",
+             config.pipelineCachePath, error.message());
+    std::filesystem::remove(tempPath, error);
+    return;
+  }
+
+  ASH_INFO("Saved {} bytes of pipeline cache to {}", data.size(),
+           config.pipelineCachePath);
 }
 
 void VulkanAPI::createGraphicsPipelines(
     const std::vector<Pipeline> &pipelines) {
   ASH_INFO("Creating graphics pipelines");
 
-  pipelineObjects = pipelines;
+  auto start = std::chrono::high_resolution_clock::now();
 
-  std::vector<char> vert =
-      Helper::readBinaryFile("assets/shaders/shader.vert.spv");
-  std::vector<char> frag =
-      Helper::readBinaryFile("assets/shaders/shader.frag.spv");
+  // The built-in pipeline, variant 0 is lit without alpha testing
+  Pipeline mainPipeline("assets/shaders/shader.vert.spv",
+                        "assets/shaders/shader.frag.spv", "main");
+  mainPipeline.specialize("LIGHTING_MODEL", {1, 0})
+      .specialize("ALPHA_TEST", {0, 1});
 
-  vk::ShaderModule vertShaderModule = createShaderModule(vert);
-  vk::ShaderModule fragShaderModule = createShaderModule(frag);
+  pipelineObjects.clear();
+  pipelineObjects.push_back(mainPipeline);
+  pipelineObjects.insert(pipelineObjects.end(), pipelines.begin(),
+                         pipelines.end());
 
-  vk::PipelineShaderStageCreateInfo vertShaderStageInfo(
-      {}, vk::ShaderStageFlagBits::eVertex, vertShaderModule, "main");
+  uint32_t variantCount = 0;
+  for (uint32_t i = 0; i < pipelineObjects.size(); i++) {
+    const Pipeline &pipeline = pipelineObjects[i];
+    ASH_ASSERT(!pipelineIndices.contains(pipeline.name),
+               "Pipeline {} was loaded twice", pipeline.name);
 
-  vk::PipelineShaderStageCreateInfo fragShaderStageInfo(
-      {}, vk::ShaderStageFlagBits::eFragment, fragShaderModule, "main");
+    pipelineIndices[pipeline.name] = i;
+    pipelineBaseIDs.push_back(variantCount);
+    variantCount += pipeline.getVariantCount();
+  }
 
-  vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
-                                                      fragShaderStageInfo};
+  // Variant IDs in order, so a job index is also the ID it fills in
+  std::vector<std::pair<uint32_t, uint32_t>> variants;
+  variants.reserve(variantCount);
+  for (uint32_t i = 0; i < pipelineObjects.size(); i++)
+    for (uint32_t v = 0; v < pipelineObjects[i].getVariantCount(); v++)
+      variants.emplace_back(i, v);
+
+  graphicsPipelines.resize(variantCount);
+
+  std::vector<std::vector<vk::ShaderModule>> shaderModules(
+      pipelineObjects.size());
+  ThreadPool::parallelFor(pipelineObjects.size(), [&](size_t i) {
+    for (const std::string &path : pipelineObjects[i].paths) {
+      MappedFile code = Helper::readBinaryFile(path.c_str());
+      shaderModules[i].push_back(createShaderModule(code));
+    }
+  });
 
   auto bindingDescription = Vertex::getBindingDescription();
   auto attributeDescriptions = Vertex::getAttributeDescription();
@@ -558,8 +943,6 @@ void VulkanAPI::createGraphicsPipelines(
   vk::GraphicsPipelineCreateInfo pipelineInfo(
       vk::PipelineCreateFlagBits::eAllowDerivatives);
 
-  pipelineInfo.setStages(shaderStages);
-
   pipelineInfo.pVertexInputState = &vertexInputInfo;
   pipelineInfo.pInputAssemblyState = &inputAssembly;
   pipelineInfo.pViewportState = &viewportState;
@@ -574,56 +957,92 @@ void VulkanAPI::createGraphicsPipelines(
   pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass = 0;
 
-  auto [result, graphicsPipeline] =
-      device.createGraphicsPipelines(pipelineCache, pipelineInfo);
-
-  ASH_ASSERT(result == vk::Result::eSuccess,
-             "Failed to create graphics pipeline");
-  graphicsPipelines["main"] = graphicsPipeline.front();
+  // Everything else derives from the base variant of main, so it goes first
+  graphicsPipelines[0] =
+      createPipelineVariant(pipelineObjects[0], shaderModules[0], 0,
+                            pipelineInfo);
 
   pipelineInfo.flags = vk::PipelineCreateFlagBits::eDerivative;
-  pipelineInfo.basePipelineHandle = graphicsPipelines["main"];
+  pipelineInfo.basePipelineHandle = graphicsPipelines[0];
   pipelineInfo.basePipelineIndex = -1;
 
-  for (const Pipeline &pipeline : pipelines) {
-    std::vector<vk::PipelineShaderStageCreateInfo> shaderStageInfos;
-    std::vector<vk::ShaderModule> shaderModules;
-    for (size_t i = 0; i < pipeline.stages.size(); i++) {
-      std::vector<char> code =
-          Helper::readBinaryFile(pipeline.paths[i].c_str());
-      shaderModules.push_back(createShaderModule(code));
+  // The pipeline cache is internally synchronized so workers share it
+  ThreadPool::parallelFor(variants.size() - 1, [&](size_t i) {
+    auto [pipeline, variant] = variants[i + 1];
+    graphicsPipelines[i + 1] =
+        createPipelineVariant(pipelineObjects[pipeline],
+                              shaderModules[pipeline], variant, pipelineInfo);
+  });
 
-      vk::PipelineShaderStageCreateInfo shaderStageInfo;
+  for (auto &modules : shaderModules)
+    for (auto &module : modules)
+      device.destroyShaderModule(module);
 
-      switch (pipeline.stages[i]) {
-      case ShaderStages::VERTEX_SHADER_STAGE:
-        shaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
-        break;
-      case ShaderStages::FRAGMENT_SHADER_STAGE:
-        shaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
-        break;
-      }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::high_resolution_clock::now() - start)
+                     .count();
+  ASH_INFO("Created {} pipeline variants in {} ms", variantCount, elapsed);
+}
 
-      shaderStageInfo.module = shaderModules.back();
-      shaderStageInfo.pName = "main";
-      shaderStageInfo.pSpecializationInfo = nullptr;
-      shaderStageInfos.push_back(shaderStageInfo);
+vk::Pipeline VulkanAPI::createPipelineVariant(
+    const Pipeline &pipeline, const std::vector<vk::ShaderModule> &shaderModules,
+    uint32_t variant, vk::GraphicsPipelineCreateInfo pipelineInfo) {
+  // Every constant is 32 bits wide and laid out by constant_id, stages that
+  // don't declare a constant ignore its entry
+  std::vector<uint32_t> constants = pipeline.getConstants(variant);
+  std::vector<vk::SpecializationMapEntry> mapEntries;
+  for (uint32_t i = 0; i < constants.size(); i++)
+    mapEntries.emplace_back(i, i * sizeof(uint32_t), sizeof(uint32_t));
+
+  vk::SpecializationInfo specializationInfo;
+  specializationInfo.setMapEntries(mapEntries);
+  specializationInfo.setData<uint32_t>(constants);
+
+  std::vector<vk::PipelineShaderStageCreateInfo> shaderStageInfos;
+  for (size_t i = 0; i < pipeline.stages.size(); i++) {
+    vk::PipelineShaderStageCreateInfo shaderStageInfo;
+
+    switch (pipeline.stages[i]) {
+    case ShaderStages::VERTEX_SHADER_STAGE:
+      shaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
+      break;
+    case ShaderStages::FRAGMENT_SHADER_STAGE:
+      shaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
+      break;
     }
 
-    pipelineInfo.setStages(shaderStageInfos);
+    shaderStageInfo.module = shaderModules[i];
+    shaderStageInfo.pName = "main";
+    shaderStageInfo.pSpecializationInfo =
+        constants.empty() ? nullptr : &specializationInfo;
+    shaderStageInfos.push_back(shaderStageInfo);
+  }
 
-    auto [result, pl] =
-        device.createGraphicsPipelines(pipelineCache, pipelineInfo);
-    ASH_ASSERT(result == vk::Result::eSuccess,
-               "Failed to create user pipeline");
-    graphicsPipelines[pipeline.name] = pl.front();
+  pipelineInfo.setStages(shaderStageInfos);
 
-    for (auto &module : shaderModules)
-      device.destroyShaderModule(module);
-  }
+  auto [result, graphicsPipeline] =
+      device.createGraphicsPipelines(pipelineCache, pipelineInfo);
+  ASH_ASSERT(result == vk::Result::eSuccess,
+             "Failed to create variant {} of pipeline {}", variant,
+             pipeline.name);
 
-  device.destroyShaderModule(vertShaderModule);
-  device.destroyShaderModule(fragShaderModule);
+  return graphicsPipeline.front();
+}
+
+uint32_t VulkanAPI::getPipelineID(const std::string &name, uint32_t variant) {
+  ASH_ASSERT(pipelineIndices.contains(name), "Unknown pipeline {}", name);
+
+  uint32_t index = pipelineIndices[name];
+  ASH_ASSERT(variant < pipelineObjects[index].getVariantCount(),
+             "Pipeline {} has no variant {}", name, variant);
+
+  return pipelineBaseIDs[index] + variant;
+}
+
+const Pipeline &VulkanAPI::getPipeline(const std::string &name) {
+  ASH_ASSERT(pipelineIndices.contains(name), "Unknown pipeline {}", name);
+
+  return pipelineObjects[pipelineIndices[name]];
 }
 
 void VulkanAPI::createFramebuffers() {
@@ -645,12 +1064,12 @@ void VulkanAPI::createFramebuffers() {
 
 void VulkanAPI::createUniformBuffers(std::vector<UniformBuffer> &ubos,
                                      vk::DeviceSize bufferSize) {
-  ubos.resize(swapchainImages.size());
+  ubos.resize(config.framesInFlight);
 
-  for (size_t i = 0; i < swapchainImages.size(); i++) {
+  for (size_t i = 0; i < config.framesInFlight; i++) {
     createBuffer(bufferSize, VMA_MEMORY_USAGE_AUTO,
                  vk::BufferUsageFlagBits::eUniformBuffer, ubos[i].uniformBuffer,
-                 ubos[i].uniformBufferAllocation,
+                 ubos[i].uniformBufferAllocation, MemoryCategory::Uniforms,
                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
   }
 }
@@ -663,8 +1082,8 @@ void VulkanAPI::createDescriptorAllocator() {
 void VulkanAPI::createGlobalDescriptorSets() {
   ASH_INFO("Creating global descriptor set for objects");
 
-  globalDescriptorSets.resize(swapchainImages.size());
-  for (size_t i = 0; i < swapchainImages.size(); i++) {
+  globalDescriptorSets.resize(config.framesInFlight);
+  for (size_t i = 0; i < config.framesInFlight; i++) {
     vk::DescriptorBufferInfo bufferInfo(globalUniformBuffers[i].uniformBuffer,
                                         0, sizeof(GlobalBufferObject));
 
@@ -682,27 +1101,60 @@ void VulkanAPI::createGlobalDescriptorSets() {
   }
 }
 
-void VulkanAPI::createRenderableDescriptorSets(
-    std::vector<vk::DescriptorSet> &sets, const std::vector<UniformBuffer> &ubo,
-    Material &material) {
-  ASH_INFO("Creating descriptor sets for objects and their materials");
+uint32_t VulkanAPI::acquireRenderableResources() {
+  if (!freeRenderableResources.empty()) {
+    uint32_t index = freeRenderableResources.back();
+    freeRenderableResources.pop_back();
+    return index;
+  }
 
-  sets.resize(swapchainImages.size());
-  material.sets.resize(swapchainImages.size());
-  for (size_t i = 0; i < swapchainImages.size(); i++) {
-    vk::DescriptorBufferInfo bufferInfo(ubo[i].uniformBuffer, 0,
+  uint32_t index = static_cast<uint32_t>(renderableResources.size());
+  RenderableResources &resources = renderableResources.emplace_back();
+
+  createUniformBuffers(resources.ubos, sizeof(RenderableBufferObject));
+
+  resources.sets.resize(config.framesInFlight);
+  for (size_t i = 0; i < config.framesInFlight; i++) {
+    vk::DescriptorBufferInfo bufferInfo(resources.ubos[i].uniformBuffer, 0,
                                         sizeof(RenderableBufferObject));
 
-    DescriptorBuilder::begin(&Renderer::getAPI()->descriptorLayoutCache,
-                             &Renderer::getAPI()->descriptorAllocator)
+    DescriptorBuilder::begin(&descriptorLayoutCache, &descriptorAllocator)
         .bind_buffer(0, &bufferInfo, vk::DescriptorType::eUniformBuffer,
                      vk::ShaderStageFlagBits::eVertex)
-        .build(sets[i]);
+        .build(resources.sets[i]);
+  }
+
+  return index;
+}
 
-    vk::DescriptorImageInfo imageInfo(
-        textureSampler, Renderer::getTexture(material.diffuse).imageView,
-        vk::ImageLayout::eShaderReadOnlyOptimal);
+void VulkanAPI::releaseRenderableResources(uint32_t index) {
+  // Frames already submitted may still read the UBOs
+  deletionQueue.push(frameNumber, [this, index]() {
+    freeRenderableResources.push_back(index);
+  });
+}
 
+void VulkanAPI::createMaterialDescriptorSets(Material &material) {
+  vk::DescriptorImageInfo imageInfo(
+      textureSampler, Renderer::getTexture(material.diffuse).imageView,
+      vk::ImageLayout::eShaderReadOnlyOptimal);
+
+  // Every material set has the same layout, only the image changes
+  if (!freeMaterialSets.empty()) {
+    material.sets = std::move(freeMaterialSets.back());
+    freeMaterialSets.pop_back();
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (vk::DescriptorSet set : material.sets)
+      writes.emplace_back(set, 0, 0, 1,
+                          vk::DescriptorType::eCombinedImageSampler,
+                          &imageInfo);
+    device.updateDescriptorSets(writes, {});
+    return;
+  }
+
+  material.sets.resize(config.framesInFlight);
+  for (size_t i = 0; i < config.framesInFlight; i++) {
     DescriptorBuilder::begin(&Renderer::getAPI()->descriptorLayoutCache,
                              &Renderer::getAPI()->descriptorAllocator)
         .bind_image(0, &imageInfo, vk::DescriptorType::eCombinedImageSampler,
@@ -711,6 +1163,14 @@ void VulkanAPI::createRenderableDescriptorSets(
   }
 }
 
+void VulkanAPI::releaseMaterialDescriptorSets(
+    std::vector<vk::DescriptorSet> sets) {
+  // Frames already submitted may still bind them
+  deletionQueue.push(frameNumber, [this, sets = std::move(sets)]() {
+    freeMaterialSets.push_back(sets);
+  });
+}
+
 void VulkanAPI::createCommandPools() {
   ASH_INFO("Creating command pool");
   QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
@@ -740,122 +1200,130 @@ uint32_t VulkanAPI::findMemoryType(uint32_t typeFilter,
   return -1;
 }
 
-void VulkanAPI::createCommandBuffers() {
-  ASH_INFO("Creating command buffers");
-
-  commandBuffers.resize(swapchainFramebuffers.size());
-
-  vk::CommandBufferAllocateInfo allocInfo(
-      commandPool, vk::CommandBufferLevel::ePrimary, commandBuffers.size());
-
-  commandBuffers = device.allocateCommandBuffers(allocInfo);
-
-  recordCommandBuffers();
-}
-
-void VulkanAPI::recordCommandBuffers() {
-  for (size_t i = 0; i < commandBuffers.size(); i++) {
-    commandBuffers[i].begin(vk::CommandBufferBeginInfo());
+void VulkanAPI::createFrames() {
+  ASH_INFO("Creating {} frames in flight", config.framesInFlight);
 
-    vk::RenderPassBeginInfo renderPassInfo(renderPass, swapchainFramebuffers[i],
-                                           {{0, 0}, swapchainExtent});
+  QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
-    std::array<vk::ClearValue, 2> clearValues{
-        vk::ClearValue(
-            {clearColor.r, clearColor.g, clearColor.b, clearColor.a}),
-        vk::ClearValue({1, 0})};
+  // Each frame owns a transient pool that is reset wholesale before its
+  // command buffer is recorded again
+  vk::CommandPoolCreateInfo poolInfo(vk::CommandPoolCreateFlagBits::eTransient,
+                                     queueFamilyIndices.graphicsFamily.value());
 
-    renderPassInfo.setClearValues(clearValues);
+  frames.resize(config.framesInFlight);
+  for (FrameData &frame : frames) {
+    frame.commandPool = device.createCommandPool(poolInfo);
 
-    commandBuffers[i].beginRenderPass(renderPassInfo,
-                                      vk::SubpassContents::eInline);
+    vk::CommandBufferAllocateInfo allocInfo(
+        frame.commandPool, vk::CommandBufferLevel::ePrimary, 1);
+    frame.commandBuffer = device.allocateCommandBuffers(allocInfo).front();
 
-    vk::Viewport viewport(0, 0, swapchainExtent.width, swapchainExtent.height,
-                          0, 1);
+    frame.imageAvailable = device.createSemaphore({});
+  }
+}
 
-    vk::Rect2D scissor({0, 0}, swapchainExtent);
+void VulkanAPI::recordCommandBuffer(vk::CommandBuffer commandBuffer,
+                                    uint32_t imageIndex) {
+  commandBuffer.begin(vk::CommandBufferBeginInfo());
 
-    commandBuffers[i].setViewport(0, viewport);
-    commandBuffers[i].setScissor(0, scissor);
-    commandBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                         pipelineLayout, 0,
-                                         globalDescriptorSets[i], {});
+  vk::RenderPassBeginInfo renderPassInfo(
+      renderPass, swapchainFramebuffers[imageIndex], {{0, 0}, swapchainExtent});
 
-    vk::DeviceSize offsets[] = {0};
+  std::array<vk::ClearValue, 2> clearValues{
+      vk::ClearValue({clearColor.r, clearColor.g, clearColor.b, clearColor.a}),
+      vk::ClearValue({1, 0})};
 
-    std::shared_ptr<Scene> scene = Renderer::getScene();
-    if (scene) {
-      auto renderables = scene->registry.view<Renderable>();
+  renderPassInfo.setClearValues(clearValues);
 
-      for (auto entity : renderables) {
-        auto &renderable = renderables.get(entity);
+  commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
 
-        Model &model = Renderer::getModel(renderable.model);
-        for (uint32_t j = 0; j < model.meshes.size(); j++) {
-          Mesh &mesh = Renderer::getMesh(model.meshes[j]);
-          vk::Buffer vb[] = {mesh.ivb.buffer};
+  vk::Viewport viewport(0, 0, swapchainExtent.width, swapchainExtent.height, 0,
+                        1);
 
-          commandBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                               pipelineLayout, 1,
-                                               model.materials[j].sets[i], {});
+  vk::Rect2D scissor({0, 0}, swapchainExtent);
 
-          // Each model should have their own pipeline
-          commandBuffers[i].bindPipeline(
-              vk::PipelineBindPoint::eGraphics,
-              graphicsPipelines[renderable.pipeline]);
+  commandBuffer.setViewport(0, viewport);
+  commandBuffer.setScissor(0, scissor);
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                   pipelineLayout, 0,
+                                   globalDescriptorSets[currentFrame], {});
 
-          // Each model has their own mesh and thus their own vertex
-          // and index buffers
-          commandBuffers[i].bindVertexBuffers(0, vb, offsets);
-          commandBuffers[i].bindIndexBuffer(mesh.ivb.buffer, mesh.ivb.vertSize,
-                                            vk::IndexType::eUint32);
+  vk::DeviceSize offsets[] = {0};
 
-          // Each entity has their own transform and thus their own
-          // UBO transform matrix
-          commandBuffers[i].bindDescriptorSets(
-              vk::PipelineBindPoint::eGraphics, pipelineLayout, 2,
-              renderable.descriptorSets[j][i], {});
+  std::shared_ptr<Scene> scene = Renderer::getScene();
+  if (scene) {
+    auto renderables = scene->registry.view<Renderable>();
 
-          commandBuffers[i].drawIndexed(mesh.ivb.numIndices, 1, 0, 0, 0);
-        }
+    for (auto entity : renderables) {
+      auto &renderable = renderables.get(entity);
+
+      // Renderables naming a model that isn't loaded draw nothing
+      Model *model = Renderer::getModels().find(renderable.model);
+      if (!model)
+        continue;
+
+      model->lastUsedFrame = frameNumber;
+      for (uint32_t j = 0; j < model->meshes.size(); j++) {
+        Mesh &mesh = Renderer::getMesh(model->meshes[j]);
+        Material &material = Renderer::getMaterial(model->materials[j]);
+        vk::Buffer vb[] = {mesh.ivb.buffer};
+
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                         pipelineLayout, 1,
+                                         material.sets[currentFrame], {});
+
+        // Each model should have their own pipeline
+        commandBuffer.bindPipeline(
+            vk::PipelineBindPoint::eGraphics,
+            graphicsPipelines[renderable.pipeline.index]);
+
+        // Each model has their own mesh and thus their own vertex
+        // and index buffers
+        commandBuffer.bindVertexBuffers(0, vb, offsets);
+        commandBuffer.bindIndexBuffer(mesh.ivb.buffer, mesh.ivb.vertSize,
+                                      vk::IndexType::eUint32);
+
+        // Each entity has their own transform and thus their own
+        // UBO transform matrix
+        commandBuffer.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics, pipelineLayout, 2,
+            renderableResources[renderable.resources].sets[currentFrame], {});
+
+        commandBuffer.drawIndexed(mesh.ivb.numIndices, 1, 0, 0, 0);
       }
     }
+  }
 
-    commandBuffers[i].endRenderPass();
+  commandBuffer.endRenderPass();
 
-    commandBuffers[i].end();
-  }
+  commandBuffer.end();
 }
 
 void VulkanAPI::createSyncObjects() {
   ASH_INFO("Creating synchronization objects");
 
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(swapchainImages.size(), VK_NULL_HANDLE);
+  vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+  frameTimeline = device.createSemaphore({{}, &timelineInfo});
 
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    imageAvailableSemaphores[i] = device.createSemaphore({});
-    renderFinishedSemaphores[i] = device.createSemaphore({});
-    inFlightFences[i] =
-        device.createFence({vk::FenceCreateFlagBits::eSignaled});
-  }
+  createRenderFinishedSemaphores();
+}
 
-  copyFinishedFence = device.createFence({vk::FenceCreateFlagBits::eSignaled});
+void VulkanAPI::createRenderFinishedSemaphores() {
+  renderFinishedSemaphores.resize(swapchainImages.size());
+  for (auto &semaphore : renderFinishedSemaphores)
+    semaphore = device.createSemaphore({});
 }
 
 void VulkanAPI::cleanupSwapchain() {
   device.destroyImageView(depthImageView);
 
-  vmaDestroyImage(allocator, depthImage, depthImageAllocation);
+  destroyImage(depthImage, depthImageAllocation);
 
   for (auto framebuffer : swapchainFramebuffers)
     device.destroyFramebuffer(framebuffer);
 
-  device.freeCommandBuffers(commandPool, commandBuffers);
-
-  device.destroyRenderPass(renderPass);
+  for (auto semaphore : renderFinishedSemaphores)
+    device.destroySemaphore(semaphore);
 
   for (auto imageView : swapchainImageViews)
     device.destroyImageView(imageView);
@@ -871,53 +1339,729 @@ void VulkanAPI::recreateSwapchain() {
     glfwWaitEvents();
   }
 
-  device.waitIdle();
-
   ASH_INFO("Recreating swapchain");
 
-  cleanupSwapchain();
+  // Frames in flight keep using the old resources, so they are only destroyed
+  // once those frames complete instead of draining the device. The render pass
+  // doesn't depend on the extent and is kept
+  retireSwapchainResources();
 
   createSwapchain();
   createImageViews();
-  createRenderPass();
   createDepthResources();
   createFramebuffers();
-  createCommandBuffers();
+  createRenderFinishedSemaphores();
+
+  swapchainDirty = false;
+}
+
+void VulkanAPI::retireSwapchainResources() {
+  deletionQueue.push(
+      frameNumber,
+      [this, imageViews = swapchainImageViews,
+       framebuffers = swapchainFramebuffers, depthImage = depthImage,
+       depthImageView = depthImageView,
+       depthImageAllocation = depthImageAllocation,
+       semaphores = renderFinishedSemaphores]() {
+        for (auto framebuffer : framebuffers)
+          device.destroyFramebuffer(framebuffer);
+
+        device.destroyImageView(depthImageView);
+        destroyImage(depthImage, depthImageAllocation);
+
+        for (auto semaphore : semaphores)
+          device.destroySemaphore(semaphore);
+
+        for (auto imageView : imageViews)
+          device.destroyImageView(imageView);
+      });
+}
+
+void VulkanAPI::setVSync(bool vsync) {
+  if (config.vsync == vsync)
+    return;
+
+  config.vsync = vsync;
+  swapchainDirty = true;
 }
 
 void VulkanAPI::createBuffer(vk::DeviceSize size, VmaMemoryUsage memUsage,
                              vk::BufferUsageFlags usage, vk::Buffer &buffer,
                              VmaAllocation &allocation,
-                             VmaAllocationCreateFlags flags) {
+                             MemoryCategory category,
+                             VmaAllocationCreateFlags flags,
+                             VmaAllocationInfo *allocationInfo) {
+  ASH_ASSERT(tryCreateBuffer(size, memUsage, usage, buffer, allocation,
+                             category, flags, allocationInfo),
+             "Failed to create buffer and allocation");
+}
+
+bool VulkanAPI::tryCreateBuffer(vk::DeviceSize size, VmaMemoryUsage memUsage,
+                                vk::BufferUsageFlags usage, vk::Buffer &buffer,
+                                VmaAllocation &allocation,
+                                MemoryCategory category,
+                                VmaAllocationCreateFlags flags,
+                                VmaAllocationInfo *allocationInfo) {
   vk::BufferCreateInfo bufferInfo({}, size, usage);
 
-  VmaAllocationCreateInfo allocationInfo{};
-  allocationInfo.usage = memUsage;
-  allocationInfo.flags = flags;
+  VmaAllocationCreateInfo allocCreateInfo{};
+  allocCreateInfo.usage = memUsage;
+  allocCreateInfo.flags = flags;
+  allocCreateInfo.pool = getMemoryPool(category, flags);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  VkResult result = vmaCreateBuffer(
+      allocator, reinterpret_cast<VkBufferCreateInfo *>(&bufferInfo),
+      &allocCreateInfo, reinterpret_cast<VkBuffer *>(&buffer), &allocation,
+      allocationInfo);
+
+  // Full pools and requests larger than a pool block use default placement
+  if (result != VK_SUCCESS && allocCreateInfo.pool) {
+    allocCreateInfo.pool = VK_NULL_HANDLE;
+    result = vmaCreateBuffer(
+        allocator, reinterpret_cast<VkBufferCreateInfo *>(&bufferInfo),
+        &allocCreateInfo, reinterpret_cast<VkBuffer *>(&buffer), &allocation,
+        allocationInfo);
+  }
 
-  ASH_ASSERT(vmaCreateBuffer(
-                 allocator, reinterpret_cast<VkBufferCreateInfo *>(&bufferInfo),
-                 &allocationInfo, reinterpret_cast<VkBuffer *>(&buffer),
-                 &allocation, nullptr) == VK_SUCCESS,
-             "Failed to create buffer and allocation");
+  if (result != VK_SUCCESS)
+    return false;
+
+  trackAllocation(allocation, category,
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count());
+  return true;
 }
 
-void VulkanAPI::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                           vk::DeviceSize size) {
-  vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+void VulkanAPI::createMemoryPools() {
+  if (!config.useMemoryPools)
+    return;
 
-  vk::BufferCopy copyRegion{};
-  copyRegion.size = size;
-  commandBuffer.copyBuffer(srcBuffer, dstBuffer, copyRegion);
+  ASH_INFO("Creating memory pools");
 
-  endSingleTimeCommands(commandBuffer);
+  // Pools are tied to one memory type, found from a representative resource
+  // of each category
+  auto findBufferMemoryType = [&](vk::BufferUsageFlags usage,
+                                  VmaMemoryUsage memUsage,
+                                  VmaAllocationCreateFlags flags) {
+    vk::BufferCreateInfo bufferInfo({}, 1024, usage);
+
+    VmaAllocationCreateInfo allocCreateInfo{};
+    allocCreateInfo.usage = memUsage;
+    allocCreateInfo.flags = flags;
+
+    uint32_t memoryTypeIndex;
+    ASH_ASSERT(vmaFindMemoryTypeIndexForBufferInfo(
+                   allocator,
+                   reinterpret_cast<VkBufferCreateInfo *>(&bufferInfo),
+                   &allocCreateInfo, &memoryTypeIndex) == VK_SUCCESS,
+               "Failed to find a memory type for a buffer pool");
+    return memoryTypeIndex;
+  };
+
+  vk::ImageCreateInfo imageInfo(
+      {}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Srgb,
+      vk::Extent3D(1024, 1024, 1), 1, 1, vk::SampleCountFlagBits::e1,
+      vk::ImageTiling::eOptimal, textureImageUsage,
+      vk::SharingMode::eExclusive);
+
+  VmaAllocationCreateInfo imageAllocCreateInfo{};
+  imageAllocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+  uint32_t textureMemoryType;
+  ASH_ASSERT(vmaFindMemoryTypeIndexForImageInfo(
+                 allocator, reinterpret_cast<VkImageCreateInfo *>(&imageInfo),
+                 &imageAllocCreateInfo, &textureMemoryType) == VK_SUCCESS,
+             "Failed to find a memory type for the texture pool");
+
+  const VkPhysicalDeviceMemoryProperties *memProperties;
+  vmaGetMemoryProperties(allocator, &memProperties);
+
+  auto setPool = [&](MemoryCategory category, uint32_t memoryTypeIndex,
+                     vk::DeviceSize blockSize, size_t maxBlockCount,
+                     VmaPoolCreateFlags flags) {
+    MemoryPool &pool = memoryPools[static_cast<size_t>(category)];
+    pool.pool =
+        createMemoryPool(memoryTypeIndex, blockSize, maxBlockCount, flags);
+    pool.hostVisible =
+        memProperties->memoryTypes[memoryTypeIndex].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    vmaSetPoolName(allocator, pool.pool, getMemoryCategoryName(category));
+  };
+
+  // Uniform buffers are small and recycled rather than freed, so a linear
+  // pool packs them back to back without any free list bookkeeping
+  setPool(MemoryCategory::Uniforms,
+          findBufferMemoryType(
+              vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_AUTO,
+              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT),
+          config.uniformPoolBlockSize, 0,
+          VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT);
+
+  // Overflow staging is freed in submission order, a single linear block is
+  // then used as a ring buffer and each free is O(1)
+  setPool(MemoryCategory::Staging,
+          findBufferMemoryType(vk::BufferUsageFlagBits::eTransferSrc,
+                               VMA_MEMORY_USAGE_AUTO,
+                               VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT),
+          config.stagingPoolSize, 1, VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT);
+
+  setPool(MemoryCategory::Geometry,
+          findBufferMemoryType(geometryBufferUsage,
+                               VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0),
+          config.geometryPoolBlockSize, 0, 0);
+
+  setPool(MemoryCategory::Textures, textureMemoryType,
+          config.texturePoolBlockSize, 0, 0);
 }
 
-void VulkanAPI::copyBufferToImage(vk::Buffer buffer, vk::Image image,
-                                  uint32_t width, uint32_t height) {
-  vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+VmaPool VulkanAPI::createMemoryPool(uint32_t memoryTypeIndex,
+                                    vk::DeviceSize blockSize,
+                                    size_t maxBlockCount,
+                                    VmaPoolCreateFlags flags) {
+  VmaPoolCreateInfo poolInfo{};
+  poolInfo.memoryTypeIndex = memoryTypeIndex;
+  poolInfo.blockSize = blockSize;
+  poolInfo.maxBlockCount = maxBlockCount;
+  poolInfo.flags = flags;
+
+  VmaPool pool;
+  ASH_ASSERT(vmaCreatePool(allocator, &poolInfo, &pool) == VK_SUCCESS,
+             "Failed to create memory pool");
+  return pool;
+}
+
+VmaPool VulkanAPI::getMemoryPool(MemoryCategory category,
+                                 VmaAllocationCreateFlags flags) {
+  const MemoryPool &pool = memoryPools[static_cast<size_t>(category)];
+
+  // Requests that want host access can't be placed in device only pools,
+  // e.g. geometry written directly into host visible device memory
+  VmaAllocationCreateFlags hostAccess =
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+  if ((flags & hostAccess) && !pool.hostVisible)
+    return VK_NULL_HANDLE;
+
+  return pool.pool;
+}
+
+void VulkanAPI::startDefragmentation() {
+  auto now = std::chrono::steady_clock::now();
+  if (now - defragmentation.lastCheck < std::chrono::seconds(1))
+    return;
+  defragmentation.lastCheck = now;
+
+  for (MemoryCategory category :
+       {MemoryCategory::Geometry, MemoryCategory::Textures}) {
+    VmaPool pool = memoryPools[static_cast<size_t>(category)].pool;
+    if (!pool)
+      continue;
+
+    VmaStatistics stats;
+    vmaGetPoolStatistics(allocator, pool, &stats);
+
+    // Compacting a single block can't give memory back
+    VkDeviceSize freeBytes = stats.blockBytes - stats.allocationBytes;
+    if (stats.blockCount < 2 ||
+        freeBytes < config.defragmentationThreshold * stats.blockBytes)
+      continue;
+
+    ASH_INFO("Defragmenting {} pool, {} MiB free in {} blocks",
+             getMemoryCategoryName(category), freeBytes >> 20,
+             stats.blockCount);
+
+    VmaDefragmentationInfo defragInfo{};
+    defragInfo.pool = pool;
+    defragInfo.maxBytesPerPass = config.defragmentationBytesPerPass;
+    defragInfo.maxAllocationsPerPass = config.defragmentationMovesPerPass;
+
+    ASH_ASSERT(vmaBeginDefragmentation(allocator, &defragInfo,
+                                       &defragmentation.context) ==
+                   VK_SUCCESS,
+               "Failed to begin defragmentation");
+    defragmentation.category = category;
+    return;
+  }
+}
+
+void VulkanAPI::updateDefragmentation() {
+  if (!config.defragmentation)
+    return;
+
+  switch (defragmentation.state) {
+  case DefragmentationState::Idle:
+    // Moves are recorded into an upload batch of their own, submitting it
+    // would have to wait for queued batches
+    if (uploadBatch || !queuedUploadBatches.empty())
+      return;
+
+    if (!defragmentation.context)
+      startDefragmentation();
 
+    if (defragmentation.context && !beginDefragmentationPass())
+      finishDefragmentation();
+    return;
+
+  case DefragmentationState::Copying:
+    if (!isUploadComplete(defragmentation.uploadSerial))
+      return;
+
+    swapDefragmentedResources();
+    defragmentation.patchedFrames.assign(frames.size(), false);
+    defragmentation.state = DefragmentationState::Patching;
+    [[fallthrough]];
+
+  case DefragmentationState::Patching:
+    // A slot's descriptor sets are only free to update once the frame that
+    // last used them is done, which is now for the current slot
+    patchDefragmentedDescriptors(currentFrame);
+
+    for (bool patched : defragmentation.patchedFrames)
+      if (!patched)
+        return;
+
+    defragmentation.retireFrame = frameNumber;
+    defragmentation.state = DefragmentationState::Retiring;
+    return;
+
+  case DefragmentationState::Retiring:
+    if (device.getSemaphoreCounterValue(frameTimeline) <
+        defragmentation.retireFrame)
+      return;
+
+    endDefragmentationPass();
+    return;
+  }
+}
+
+bool VulkanAPI::beginDefragmentationPass() {
+  Defragmentation &defrag = defragmentation;
+
+  if (vmaBeginDefragmentationPass(allocator, defrag.context, &defrag.pass) ==
+      VK_SUCCESS)
+    return false;
+
+  // Owners are looked up once per pass rather than once per move
+  std::unordered_map<VmaAllocation, Mesh *> meshOwners;
+  std::unordered_map<VmaAllocation, Texture *> textureOwners;
+  if (defrag.category == MemoryCategory::Geometry)
+    Renderer::getMeshes().forEach([&](MeshHandle, Mesh &mesh) {
+      meshOwners[mesh.ivb.bufferAllocation] = &mesh;
+    });
+  else
+    Renderer::getTextures().forEach([&](TextureHandle, Texture &texture) {
+      textureOwners[texture.imageAllocation] = &texture;
+    });
+
+  beginUploadBatch();
+  vk::CommandBuffer commandBuffer = uploadBatch->commandBuffer;
+
+  defrag.moves.clear();
+  for (uint32_t i = 0; i < defrag.pass.moveCount; i++) {
+    VmaDefragmentationMove &vmaMove = defrag.pass.pMoves[i];
+
+    DefragmentationMove move{};
+    move.allocation = vmaMove.srcAllocation;
+    move.category = defrag.category;
+    move.passIndex = i;
+
+    if (auto it = meshOwners.find(vmaMove.srcAllocation);
+        it != meshOwners.end()) {
+      const IndexedVertexBuffer &ivb = it->second->ivb;
+      vk::DeviceSize size = ivb.vertSize + ivb.numIndices * sizeof(uint32_t);
+
+      move.oldBuffer = ivb.buffer;
+      move.newBuffer = device.createBuffer({{}, size, geometryBufferUsage});
+      vmaBindBufferMemory(allocator, vmaMove.dstTmpAllocation, move.newBuffer);
+
+      copyBuffer(commandBuffer, move.oldBuffer, 0, move.newBuffer, 0, size);
+    } else if (auto it = textureOwners.find(vmaMove.srcAllocation);
+               it != textureOwners.end()) {
+      const Texture &texture = *it->second;
+
+      move.oldImage = texture.image;
+      move.oldImageView = texture.imageView;
+      move.newImage = device.createImage(
+          {{},
+           vk::ImageType::e2D,
+           vk::Format::eR8G8B8A8Srgb,
+           vk::Extent3D(texture.width, texture.height, 1),
+           1,
+           1,
+           vk::SampleCountFlagBits::e1,
+           vk::ImageTiling::eOptimal,
+           textureImageUsage,
+           vk::SharingMode::eExclusive});
+      vmaBindImageMemory(allocator, vmaMove.dstTmpAllocation, move.newImage);
+
+      vk::PipelineStageFlags sourceStage, destinationStage;
+      vk::PipelineStageFlags srcStageMask, dstStageMask;
+
+      // Frames submitted earlier may still sample the old image, the barrier
+      // orders the copy after them
+      std::array<vk::ImageMemoryBarrier, 2> barriers = {
+          createImageLayoutBarrier(move.oldImage, vk::Format::eR8G8B8A8Srgb,
+                                   vk::ImageLayout::eShaderReadOnlyOptimal,
+                                   vk::ImageLayout::eTransferSrcOptimal,
+                                   sourceStage, destinationStage),
+          createImageLayoutBarrier(move.newImage, vk::Format::eR8G8B8A8Srgb,
+                                   vk::ImageLayout::eUndefined,
+                                   vk::ImageLayout::eTransferDstOptimal,
+                                   srcStageMask, dstStageMask)};
+      commandBuffer.pipelineBarrier(sourceStage | srcStageMask,
+                                    destinationStage | dstStageMask, {}, {},
+                                    {}, barriers);
+
+      vk::ImageCopy region(
+          {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0},
+          {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0},
+          vk::Extent3D(texture.width, texture.height, 1));
+      commandBuffer.copyImage(move.oldImage,
+                              vk::ImageLayout::eTransferSrcOptimal,
+                              move.newImage,
+                              vk::ImageLayout::eTransferDstOptimal, region);
+
+      // Both go back to shader reads with the rest of the batch
+      uploadBatch->imageBarriers.push_back(createImageLayoutBarrier(
+          move.oldImage, vk::Format::eR8G8B8A8Srgb,
+          vk::ImageLayout::eTransferSrcOptimal,
+          vk::ImageLayout::eShaderReadOnlyOptimal, sourceStage,
+          destinationStage));
+      uploadBatch->imageBarriers.push_back(createImageLayoutBarrier(
+          move.newImage, vk::Format::eR8G8B8A8Srgb,
+          vk::ImageLayout::eTransferDstOptimal,
+          vk::ImageLayout::eShaderReadOnlyOptimal, sourceStage,
+          destinationStage));
+
+      move.newImageView = createImageView(
+          move.newImage, vk::Format::eR8G8B8A8Srgb,
+          vk::ImageAspectFlagBits::eColor);
+    } else {
+      // Not something the renderer knows how to relocate
+      vmaMove.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+
+    defrag.moves.push_back(move);
+  }
+
+  defrag.uploadSerial = submitUploadBatch();
+  defrag.state = DefragmentationState::Copying;
+
+  return true;
+}
+
+void VulkanAPI::swapDefragmentedResources() {
+  std::unordered_map<VmaAllocation, const DefragmentationMove *> moves;
+  for (const DefragmentationMove &move : defragmentation.moves)
+    moves[move.allocation] = &move;
+
+  // Frames recorded from here on use the new copies
+  auto patchBuffer = [&](IndexedVertexBuffer &ivb) {
+    if (auto it = moves.find(ivb.bufferAllocation); it != moves.end())
+      ivb.buffer = it->second->newBuffer;
+  };
+  auto patchTexture = [&](Texture &texture) {
+    if (auto it = moves.find(texture.imageAllocation); it != moves.end()) {
+      texture.image = it->second->newImage;
+      texture.imageView = it->second->newImageView;
+    }
+  };
+
+  if (defragmentation.category == MemoryCategory::Geometry) {
+    Renderer::getMeshes().forEach(
+        [&](MeshHandle, Mesh &mesh) { patchBuffer(mesh.ivb); });
+    for (IndexedVertexBuffer &ivb : indexedVertexBuffers)
+      patchBuffer(ivb);
+  } else {
+    Renderer::getTextures().forEach(
+        [&](TextureHandle, Texture &texture) { patchTexture(texture); });
+    for (Texture &texture : textures)
+      patchTexture(texture);
+  }
+}
+
+void VulkanAPI::patchDefragmentedDescriptors(uint32_t frame) {
+  Defragmentation &defrag = defragmentation;
+  if (defrag.patchedFrames[frame])
+    return;
+  defrag.patchedFrames[frame] = true;
+
+  if (defrag.category != MemoryCategory::Textures)
+    return;
+
+  std::unordered_set<VmaAllocation> moved;
+  for (const DefragmentationMove &move : defrag.moves)
+    moved.insert(move.allocation);
+
+  Renderer::getMaterials().forEach([&](MaterialHandle, Material &material) {
+    if (frame >= material.sets.size())
+      return;
+
+    Texture &texture = Renderer::getTexture(material.diffuse);
+    if (!moved.contains(texture.imageAllocation))
+      return;
+
+    vk::DescriptorImageInfo imageInfo(textureSampler, texture.imageView,
+                                      vk::ImageLayout::eShaderReadOnlyOptimal);
+    vk::WriteDescriptorSet write(material.sets[frame], 0, 0,
+                                 vk::DescriptorType::eCombinedImageSampler,
+                                 imageInfo);
+    device.updateDescriptorSets(write, {});
+  });
+}
+
+void VulkanAPI::endDefragmentationPass() {
+  Defragmentation &defrag = defragmentation;
+
+  // No frame can reference the old copies anymore, VMA frees their memory
+  // when the pass ends
+  for (const DefragmentationMove &move : defrag.moves) {
+    if (move.oldBuffer)
+      device.destroyBuffer(move.oldBuffer);
+    if (move.oldImageView)
+      device.destroyImageView(move.oldImageView);
+    if (move.oldImage)
+      device.destroyImage(move.oldImage);
+
+    if (!move.released)
+      continue;
+
+    if (move.newBuffer)
+      device.destroyBuffer(move.newBuffer);
+    if (move.newImageView)
+      device.destroyImageView(move.newImageView);
+    if (move.newImage)
+      device.destroyImage(move.newImage);
+  }
+  defrag.moves.clear();
+  defrag.state = DefragmentationState::Idle;
+
+  if (vmaEndDefragmentationPass(allocator, defrag.context, &defrag.pass) ==
+      VK_SUCCESS)
+    finishDefragmentation();
+}
+
+void VulkanAPI::finishDefragmentation() {
+  Defragmentation &defrag = defragmentation;
+  if (!defrag.context)
+    return;
+
+  // Only reached mid-pass at shutdown, with the device idle
+  if (defrag.state != DefragmentationState::Idle) {
+    if (defrag.state == DefragmentationState::Copying)
+      swapDefragmentedResources();
+    defrag.state = DefragmentationState::Retiring;
+    endDefragmentationPass();
+    if (!defrag.context)
+      return;
+  }
+
+  vmaEndDefragmentation(allocator, defrag.context, &defrag.stats);
+  defrag.context = VK_NULL_HANDLE;
+
+  ASH_INFO("Defragmented {} pool: moved {} allocations ({} MiB), freed {} "
+           "blocks ({} MiB)",
+           getMemoryCategoryName(defrag.category),
+           defrag.stats.allocationsMoved, defrag.stats.bytesMoved >> 20,
+           defrag.stats.deviceMemoryBlocksFreed,
+           defrag.stats.bytesFreed >> 20);
+}
+
+// The category lives in the allocation's user data so it can be found again
+// when the allocation is destroyed, the name shows up in the JSON dump
+void VulkanAPI::trackAllocation(VmaAllocation allocation,
+                                MemoryCategory category,
+                                uint64_t nanoseconds) {
+  vmaSetAllocationUserData(
+      allocator, allocation,
+      reinterpret_cast<void *>(static_cast<uintptr_t>(category)));
+  vmaSetAllocationName(allocator, allocation, getMemoryCategoryName(category));
+
+  VmaAllocationInfo allocationInfo;
+  vmaGetAllocationInfo(allocator, allocation, &allocationInfo);
+
+  CategoryMemoryStats &stats = categoryStats[static_cast<size_t>(category)];
+  stats.allocationCount++;
+  stats.allocationBytes += allocationInfo.size;
+  stats.peakAllocationBytes =
+      std::max(stats.peakAllocationBytes, stats.allocationBytes);
+  stats.totalAllocationCount++;
+  stats.allocationNanoseconds += nanoseconds;
+}
+
+void VulkanAPI::untrackAllocation(VmaAllocation allocation) {
+  VmaAllocationInfo allocationInfo;
+  vmaGetAllocationInfo(allocator, allocation, &allocationInfo);
+
+  CategoryMemoryStats &stats =
+      categoryStats[reinterpret_cast<uintptr_t>(allocationInfo.pUserData)];
+  stats.allocationCount--;
+  stats.allocationBytes -= allocationInfo.size;
+}
+
+void VulkanAPI::destroyBuffer(vk::Buffer buffer, VmaAllocation allocation) {
+  untrackAllocation(allocation);
+  vmaDestroyBuffer(allocator, buffer, allocation);
+}
+
+void VulkanAPI::destroyImage(vk::Image image, VmaAllocation allocation) {
+  untrackAllocation(allocation);
+  vmaDestroyImage(allocator, image, allocation);
+}
+
+// Resources in the middle of a defragmentation pass are retired with it
+bool VulkanAPI::releaseDefragmentedAllocation(VmaAllocation allocation) {
+  Defragmentation &defrag = defragmentation;
+  if (defrag.state == DefragmentationState::Idle)
+    return false;
+
+  for (DefragmentationMove &move : defrag.moves) {
+    if (move.allocation != allocation || move.released)
+      continue;
+
+    untrackAllocation(allocation);
+    defrag.pass.pMoves[move.passIndex].operation =
+        VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+    move.released = true;
+
+    // Either copy may have been used by frames recorded up to now
+    defrag.retireFrame = std::max(defrag.retireFrame, frameNumber);
+    return true;
+  }
+
+  return false;
+}
+
+void VulkanAPI::destroyIndexedVertexArray(const IndexedVertexBuffer &ivb) {
+  std::erase_if(indexedVertexBuffers, [&](const IndexedVertexBuffer &other) {
+    return other.bufferAllocation == ivb.bufferAllocation;
+  });
+
+  if (releaseDefragmentedAllocation(ivb.bufferAllocation))
+    return;
+
+  deletionQueue.push(frameNumber, [this, ivb]() {
+    destroyBuffer(ivb.buffer, ivb.bufferAllocation);
+  });
+}
+
+void VulkanAPI::destroyTexture(const Texture &texture) {
+  std::erase_if(textures, [&](const Texture &other) {
+    return other.imageAllocation == texture.imageAllocation;
+  });
+
+  if (releaseDefragmentedAllocation(texture.imageAllocation))
+    return;
+
+  deletionQueue.push(frameNumber, [this, texture]() {
+    device.destroyImageView(texture.imageView);
+    destroyImage(texture.image, texture.imageAllocation);
+  });
+}
+
+vk::DeviceSize VulkanAPI::getAllocationSize(VmaAllocation allocation) {
+  VmaAllocationInfo info;
+  vmaGetAllocationInfo(allocator, allocation, &info);
+  return info.size;
+}
+
+uint64_t VulkanAPI::getCompletedFrameNumber() {
+  return device.getSemaphoreCounterValue(frameTimeline);
+}
+
+MemoryStats VulkanAPI::getMemoryStats() {
+  const VkPhysicalDeviceMemoryProperties *memProperties;
+  vmaGetMemoryProperties(allocator, &memProperties);
+
+  std::vector<VmaBudget> budgets(memProperties->memoryHeapCount);
+  vmaGetHeapBudgets(allocator, budgets.data());
+
+  MemoryStats stats;
+  for (uint32_t i = 0; i < memProperties->memoryHeapCount; i++) {
+    HeapMemoryStats heap;
+    heap.heapIndex = i;
+    heap.deviceLocal = memProperties->memoryHeaps[i].flags &
+                       VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    heap.usage = budgets[i].usage;
+    heap.budget = budgets[i].budget;
+    heap.blockCount = budgets[i].statistics.blockCount;
+    heap.allocationCount = budgets[i].statistics.allocationCount;
+    heap.blockBytes = budgets[i].statistics.blockBytes;
+    heap.allocationBytes = budgets[i].statistics.allocationBytes;
+    stats.heaps.push_back(heap);
+  }
+
+  stats.categories = categoryStats;
+
+  return stats;
+}
+
+void VulkanAPI::logMemoryStats() {
+  MemoryStats stats = getMemoryStats();
+
+  for (const HeapMemoryStats &heap : stats.heaps) {
+    // Heaps VMA never allocated from only clutter the log
+    if (heap.blockCount == 0 && heap.usage == 0)
+      continue;
+
+    ASH_INFO("Heap {} ({}): {} / {} MiB used, {} MiB in {} blocks, {} MiB in "
+             "{} allocations",
+             heap.heapIndex, heap.deviceLocal ? "device" : "host",
+             heap.usage >> 20, heap.budget >> 20, heap.blockBytes >> 20,
+             heap.blockCount, heap.allocationBytes >> 20,
+             heap.allocationCount);
+  }
+
+  for (size_t i = 0; i < stats.categories.size(); i++) {
+    const CategoryMemoryStats &category = stats.categories[i];
+    ASH_INFO("{}: {:.2f} MiB in {} allocations, peak {:.2f} MiB, {} "
+             "allocations averaging {:.1f} us",
+             getMemoryCategoryName(static_cast<MemoryCategory>(i)),
+             category.allocationBytes / (1024.0 * 1024.0),
+             category.allocationCount,
+             category.peakAllocationBytes / (1024.0 * 1024.0),
+             category.totalAllocationCount,
+             category.totalAllocationCount
+                 ? category.allocationNanoseconds /
+                       (1000.0 * category.totalAllocationCount)
+                 : 0.0);
+  }
+}
+
+std::string VulkanAPI::buildMemoryStatsJson(bool detailedMap) {
+  char *statsString;
+  vmaBuildStatsString(allocator, &statsString, detailedMap);
+
+  std::string json(statsString);
+  vmaFreeStatsString(allocator, statsString);
+
+  return json;
+}
+
+bool VulkanAPI::isHostVisible(VmaAllocation allocation) {
+  VkMemoryPropertyFlags memProperties;
+  vmaGetAllocationMemoryProperties(allocator, allocation, &memProperties);
+  return memProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+void VulkanAPI::copyBuffer(vk::CommandBuffer commandBuffer,
+                           vk::Buffer srcBuffer, vk::DeviceSize srcOffset,
+                           vk::Buffer dstBuffer, vk::DeviceSize dstOffset,
+                           vk::DeviceSize size) {
+  vk::BufferCopy copyRegion(srcOffset, dstOffset, size);
+  commandBuffer.copyBuffer(srcBuffer, dstBuffer, copyRegion);
+}
+
+void VulkanAPI::copyBufferToImage(vk::CommandBuffer commandBuffer,
+                                  vk::Buffer buffer,
+                                  vk::DeviceSize bufferOffset, vk::Image image,
+                                  uint32_t width, uint32_t height) {
   vk::BufferImageCopy region;
+  region.setBufferOffset(bufferOffset);
   region.setImageSubresource(
       vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1));
   region.setImageOffset(vk::Offset3D(0, 0, 0));
@@ -925,11 +2069,10 @@ void VulkanAPI::copyBufferToImage(vk::Buffer buffer, vk::Image image,
 
   commandBuffer.copyBufferToImage(buffer, image,
                                   vk::ImageLayout::eTransferDstOptimal, region);
-
-  endSingleTimeCommands(commandBuffer);
 }
 
-vk::ShaderModule VulkanAPI::createShaderModule(const std::vector<char> &code) {
+vk::ShaderModule VulkanAPI::createShaderModule(const MappedFile &code) {
+  // Mappings are page aligned, so the SPIR-V words can be read in place
   vk::ShaderModuleCreateInfo createInfo(
       {}, code.size(), reinterpret_cast<const uint32_t *>(code.data()));
 
@@ -939,26 +2082,44 @@ vk::ShaderModule VulkanAPI::createShaderModule(const std::vector<char> &code) {
 void VulkanAPI::createImage(uint32_t width, uint32_t height,
                             VmaMemoryUsage memUsage, vk::Format format,
                             vk::ImageTiling tiling, vk::ImageUsageFlags usage,
-                            vk::Image &image, VmaAllocation &allocation) {
+                            vk::Image &image, VmaAllocation &allocation,
+                            MemoryCategory category) {
   vk::ImageCreateInfo imageInfo(
       {}, vk::ImageType::e2D, format, vk::Extent3D(width, height, 1), 1, 1,
       vk::SampleCountFlagBits::e1, tiling, usage, vk::SharingMode::eExclusive);
 
   VmaAllocationCreateInfo allocCreateInfo{};
   allocCreateInfo.usage = memUsage;
+  allocCreateInfo.pool = getMemoryPool(category, 0);
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  VkResult result = vmaCreateImage(
+      allocator, reinterpret_cast<VkImageCreateInfo *>(&imageInfo),
+      &allocCreateInfo, reinterpret_cast<VkImage *>(&image), &allocation,
+      nullptr);
+
+  // Images larger than a pool block or with incompatible memory types
+  if (result != VK_SUCCESS && allocCreateInfo.pool) {
+    allocCreateInfo.pool = VK_NULL_HANDLE;
+    result = vmaCreateImage(
+        allocator, reinterpret_cast<VkImageCreateInfo *>(&imageInfo),
+        &allocCreateInfo, reinterpret_cast<VkImage *>(&image), &allocation,
+        nullptr);
+  }
 
-  ASH_ASSERT(vmaCreateImage(
-                 allocator, reinterpret_cast<VkImageCreateInfo *>(&imageInfo),
-                 &allocCreateInfo, reinterpret_cast<VkImage *>(&image),
-                 &allocation, nullptr) == VK_SUCCESS,
-             "Failed to create device image");
-}
+  ASH_ASSERT(result == VK_SUCCESS, "Failed to create device image");
 
-void VulkanAPI::transitionImageLayout(vk::Image image, vk::Format format,
-                                      vk::ImageLayout oldLayout,
-                                      vk::ImageLayout newLayout) {
-  vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+  trackAllocation(allocation, category,
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::high_resolution_clock::now() - start)
+                      .count());
+}
 
+vk::ImageMemoryBarrier VulkanAPI::createImageLayoutBarrier(
+    vk::Image image, vk::Format format, vk::ImageLayout oldLayout,
+    vk::ImageLayout newLayout, vk::PipelineStageFlags &sourceStage,
+    vk::PipelineStageFlags &destinationStage) {
   vk::ImageMemoryBarrier barrier;
   barrier.oldLayout = oldLayout;
   barrier.newLayout = newLayout;
@@ -982,9 +2143,6 @@ void VulkanAPI::transitionImageLayout(vk::Image image, vk::Format format,
   barrier.srcAccessMask = {}; // TODO
   barrier.dstAccessMask = {}; // TODO
 
-  vk::PipelineStageFlags sourceStage;
-  vk::PipelineStageFlags destinationStage;
-
   if (oldLayout == vk::ImageLayout::eUndefined &&
       newLayout == vk::ImageLayout::eTransferDstOptimal) {
     barrier.srcAccessMask = {};
@@ -1007,11 +2165,38 @@ void VulkanAPI::transitionImageLayout(vk::Image image, vk::Format format,
 
     sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
     destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
+  } else if (oldLayout == vk::ImageLayout::eShaderReadOnlyOptimal &&
+             newLayout == vk::ImageLayout::eTransferSrcOptimal) {
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+    sourceStage = vk::PipelineStageFlagBits::eFragmentShader;
+    destinationStage = vk::PipelineStageFlagBits::eTransfer;
+  } else if (oldLayout == vk::ImageLayout::eTransferSrcOptimal &&
+             newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    sourceStage = vk::PipelineStageFlagBits::eTransfer;
+    destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
   } else {
     ASH_ASSERT(false, "Unsupported image layout transition");
-    return;
   }
 
+  return barrier;
+}
+
+void VulkanAPI::transitionImageLayout(vk::Image image, vk::Format format,
+                                      vk::ImageLayout oldLayout,
+                                      vk::ImageLayout newLayout) {
+  vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+
+  vk::PipelineStageFlags sourceStage;
+  vk::PipelineStageFlags destinationStage;
+
+  vk::ImageMemoryBarrier barrier = createImageLayoutBarrier(
+      image, format, oldLayout, newLayout, sourceStage, destinationStage);
+
   commandBuffer.pipelineBarrier(sourceStage, destinationStage, {}, {}, {},
                                 barrier);
 
@@ -1019,48 +2204,73 @@ void VulkanAPI::transitionImageLayout(vk::Image image, vk::Format format,
 }
 
 void VulkanAPI::createTextureImage(const std::string &path, Texture &texture) {
+  createTextureImage(Helper::readBinaryFile(path.c_str()), path, texture);
+}
+
+void VulkanAPI::createTextureImage(MappedFile file, const std::string &path,
+                                   Texture &texture) {
   ASH_INFO("Loading texture {}", path);
 
-  int texWidth, texHeight, texChannels;
-  stbi_uc *pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels,
-                              STBI_rgb_alpha);
+  int texWidth, texHeight;
+  ASH_ASSERT(Helper::getImageInfo(file.data(), file.size(), texWidth,
+                                  texHeight),
+             "Failed to read image header of {}", path);
 
   vk::DeviceSize imageSize = texWidth * texHeight * 4;
 
-  ASH_ASSERT(pixels, "Failed to load image from disk");
+  bool implicitBatch = !uploadBatch;
+  if (implicitBatch)
+    beginUploadBatch();
+
+  // Pixels are decoded straight into the staging memory they upload from.
+  // Batched textures decode on the thread pool while the copies are recorded
+  StagingAllocation staging = allocateStaging(imageSize + 1);
+  if (implicitBatch) {
+    ASH_ASSERT(Helper::decodeImage(file.data(), file.size(), staging.mapped,
+                                   imageSize),
+               "Failed to load image from disk");
+  } else {
+    uploadBatch->decodes.push_back(ThreadPool::submit(
+        [file = std::move(file), dst = staging.mapped, imageSize, path]() {
+          bool decoded =
+              Helper::decodeImage(file.data(), file.size(), dst, imageSize);
+          if (!decoded)
+            ASH_ERROR("Failed to decode {}", path);
+          return decoded;
+        }));
+  }
 
-  vk::Buffer stagingBuffer;
-  VmaAllocation stagingBufferAllocation;
+  texture.width = static_cast<uint32_t>(texWidth);
+  texture.height = static_cast<uint32_t>(texHeight);
 
-  createBuffer(imageSize, VMA_MEMORY_USAGE_AUTO,
-               vk::BufferUsageFlagBits::eTransferSrc, stagingBuffer,
-               stagingBufferAllocation,
-               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+  createImage(texWidth, texHeight, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+              vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal,
+              textureImageUsage, texture.image, texture.imageAllocation,
+              MemoryCategory::Textures);
 
-  void *data;
-  vmaMapMemory(allocator, stagingBufferAllocation, &data);
-  std::memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vmaUnmapMemory(allocator, stagingBufferAllocation);
+  vk::PipelineStageFlags sourceStage;
+  vk::PipelineStageFlags destinationStage;
 
-  stbi_image_free(pixels);
+  vk::ImageMemoryBarrier barrier = createImageLayoutBarrier(
+      texture.image, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eUndefined,
+      vk::ImageLayout::eTransferDstOptimal, sourceStage, destinationStage);
+  uploadBatch->commandBuffer.pipelineBarrier(sourceStage, destinationStage, {},
+                                             {}, {}, barrier);
 
-  createImage(texWidth, texHeight, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-              vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal,
-              vk::ImageUsageFlagBits::eTransferDst |
-                  vk::ImageUsageFlagBits::eSampled,
-              texture.image, texture.imageAllocation);
-
-  transitionImageLayout(texture.image, vk::Format::eR8G8B8A8Srgb,
-                        vk::ImageLayout::eUndefined,
-                        vk::ImageLayout::eTransferDstOptimal);
-  copyBufferToImage(stagingBuffer, texture.image,
-                    static_cast<uint32_t>(texWidth),
+  copyBufferToImage(uploadBatch->commandBuffer, staging.buffer, staging.offset,
+                    texture.image, static_cast<uint32_t>(texWidth),
                     static_cast<uint32_t>(texHeight));
-  transitionImageLayout(texture.image, vk::Format::eR8G8B8A8Srgb,
-                        vk::ImageLayout::eTransferDstOptimal,
-                        vk::ImageLayout::eShaderReadOnlyOptimal);
 
-  vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+  // The transition to shader read is recorded once for the whole batch
+  uploadBatch->imageBarriers.push_back(createImageLayoutBarrier(
+      texture.image, vk::Format::eR8G8B8A8Srgb,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::ImageLayout::eShaderReadOnlyOptimal, sourceStage, destinationStage));
+
+  texture.uploadSerial = uploadBatch->serial;
+
+  if (implicitBatch)
+    waitForUpload(submitUploadBatch());
 
   createTextureImageView(texture);
 
@@ -1111,13 +2321,21 @@ void VulkanAPI::createSurface() {
   ASH_INFO("Created Vulkan surface");
 }
 
-void VulkanAPI::init(const std::vector<Pipeline> &pipelines) {
+void VulkanAPI::init(const std::vector<Pipeline> &pipelines,
+                     const RendererConfig &config) {
+  ASH_ASSERT(config.framesInFlight > 0, "At least one frame must be in flight");
+
+  this->config = config;
+
   createInstance();
   setupDebugMessenger();
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
   createAllocator();
+  // The ring is one long lived allocation and stays out of the staging pool
+  createStagingRing();
+  createMemoryPools();
   createSwapchain();
   createImageViews();
   createRenderPass();
@@ -1131,12 +2349,12 @@ void VulkanAPI::init(const std::vector<Pipeline> &pipelines) {
   createCommandPools();
   createDepthResources();
   createFramebuffers();
-  createCommandBuffers();
+  createFrames();
   createTextureSampler();
   createSyncObjects();
 }
 
-void VulkanAPI::updateUniformBuffers(uint32_t currentImage) {
+void VulkanAPI::updateUniformBuffers(uint32_t frame) {
   GlobalBufferObject gbo{};
   gbo.view = Renderer::getCamera().getView();
   gbo.proj =
@@ -1147,21 +2365,21 @@ void VulkanAPI::updateUniformBuffers(uint32_t currentImage) {
 
   void *data;
   vmaMapMemory(allocator,
-               globalUniformBuffers[currentImage].uniformBufferAllocation,
+               globalUniformBuffers[frame].uniformBufferAllocation,
                &data);
   std::memcpy(data, &gbo, sizeof(gbo));
   vmaUnmapMemory(allocator,
-                 globalUniformBuffers[currentImage].uniformBufferAllocation);
+                 globalUniformBuffers[frame].uniformBufferAllocation);
 
   LightBufferObject lbo{glm::vec4(1.0, 5.0, 0.0, 1.0),
                         glm::vec4(1.0, 1.0, 1.0, 1.0)};
   
   vmaMapMemory(allocator,
-               globalLightUniformBuffers[currentImage].uniformBufferAllocation,
+               globalLightUniformBuffers[frame].uniformBufferAllocation,
                &data);
   std::memcpy(data, &lbo, sizeof(lbo));
   vmaUnmapMemory(allocator,
-                 globalLightUniformBuffers[currentImage].uniformBufferAllocation);
+                 globalLightUniformBuffers[frame].uniformBufferAllocation);
 
   RenderableBufferObject ubo{};
   ubo.model = glm::rotate(glm::mat4(1.0f), 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
@@ -1175,28 +2393,58 @@ void VulkanAPI::updateUniformBuffers(uint32_t currentImage) {
 
       ubo.model = transform.getTransform();
 
+      UniformBuffer &buffer =
+          renderableResources[renderable.resources].ubos[frame];
+
       void *data;
-      vmaMapMemory(allocator,
-                   renderable.ubos[currentImage].uniformBufferAllocation,
-                   &data);
+      vmaMapMemory(allocator, buffer.uniformBufferAllocation, &data);
       std::memcpy(data, &ubo, sizeof(ubo));
-      vmaUnmapMemory(allocator,
-                     renderable.ubos[currentImage].uniformBufferAllocation);
+      vmaUnmapMemory(allocator, buffer.uniformBufferAllocation);
     }
   }
 }
 
 void VulkanAPI::render() {
-  updateCommandBuffers();
+  // Queued batches go out once their textures are decoded, ahead of the
+  // frame so it can draw what they upload
+  submitQueuedUploadBatches(false);
+  collectUploadBatches();
 
-  ASH_ASSERT(device.waitForFences(inFlightFences[currentFrame], vk::True,
-                                  UINT64_MAX) == vk::Result::eSuccess,
-             "Error while waiting for in-flight fence");
+  if (swapchainDirty)
+    recreateSwapchain();
+
+  FrameData &frame = frames[currentFrame];
+
+  // Wait until the GPU is done with the last frame that used this slot
+  vk::SemaphoreWaitInfo waitInfo({}, frameTimeline, frame.timelineValue);
+  ASH_ASSERT(device.waitSemaphores(waitInfo, UINT64_MAX) ==
+                 vk::Result::eSuccess,
+             "Error while waiting for frame timeline");
+
+  deletionQueue.flush(device.getSemaphoreCounterValue(frameTimeline));
+
+  // Lets VMA refresh its budget query once per frame
+  vmaSetCurrentFrameIndex(allocator, static_cast<uint32_t>(frameNumber));
+
+  if (config.memoryStatsLogInterval > 0) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastMemoryStatsLog >=
+        std::chrono::seconds(config.memoryStatsLogInterval)) {
+      lastMemoryStatsLog = now;
+      logMemoryStats();
+    }
+  }
 
-  auto [result, imageIndex] = device.acquireNextImageKHR(
-      swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame]);
+  updateDefragmentation();
 
-  if (result == vk::Result::eErrorOutOfDateKHR) {
+  vk::Result result;
+  uint32_t imageIndex;
+  try {
+    auto acquired = device.acquireNextImageKHR(swapchain, UINT64_MAX,
+                                               frame.imageAvailable);
+    result = acquired.result;
+    imageIndex = acquired.value;
+  } catch (vk::OutOfDateKHRError const &) {
     recreateSwapchain();
     return;
   }
@@ -1205,99 +2453,117 @@ void VulkanAPI::render() {
                  result == vk::Result::eSuboptimalKHR,
              "Failed to acquire swapchain image");
 
-  if (imagesInFlight[imageIndex] != VK_NULL_HANDLE)
-    ASH_ASSERT(device.waitForFences(imagesInFlight[imageIndex], vk::True,
-                                    UINT64_MAX) == vk::Result::eSuccess,
-               "Error while waiting for images-in-flight fence");
+  device.resetCommandPool(frame.commandPool);
+  recordCommandBuffer(frame.commandBuffer, imageIndex);
 
-  imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+  updateUniformBuffers(currentFrame);
 
-  updateUniformBuffers(imageIndex);
+  frame.timelineValue = ++frameNumber;
+
+  vk::Semaphore signalSemaphores[] = {renderFinishedSemaphores[imageIndex],
+                                      frameTimeline};
+  // The binary semaphore ignores its value
+  uint64_t signalValues[] = {0, frame.timelineValue};
+
+  vk::TimelineSemaphoreSubmitInfo timelineSubmitInfo;
+  timelineSubmitInfo.setSignalSemaphoreValues(signalValues);
 
   vk::PipelineStageFlags waitStages[] = {
       vk::PipelineStageFlagBits::eColorAttachmentOutput};
-  vk::SubmitInfo submitInfo(imageAvailableSemaphores[currentFrame], waitStages,
-                            commandBuffers[imageIndex],
-                            renderFinishedSemaphores[currentFrame]);
-
-  device.resetFences(inFlightFences[currentFrame]);
+  vk::SubmitInfo submitInfo(frame.imageAvailable, waitStages,
+                            frame.commandBuffer, signalSemaphores,
+                            &timelineSubmitInfo);
 
-  graphicsQueue.submit(submitInfo, inFlightFences[currentFrame]);
+  graphicsQueue.submit(submitInfo);
 
-  vk::PresentInfoKHR presentInfo(renderFinishedSemaphores[currentFrame],
+  vk::PresentInfoKHR presentInfo(renderFinishedSemaphores[imageIndex],
                                  swapchain, imageIndex);
 
+  bool outOfDate = false;
   try {
     result = presentQueue.presentKHR(presentInfo);
-  } catch (std::exception const &e) {
-    if (result == vk::Result::eErrorOutOfDateKHR ||
-        result == vk::Result::eSuboptimalKHR ||
-        App::getWindow()->framebufferResized) {
-      App::getWindow()->framebufferResized = false;
-      recreateSwapchain();
-    }
+  } catch (vk::OutOfDateKHRError const &) {
+    outOfDate = true;
+  }
+
+  if (outOfDate || result == vk::Result::eSuboptimalKHR ||
+      App::getWindow()->framebufferResized) {
+    App::getWindow()->framebufferResized = false;
+    swapchainDirty = true;
   }
 
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % frames.size();
 }
 
 void VulkanAPI::cleanup() {
+  if (uploadBatch)
+    queueUploadBatch();
+  submitQueuedUploadBatches(true);
+
   device.waitIdle();
 
+  collectUploadBatches();
+  finishDefragmentation();
+  deletionQueue.flushAll();
+
   ASH_INFO("Cleaning up graphics API");
 
+  savePipelineCache();
   device.destroyPipelineCache(pipelineCache);
 
   cleanupSwapchain();
+  device.destroyRenderPass(renderPass);
 
   device.destroySampler(textureSampler);
 
   for (auto texture : textures) {
     device.destroyImageView(texture.imageView);
-    vmaDestroyImage(allocator, texture.image, texture.imageAllocation);
+    destroyImage(texture.image, texture.imageAllocation);
   }
 
   for (auto pipeline : graphicsPipelines)
-    device.destroyPipeline(pipeline.second);
+    device.destroyPipeline(pipeline);
 
   device.destroyPipelineLayout(pipelineLayout);
 
-  std::shared_ptr<Scene> scene = Renderer::getScene();
-  if (scene) {
-    auto renderables = scene->registry.view<Renderable>();
-    for (auto entity : renderables) {
-      auto &renderable = renderables.get<Renderable>(entity);
-      for (auto buffer : renderable.ubos) {
-        vmaDestroyBuffer(allocator, buffer.uniformBuffer,
-                         buffer.uniformBufferAllocation);
-      }
-    }
-  }
+  for (const RenderableResources &resources : renderableResources)
+    for (auto buffer : resources.ubos)
+      destroyBuffer(buffer.uniformBuffer, buffer.uniformBufferAllocation);
 
   for (auto buffer : globalUniformBuffers)
-    vmaDestroyBuffer(allocator, buffer.uniformBuffer,
-                     buffer.uniformBufferAllocation);
+    destroyBuffer(buffer.uniformBuffer, buffer.uniformBufferAllocation);
 
   for (auto buffer : globalLightUniformBuffers)
-    vmaDestroyBuffer(allocator, buffer.uniformBuffer,
-                     buffer.uniformBufferAllocation);
+    destroyBuffer(buffer.uniformBuffer, buffer.uniformBufferAllocation);
 
   descriptorLayoutCache.cleanup();
   descriptorAllocator.cleanup();
 
   for (IndexedVertexBuffer ivb : indexedVertexBuffers) {
-    vmaDestroyBuffer(allocator, ivb.buffer, ivb.bufferAllocation);
+    destroyBuffer(ivb.buffer, ivb.bufferAllocation);
   }
 
+  destroyBuffer(stagingRingBuffer, stagingRingAllocation);
+
+  for (const MemoryPool &pool : memoryPools)
+    if (pool.pool)
+      vmaDestroyPool(allocator, pool.pool);
+
+  for (size_t i = 0; i < categoryStats.size(); i++)
+    if (categoryStats[i].allocationCount > 0)
+      ASH_WARN("Leaked {} {} allocations ({} bytes)",
+               categoryStats[i].allocationCount,
+               getMemoryCategoryName(static_cast<MemoryCategory>(i)),
+               categoryStats[i].allocationBytes);
+
   vmaDestroyAllocator(allocator);
 
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    device.destroySemaphore(imageAvailableSemaphores[i]);
-    device.destroySemaphore(renderFinishedSemaphores[i]);
-    device.destroyFence(inFlightFences[i]);
+  for (FrameData &frame : frames) {
+    device.destroySemaphore(frame.imageAvailable);
+    device.destroyCommandPool(frame.commandPool);
   }
 
-  device.destroyFence(copyFinishedFence);
+  device.destroySemaphore(frameTimeline);
 
   device.destroyCommandPool(commandPool);
   device.destroyCommandPool(transferCommandPool);
@@ -1315,12 +2581,6 @@ void VulkanAPI::cleanup() {
   instance.destroy();
 }
 
-void VulkanAPI::updateCommandBuffers() {
-  graphicsQueue.waitIdle();
-  device.resetCommandPool(commandPool);
-  recordCommandBuffers();
-}
-
 vk::Format
 VulkanAPI::findSupportedFormat(const std::vector<vk::Format> &candidates,
                                vk::ImageTiling tiling,
@@ -1360,7 +2620,7 @@ void VulkanAPI::createDepthResources() {
               VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, depthFormat,
               vk::ImageTiling::eOptimal,
               vk::ImageUsageFlagBits::eDepthStencilAttachment, depthImage,
-              depthImageAllocation);
+              depthImageAllocation, MemoryCategory::Attachments);
   depthImageView =
       createImageView(depthImage, depthFormat, vk::ImageAspectFlagBits::eDepth);
 
@@ -1379,44 +2639,128 @@ void VulkanAPI::setClearColor(const glm::vec4 &color) { clearColor = color; }
 IndexedVertexBuffer
 VulkanAPI::createIndexedVertexArray(const std::vector<Vertex> &verts,
                                     const std::vector<uint32_t> &indices) {
-  IndexedVertexBuffer ret{};
-  ret.numIndices = indices.size();
+  return createIndexedVertexArray(verts.data(), sizeof(Vertex) * verts.size(),
+                                  indices.data(),
+                                  static_cast<uint32_t>(indices.size()));
+}
 
-  vk::DeviceSize vertSize = sizeof(verts[0]) * verts.size();
+IndexedVertexBuffer VulkanAPI::createIndexedVertexArray(
+    const void *vertices, vk::DeviceSize vertSize, const uint32_t *indices,
+    uint32_t indexCount) {
+  IndexedVertexBuffer ret{};
+  ret.numIndices = indexCount;
   ret.vertSize = vertSize;
 
-  vk::DeviceSize indicesSize = sizeof(indices[0]) * indices.size();
+  vk::DeviceSize indicesSize = sizeof(uint32_t) * indexCount;
   vk::DeviceSize bufferSize = vertSize + indicesSize;
 
-  vk::Buffer stagingBuffer;
-  VmaAllocation stagingBufferAllocation;
-  createBuffer(bufferSize, VMA_MEMORY_USAGE_AUTO,
-               vk::BufferUsageFlagBits::eTransferSrc, stagingBuffer,
-               stagingBufferAllocation,
-               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+  vk::BufferUsageFlags usage = geometryBufferUsage;
+
+  // Let VMA place the buffer in host visible device memory while that is
+  // within budget, otherwise it lands in plain device memory and is staged
+  VmaAllocationInfo allocationInfo{};
+  bool allocated =
+      hostVisibleDeviceMemory &&
+      tryCreateBuffer(
+          bufferSize, VMA_MEMORY_USAGE_AUTO, usage, ret.buffer,
+          ret.bufferAllocation, MemoryCategory::Geometry,
+          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+              VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+              VMA_ALLOCATION_CREATE_MAPPED_BIT |
+              VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT,
+          &allocationInfo);
+
+  if (!allocated)
+    createBuffer(bufferSize, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, usage,
+                 ret.buffer, ret.bufferAllocation, MemoryCategory::Geometry);
+
+  if (allocated && isHostVisible(ret.bufferAllocation)) {
+    std::memcpy(allocationInfo.pMappedData, vertices,
+                static_cast<size_t>(vertSize));
+    std::memcpy(static_cast<char *>(allocationInfo.pMappedData) + vertSize,
+                indices, static_cast<size_t>(indicesSize));
+    vmaFlushAllocation(allocator, ret.bufferAllocation, 0, VK_WHOLE_SIZE);
+
+    indexedVertexBuffers.push_back(ret);
+
+    return ret;
+  }
+
+  bool implicitBatch = !uploadBatch;
+  if (implicitBatch)
+    beginUploadBatch();
 
-  void *data;
-  vmaMapMemory(allocator, stagingBufferAllocation, &data);
-  std::memcpy(data, verts.data(), static_cast<size_t>(vertSize));
-  std::memcpy(static_cast<Vertex *>(data) + verts.size(), indices.data(),
+  StagingAllocation staging = allocateStaging(bufferSize);
+  std::memcpy(staging.mapped, vertices, static_cast<size_t>(vertSize));
+  std::memcpy(static_cast<char *>(staging.mapped) + vertSize, indices,
               static_cast<size_t>(indicesSize));
-  vmaUnmapMemory(allocator, stagingBufferAllocation);
 
-  createBuffer(bufferSize, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-               vk::BufferUsageFlagBits::eTransferDst |
-                   vk::BufferUsageFlagBits::eVertexBuffer |
-                   vk::BufferUsageFlagBits::eIndexBuffer,
-               ret.buffer, ret.bufferAllocation);
+  copyBuffer(uploadBatch->commandBuffer, staging.buffer, staging.offset,
+             ret.buffer, 0, bufferSize);
 
-  copyBuffer(stagingBuffer, ret.buffer, bufferSize);
+  ret.uploadSerial = uploadBatch->serial;
+  ret.staged = static_cast<const char *>(staging.mapped);
 
-  vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+  if (implicitBatch)
+    waitForUpload(submitUploadBatch());
 
   indexedVertexBuffers.push_back(ret);
 
   return ret;
 }
 
+bool VulkanAPI::matchesIndexedVertexArray(const IndexedVertexBuffer &ivb,
+                                          const void *vertices,
+                                          vk::DeviceSize vertSize,
+                                          const uint32_t *indices,
+                                          uint32_t indexCount) {
+  if (ivb.vertSize != vertSize || ivb.numIndices != indexCount)
+    return false;
+
+  vk::DeviceSize indicesSize = sizeof(uint32_t) * indexCount;
+  auto matches = [&](const void *data) {
+    const char *bytes = static_cast<const char *>(data);
+    return std::memcmp(bytes, vertices, static_cast<size_t>(vertSize)) == 0 &&
+           std::memcmp(bytes + vertSize, indices,
+                       static_cast<size_t>(indicesSize)) == 0;
+  };
+
+  if (ivb.staged && !isUploadComplete(ivb.uploadSerial))
+    return matches(ivb.staged);
+
+  if (isHostVisible(ivb.bufferAllocation)) {
+    void *mapped;
+    if (vmaMapMemory(allocator, ivb.bufferAllocation, &mapped) != VK_SUCCESS)
+      return false;
+
+    vmaInvalidateAllocation(allocator, ivb.bufferAllocation, 0, VK_WHOLE_SIZE);
+    bool same = matches(mapped);
+    vmaUnmapMemory(allocator, ivb.bufferAllocation);
+    return same;
+  }
+
+  // Stalls the graphics queue, but only runs once the content hashes match
+  vk::Buffer readback;
+  VmaAllocation readbackAllocation;
+  VmaAllocationInfo allocationInfo;
+  createBuffer(vertSize + indicesSize, VMA_MEMORY_USAGE_AUTO,
+               vk::BufferUsageFlagBits::eTransferDst, readback,
+               readbackAllocation, MemoryCategory::Staging,
+               VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                   VMA_ALLOCATION_CREATE_MAPPED_BIT,
+               &allocationInfo);
+
+  vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+  copyBuffer(commandBuffer, ivb.buffer, 0, readback, 0,
+             vertSize + indicesSize);
+  endSingleTimeCommands(commandBuffer);
+
+  vmaInvalidateAllocation(allocator, readbackAllocation, 0, VK_WHOLE_SIZE);
+  bool same = matches(allocationInfo.pMappedData);
+  destroyBuffer(readback, readbackAllocation);
+  return same;
+}
+
 /*
  *
  *      Renderer API
@@ -7,15 +7,22 @@
 
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <deque>
+#include <future>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "Core.h"
+#include "DeletionQueue.h"
 #include "Descriptor.h"
 #include "Helper.h"
+#include "MemoryStats.h"
 #include "Pipeline.h"
+#include "RendererConfig.h"
+#include "StagingRing.h"
 
 #define VULKAN_VERSION VK_API_VERSION_1_3
 
@@ -28,23 +35,80 @@ public:
   VulkanAPI();
   ~VulkanAPI();
 
-  void init(const std::vector<Pipeline> &pipelines);
+  void init(const std::vector<Pipeline> &pipelines,
+            const RendererConfig &config);
   void render();
   void cleanup();
 
   void setClearColor(const glm::vec4 &color);
 
+  // Takes effect by recreating the swapchain at the start of the next frame
+  void setVSync(bool vsync);
+
   IndexedVertexBuffer
   createIndexedVertexArray(const std::vector<Vertex> &verts,
                            const std::vector<uint32_t> &indices);
-  void createRenderableDescriptorSets(std::vector<vk::DescriptorSet> &sets,
-                                      const std::vector<UniformBuffer> &ubo,
-                                      Material &material);
+  IndexedVertexBuffer createIndexedVertexArray(const void *vertices,
+                                               vk::DeviceSize vertSize,
+                                               const uint32_t *indices,
+                                               uint32_t indexCount);
+  // Compares a buffer's contents with data. In flight uploads are read from
+  // staging and host visible buffers through a mapping, anything else is
+  // copied back and waited for
+  bool matchesIndexedVertexArray(const IndexedVertexBuffer &ivb,
+                                 const void *vertices, vk::DeviceSize vertSize,
+                                 const uint32_t *indices, uint32_t indexCount);
+  // Sets of released materials are rewritten for new ones before the
+  // descriptor pools are asked for more
+  void createMaterialDescriptorSets(Material &material);
+  void releaseMaterialDescriptorSets(std::vector<vk::DescriptorSet> sets);
   void createUniformBuffers(std::vector<UniformBuffer> &ubos,
                             vk::DeviceSize bufferSize);
   void createTextureImage(const std::string &path, Texture &texture);
+  // Uploads an image file that's already mapped, path is only for messages
+  void createTextureImage(MappedFile file, const std::string &path,
+                          Texture &texture);
   void createTextureImageView(Texture &texture);
 
+  // Per-object uniform buffers and descriptor sets come from a free list,
+  // released slots are reused once the frames in flight retire
+  uint32_t acquireRenderableResources();
+  void releaseRenderableResources(uint32_t index);
+
+  // Freed once every frame submitted so far has completed on the device
+  void destroyIndexedVertexArray(const IndexedVertexBuffer &ivb);
+  void destroyTexture(const Texture &texture);
+
+  vk::DeviceSize getAllocationSize(VmaAllocation allocation);
+
+  // Frames are numbered from 1 in submission order
+  inline uint64_t getFrameNumber() const { return frameNumber; }
+  uint64_t getCompletedFrameNumber();
+
+  // Pipeline variants are numbered consecutively, the ID of a variant is the
+  // ID of its pipeline plus the variant index
+  uint32_t getPipelineID(const std::string &name, uint32_t variant = 0);
+  const Pipeline &getPipeline(const std::string &name);
+
+  // While a batch is open, uploads are packed into the staging ring and
+  // recorded into a single command buffer. Submitting returns a serial that
+  // can be polled or waited on, staging memory is reclaimed once it completes.
+  // Queuing closes the batch without waiting for its texture decodes, it is
+  // submitted by a later frame once they are done. Submitting directly waits
+  // for everything queued before it
+  void beginUploadBatch();
+  uint64_t submitUploadBatch();
+  uint64_t queueUploadBatch();
+  bool isUploadComplete(uint64_t serial);
+  void waitForUpload(uint64_t serial);
+
+  // Per heap usage and budget from VMA plus totals for each allocation
+  // category. The JSON is VMA's own stats string, the detailed map lists
+  // every allocation with its category as the name
+  MemoryStats getMemoryStats();
+  void logMemoryStats();
+  std::string buildMemoryStatsJson(bool detailedMap = false);
+
   DescriptorLayoutCache descriptorLayoutCache;
   DescriptorAllocator descriptorAllocator;
 
@@ -64,6 +128,77 @@ private:
     std::vector<vk::PresentModeKHR> presentModes;
   };
 
+  // Everything a frame in flight records into or writes, reused once the
+  // frame timeline reaches the value it signals
+  struct FrameData {
+    vk::CommandPool commandPool;
+    vk::CommandBuffer commandBuffer;
+    vk::Semaphore imageAvailable;
+    uint64_t timelineValue = 0;
+  };
+
+  // One UBO and descriptor set per frame in flight for a renderable
+  struct RenderableResources {
+    std::vector<UniformBuffer> ubos;
+    std::vector<vk::DescriptorSet> sets;
+  };
+
+  // A resource being relocated by a defragmentation pass. Old handles stay
+  // valid until no frame in flight can reference them
+  struct DefragmentationMove {
+    VmaAllocation allocation;
+    MemoryCategory category;
+    uint32_t passIndex;
+
+    // The owner was unloaded mid-pass, VMA frees the allocation instead
+    bool released = false;
+
+    vk::Buffer oldBuffer;
+    vk::Buffer newBuffer;
+
+    vk::Image oldImage;
+    vk::Image newImage;
+    vk::ImageView oldImageView;
+    vk::ImageView newImageView;
+  };
+
+  // Copying waits for the copies of a pass, Patching rewrites the material
+  // descriptor sets of each frame slot as it comes up and Retiring waits for
+  // frames that used the old copies before the pass is ended
+  enum class DefragmentationState { Idle, Copying, Patching, Retiring };
+
+  struct Defragmentation {
+    VmaDefragmentationContext context = VK_NULL_HANDLE;
+    MemoryCategory category = MemoryCategory::Geometry;
+    DefragmentationState state = DefragmentationState::Idle;
+
+    VmaDefragmentationPassMoveInfo pass{};
+    std::vector<DefragmentationMove> moves;
+    uint64_t uploadSerial = 0;
+    uint64_t retireFrame = 0;
+    std::vector<bool> patchedFrames;
+
+    VmaDefragmentationStats stats{};
+    std::chrono::steady_clock::time_point lastCheck;
+  };
+
+  struct DedicatedStaging {
+    vk::Buffer buffer;
+    VmaAllocation allocation;
+  };
+
+  struct UploadBatch {
+    uint64_t serial;
+    vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
+    std::vector<DedicatedStaging> dedicatedStaging;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+
+    // Textures decode on the thread pool straight into their staging memory,
+    // the batch is submitted once they are done
+    std::vector<std::future<bool>> decodes;
+  };
+
   vk::CommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(vk::CommandBuffer commandBuffer);
   bool checkValidationSupport();
@@ -78,17 +213,25 @@ private:
   void createRenderPass();
   void createDescriptorSetLayouts();
   void createPipelineCache();
+  void savePipelineCache();
   void createGlobalDescriptorSets();
   void createGraphicsPipelines(const std::vector<Pipeline> &pipelines);
+  vk::Pipeline
+  createPipelineVariant(const Pipeline &pipeline,
+                        const std::vector<vk::ShaderModule> &shaderModules,
+                        uint32_t variant,
+                        vk::GraphicsPipelineCreateInfo pipelineInfo);
   void createFramebuffers();
   void createDescriptorAllocator();
   void createCommandPools();
-  void createCommandBuffers();
-  void recordCommandBuffers();
+  void createFrames();
+  void createRenderFinishedSemaphores();
+  void recordCommandBuffer(vk::CommandBuffer commandBuffer,
+                           uint32_t imageIndex);
   void createSyncObjects();
   void cleanupSwapchain();
   void recreateSwapchain();
-  void updateCommandBuffers();
+  void retireSwapchainResources();
   vk::Format findSupportedFormat(const std::vector<vk::Format> &candidates,
                                  vk::ImageTiling tiling,
                                  vk::FormatFeatureFlags features);
@@ -97,23 +240,60 @@ private:
   void createDepthResources();
   void createBuffer(vk::DeviceSize size, VmaMemoryUsage memUsage,
                     vk::BufferUsageFlags usage, vk::Buffer &buffer,
-                    VmaAllocation &allocation,
-                    VmaAllocationCreateFlags flags = 0);
+                    VmaAllocation &allocation, MemoryCategory category,
+                    VmaAllocationCreateFlags flags = 0,
+                    VmaAllocationInfo *allocationInfo = nullptr);
+  bool tryCreateBuffer(vk::DeviceSize size, VmaMemoryUsage memUsage,
+                       vk::BufferUsageFlags usage, vk::Buffer &buffer,
+                       VmaAllocation &allocation, MemoryCategory category,
+                       VmaAllocationCreateFlags flags,
+                       VmaAllocationInfo *allocationInfo);
+  bool isHostVisible(VmaAllocation allocation);
   void createImage(uint32_t width, uint32_t height, VmaMemoryUsage memUsage,
                    vk::Format format, vk::ImageTiling tiling,
                    vk::ImageUsageFlags usage, vk::Image &image,
-                   VmaAllocation &allocation);
+                   VmaAllocation &allocation, MemoryCategory category);
+  void createMemoryPools();
+  VmaPool createMemoryPool(uint32_t memoryTypeIndex, vk::DeviceSize blockSize,
+                           size_t maxBlockCount,
+                           VmaPoolCreateFlags flags);
+  VmaPool getMemoryPool(MemoryCategory category,
+                        VmaAllocationCreateFlags flags);
+  void startDefragmentation();
+  void updateDefragmentation();
+  bool beginDefragmentationPass();
+  void swapDefragmentedResources();
+  void patchDefragmentedDescriptors(uint32_t frame);
+  void endDefragmentationPass();
+  void finishDefragmentation();
+  void trackAllocation(VmaAllocation allocation, MemoryCategory category,
+                       uint64_t nanoseconds);
+  void untrackAllocation(VmaAllocation allocation);
+  void destroyBuffer(vk::Buffer buffer, VmaAllocation allocation);
+  void destroyImage(vk::Image image, VmaAllocation allocation);
+  bool releaseDefragmentedAllocation(VmaAllocation allocation);
   vk::ImageView createImageView(vk::Image image, vk::Format format,
                                 vk::ImageAspectFlags aspectFlags);
-  void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                  vk::DeviceSize size);
-  void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width,
-                         uint32_t height);
-  void updateUniformBuffers(uint32_t currentImage);
+  void copyBuffer(vk::CommandBuffer commandBuffer, vk::Buffer srcBuffer,
+                  vk::DeviceSize srcOffset, vk::Buffer dstBuffer,
+                  vk::DeviceSize dstOffset, vk::DeviceSize size);
+  void copyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer,
+                         vk::DeviceSize bufferOffset, vk::Image image,
+                         uint32_t width, uint32_t height);
+  void updateUniformBuffers(uint32_t frame);
   void createTextureSampler();
+  vk::ImageMemoryBarrier
+  createImageLayoutBarrier(vk::Image image, vk::Format format,
+                           vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                           vk::PipelineStageFlags &sourceStage,
+                           vk::PipelineStageFlags &destinationStage);
   void transitionImageLayout(vk::Image image, vk::Format format,
                              vk::ImageLayout oldLayout,
                              vk::ImageLayout newLayout);
+  void createStagingRing();
+  StagingAllocation allocateStaging(vk::DeviceSize size);
+  void submitQueuedUploadBatches(bool wait);
+  void collectUploadBatches();
 
   SwapchainSupportDetails querySwapchainSupport(vk::PhysicalDevice device);
   vk::SurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -125,8 +305,9 @@ private:
   bool isDeviceSuitable(vk::PhysicalDevice device);
   QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice device);
   bool checkDeviceExtensionSupport(vk::PhysicalDevice device);
+  bool hasDeviceExtension(vk::PhysicalDevice device, const char *extension);
 
-  vk::ShaderModule createShaderModule(const std::vector<char> &code);
+  vk::ShaderModule createShaderModule(const MappedFile &code);
 
   uint32_t findMemoryType(uint32_t typeFilter,
                           vk::MemoryPropertyFlags properties);
@@ -165,30 +346,79 @@ private:
   vk::PipelineLayout pipelineLayout;
 
   vk::PipelineCache pipelineCache;
-  std::unordered_map<std::string, vk::Pipeline> graphicsPipelines;
+  std::vector<vk::Pipeline> graphicsPipelines;
   std::vector<Pipeline> pipelineObjects;
+  std::unordered_map<std::string, uint32_t> pipelineIndices;
+  std::vector<uint32_t> pipelineBaseIDs;
 
   vk::Sampler textureSampler;
 
   vk::CommandPool commandPool;
   vk::CommandPool transferCommandPool;
-  std::vector<vk::CommandBuffer> commandBuffers;
 
-  std::vector<vk::Semaphore> imageAvailableSemaphores;
+  std::vector<FrameData> frames;
+
+  // Signalled with the frame number when each frame's work completes
+  vk::Semaphore frameTimeline;
+
+  // Presentation only takes binary semaphores, one per swapchain image so a
+  // semaphore is never re-signalled while a present still waits on it
   std::vector<vk::Semaphore> renderFinishedSemaphores;
-  std::vector<vk::Fence> inFlightFences;
-  std::vector<vk::Fence> imagesInFlight;
-  vk::Fence copyFinishedFence;
 
   VmaAllocator allocator;
 
+  // Set when the device exposes memory that is both device local and host
+  // visible (resizable BAR, integrated and software devices), geometry is
+  // then written in place instead of going through staging
+  bool hostVisibleDeviceMemory = false;
+
+  // VK_EXT_memory_budget is optional, VMA estimates budgets without it
+  bool memoryBudgetSupported = false;
+
+  std::array<CategoryMemoryStats, static_cast<size_t>(MemoryCategory::Count)>
+      categoryStats{};
+
+  // One pool per category, null where the category uses default placement
+  struct MemoryPool {
+    VmaPool pool = VK_NULL_HANDLE;
+    bool hostVisible = false;
+  };
+  std::array<MemoryPool, static_cast<size_t>(MemoryCategory::Count)>
+      memoryPools{};
+
+  Defragmentation defragmentation;
+  std::chrono::steady_clock::time_point lastMemoryStatsLog;
+
   // Keeps track of all allocations in order to be freed
   // at end of runtime
   std::vector<IndexedVertexBuffer> indexedVertexBuffers;
+  std::vector<RenderableResources> renderableResources;
+  std::vector<uint32_t> freeRenderableResources;
+  // One set per frame in flight each
+  std::vector<std::vector<vk::DescriptorSet>> freeMaterialSets;
   std::vector<Texture> textures;
 
+  RendererConfig config;
+
+  StagingRing stagingRing;
+  vk::Buffer stagingRingBuffer;
+  VmaAllocation stagingRingAllocation;
+
+  std::optional<UploadBatch> uploadBatch;
+  std::deque<UploadBatch> queuedUploadBatches;
+  std::vector<UploadBatch> pendingUploadBatches;
+  uint64_t nextUploadSerial = 1;
+  uint64_t completedUploadSerial = 0;
+
   size_t currentFrame = 0;
 
+  // Frames submitted so far, retired resources are tagged with the frame
+  // number they were last used in and freed once frameTimeline reaches it
+  uint64_t frameNumber = 0;
+  DeletionQueue deletionQueue;
+
+  bool swapchainDirty = false;
+
   glm::vec4 clearColor{0.0f, 0.0f, 0.0f, 1.0f};
 
   const std::vector<const char *> validationLayers = {
@@ -197,8 +427,6 @@ private:
   const std::vector<const char *> deviceExtensions = {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-  const size_t MAX_FRAMES_IN_FLIGHT = 2;
-
 #ifndef ASH_DEBUG
   const bool enableValidationLayers = false;
 #else
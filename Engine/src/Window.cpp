@@ -2,6 +2,7 @@
 
 #include "Core.h"
 #include "GLFW/glfw3.h"
+#include "MainThread.h"
 
 namespace Ash {
 
@@ -14,13 +15,23 @@ static void framebufferResizeCallback(GLFWwindow *window, int width,
 static void mouse_cursor_callback(GLFWwindow *window, double xpos,
                                   double ypos) {}
 
+// GLFW only allows most of its calls on the main thread, jobs go through
+// MainThread::post instead
+static inline void assertMainThread() {
+  ASH_ASSERT(MainThread::isCurrent(), "GLFW called off the main thread");
+}
+
 Window::Window() {}
 
 Window::~Window() {}
 
-void Window::init() { ASH_ASSERT(glfwInit(), "Failed to initialize GLFW"); }
+void Window::init() {
+  assertMainThread();
+  ASH_ASSERT(glfwInit(), "Failed to initialize GLFW");
+}
 
 void Window::cleanup() {
+  assertMainThread();
   ASH_INFO("Terminating GLFW");
   glfwTerminate();
 }
@@ -29,44 +40,55 @@ bool Window::shouldClose() const { return glfwWindowShouldClose(window); }
 
 void Window::swapBuffers() const { glfwSwapBuffers(window); }
 
-void Window::pollEvents() const { glfwPollEvents(); }
+void Window::pollEvents() const {
+  assertMainThread();
+  glfwPollEvents();
+}
 
 GLFWwindow *Window::get() const { return window; }
 
 std::pair<int, int> Window::getWindowSize() const {
+  assertMainThread();
   std::pair<int, int> pos;
   glfwGetWindowSize(window, &pos.first, &pos.second);
   return pos;
 }
 
 std::pair<double, double> Window::getCursorPos() const {
+  assertMainThread();
   std::pair<double, double> pos;
   glfwGetCursorPos(window, &pos.first, &pos.second);
   return pos;
 }
 
 EventStatus Window::getMouseButton(MouseButton button) const {
+  assertMainThread();
   return EventStatus(glfwGetMouseButton(window, button));
 }
 
 EventStatus Window::getKey(Key key) const {
+  assertMainThread();
   return EventStatus(glfwGetKey(window, key));
 }
 
 void Window::setCursorPos(double x, double y) const {
+  assertMainThread();
   glfwSetCursorPos(window, x, y);
 }
 
 void Window::disableCursor() const {
+  assertMainThread();
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
 void Window::enableCursor() const {
+  assertMainThread();
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 }
 
 
 std::shared_ptr<Window> Window::create(const WindowProperties &properties) {
+  assertMainThread();
   std::shared_ptr<Window> ret = std::make_shared<Window>();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   ret->window = glfwCreateWindow(properties.width, properties.height,
@@ -79,6 +101,7 @@ std::shared_ptr<Window> Window::create(const WindowProperties &properties) {
 }
 
 void Window::destroy() {
+  assertMainThread();
   ASH_INFO("Destroying window...");
   glfwDestroyWindow(window);
 }
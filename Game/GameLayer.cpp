@@ -29,15 +29,68 @@ float speed = 0.01;
 
 std::pair<int, int> last_mouse_pos{};
 
-void GameLayer::init() {
-  scene = std::make_shared<Scene>();
+// Kept so the load outlives init, frames render while it's in flight
+Task<> sceneLoad;
+
+static Task<> loadScene() {
+  // Built by the cook target, importing the glTF is the slow fallback
+  ModelHandle model = co_await Helper::loadAssetPackAsync(
+      "bp", "assets/models/sponza/NewSponza_Main_glTF_002.ashpack");
+  if (!model.isValid())
+    model = co_await Helper::importModelAsync(
+        "bp", "assets/models/sponza/NewSponza_Main_glTF_002.gltf");
 
-  Helper::importModel("bp", "assets/models/sponza/NewSponza_Main_glTF_002.gltf");
+  if (!model.isValid())
+    co_return;
+
+  // The scene is only changed directly on the main thread
+  co_await MainThread::schedule();
 
   Entity e = scene->spawn();
-  scene->addComponent<Renderable>(e, "bp", "main");
+  scene->addComponent<Renderable>(e, model, Renderer::findPipeline("main"));
   Transform transform{{0, 0, 0}};
   scene->addComponent<Transform>(e, transform);
+}
+
+void GameLayer::init() {
+  scene = std::make_shared<Scene>();
+
+  sceneLoad = loadScene();
+
+  // Spin and Bob advance in parallel, each feeds Transform afterwards
+  scene->addSystem<Read<>, Write<Spin>>("spin", [](Scene &scene) {
+    scene.parallelEach<Spin>([](entt::entity, Spin &spin) {
+      spin.rotation += 1e-3 * Ash::getFrameTime();
+    });
+  });
+
+  scene->addSystem<Read<>, Write<Bob>>("bob", [](Scene &scene) {
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    float time = std::chrono::duration<float, std::chrono::seconds::period>(
+                     currentTime - startTime)
+                     .count();
+
+    scene.parallelEach<Bob>(
+        [&](entt::entity, Bob &bob) { bob.height = glm::sin(time); });
+  });
+
+  scene->addSystem<Read<Spin>, Write<Transform>>(
+      "spin-transform", [](Scene &scene) {
+        scene.parallelEach<Spin, Transform>(
+            [](entt::entity, Spin &spin, Transform &transform) {
+              transform.rotation.y = spin.rotation;
+            });
+      });
+
+  scene->addSystem<Read<Bob>, Write<Transform>>(
+      "bob-transform", [](Scene &scene) {
+        scene.parallelEach<Bob, Transform>(
+            [](entt::entity, Bob &bob, Transform &transform) {
+              transform.position.z = bob.height;
+            });
+      });
 
   Renderer::setScene(scene);
 
@@ -47,13 +100,6 @@ void GameLayer::init() {
 }
 
 void GameLayer::onUpdate() {
-  static auto startTime = std::chrono::high_resolution_clock::now();
-
-  auto currentTime = std::chrono::high_resolution_clock::now();
-  float time = std::chrono::duration<float, std::chrono::seconds::period>(
-                   currentTime - startTime)
-                   .count();
-
   auto curr_mouse_pos = App::getWindow()->getCursorPos();
   std::pair<int, int> mouse_pos_delta = {
       curr_mouse_pos.first - last_mouse_pos.first,
@@ -70,30 +116,6 @@ void GameLayer::onUpdate() {
   dir.y = sin(glm::radians(pitch));
   dir.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
 
-  auto spinView = scene->registry.view<Spin>();
-  for (auto e : spinView) {
-    auto &spin = spinView.get<Spin>(e);
-    spin.rotation += 1e-3 * Ash::getFrameTime();
-  }
-
-  auto bobView = scene->registry.view<Bob>();
-  for (auto e : bobView) {
-    auto &bob = bobView.get<Bob>(e);
-    bob.height = glm::sin(time);
-  }
-
-  auto v = scene->registry.view<Spin, Transform>();
-  for (auto e : v) {
-    auto [spin, transform] = v.get<Spin, Transform>(e);
-    transform.rotation.y = spin.rotation;
-  }
-
-  auto bobTransform = scene->registry.view<Bob, Transform>();
-  for (auto e : bobTransform) {
-    auto [bob, transform] = bobTransform.get<Bob, Transform>(e);
-    transform.position.z = bob.height;
-  }
-
   glm::vec3 forward = dir;
   forward.y = 0;
   forward = glm::normalize(forward);
@@ -0,0 +1,139 @@
+#include <AssetPack.h>
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+namespace {
+
+ImportedModel makeModel() {
+  ImportedModel model;
+  model.materials = {"wood.png", "", "wood.png", "stone.png"};
+
+  for (uint32_t material : {2u, 1u}) {
+    ImportedMesh &mesh = model.meshes.emplace_back();
+    mesh.material = material;
+    for (float x : {0.0f, 1.0f, 2.0f}) {
+      Vertex &vertex = mesh.vertices.emplace_back();
+      vertex.pos = glm::vec3(x, material, 0.0f);
+      vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+      vertex.texCoord = glm::vec2(x, 0.5f);
+    }
+    mesh.indices = {0, 1, 2, 2, 1, 0};
+    mesh.boundsMin = glm::vec3(0.0f, material, 0.0f);
+    mesh.boundsMax = glm::vec3(2.0f, material, 0.0f);
+  }
+
+  // The first blob doesn't end on the alignment, the second is padded
+  model.meshes[1].vertices.pop_back();
+  model.meshes[1].indices = {0, 1, 0};
+  return model;
+}
+
+std::string readFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+} // namespace
+
+ASH_TEST(AssetPack, RoundTripsModel) {
+  ImportedModel model = makeModel();
+  std::string path = Test::getTempPath("model.ashpack");
+  ASH_CHECK(writeAssetPack(path, model, 0x1234,
+                           {{"model.obj", 1}, {"model.mtl", 2}}));
+
+  AssetPack pack;
+  ASH_CHECK(pack.open(path));
+
+  const AssetPackHeader &header = pack.getHeader();
+  ASH_CHECK(header.sourceHash == 0x1234);
+  ASH_CHECK(header.meshCount == 2);
+
+  // Shared textures are stored once
+  ASH_CHECK(pack.getTextures().size() == 2);
+  ASH_CHECK(pack.getMaterials().size() == 4);
+  ASH_CHECK(pack.getMaterials()[0].diffuseTexture ==
+            pack.getMaterials()[2].diffuseTexture);
+  ASH_CHECK(pack.getMaterials()[1].diffuseTexture == ASSET_PACK_NO_TEXTURE);
+
+  const AssetPackTexture &stone =
+      pack.getTextures()[pack.getMaterials()[3].diffuseTexture];
+  ASH_CHECK(pack.getString(stone.path) == "stone.png");
+
+  ASH_CHECK(pack.getDependencies().size() == 2);
+  ASH_CHECK(pack.getString(pack.getDependencies()[1].path) == "model.mtl");
+  ASH_CHECK(pack.getDependencies()[1].hash == 2);
+
+  for (size_t i = 0; i < model.meshes.size(); i++) {
+    const ImportedMesh &mesh = model.meshes[i];
+    const AssetPackMesh &entry = pack.getMeshes()[i];
+
+    ASH_CHECK(entry.dataOffset % ASSET_PACK_ALIGNMENT == 0);
+    ASH_CHECK(entry.material == mesh.material);
+    ASH_CHECK(entry.indexCount == mesh.indices.size());
+    ASH_CHECK(entry.boundsMax[0] == mesh.boundsMax.x);
+
+    // Indices follow the vertices in the same blob
+    const char *data = pack.getData(entry.dataOffset);
+    ASH_CHECK(entry.vertexSize == mesh.vertices.size() * sizeof(Vertex));
+    ASH_CHECK(std::memcmp(data, mesh.vertices.data(), entry.vertexSize) == 0);
+    ASH_CHECK(std::memcmp(data + entry.vertexSize, mesh.indices.data(),
+                          mesh.indices.size() * sizeof(uint32_t)) == 0);
+  }
+}
+
+ASH_TEST(AssetPack, RejectsDamagedPacks) {
+  std::string path = Test::getTempPath("damaged.ashpack");
+  ASH_CHECK(writeAssetPack(path, makeModel(), 0, {}));
+  std::string contents = readFile(path);
+
+  AssetPack pack;
+  ASH_CHECK(!pack.open(Test::getTempPath("missing.ashpack")));
+  ASH_CHECK(!pack.open(Test::writeTempFile("empty.ashpack", "")));
+  ASH_CHECK(!pack.open(
+      Test::writeTempFile("truncated.ashpack", contents.substr(0, 64))));
+  ASH_CHECK(!pack.open(Test::writeTempFile(
+      "short.ashpack", contents.substr(0, contents.size() - 1))));
+
+  std::string magic = contents;
+  magic[0] = 'X';
+  ASH_CHECK(!pack.open(Test::writeTempFile("magic.ashpack", magic)));
+
+  // A mesh pointing at a material that doesn't exist
+  std::string material = contents;
+  AssetPackHeader header;
+  std::memcpy(&header, material.data(), sizeof(header));
+  uint32_t invalid = header.materialCount;
+  std::memcpy(material.data() + header.meshOffset +
+                  offsetof(AssetPackMesh, material),
+              &invalid, sizeof(invalid));
+  ASH_CHECK(!pack.open(Test::writeTempFile("material.ashpack", material)));
+
+  ASH_CHECK(pack.open(Test::writeTempFile("intact.ashpack", contents)));
+}
+
+ASH_TEST(AssetPack, SourceHashFollowsContents) {
+  std::string path = Test::writeTempFile("source.obj", "v 0 0 0\n");
+  uint64_t hash = hashAssetPackSource(path);
+  ASH_CHECK(hash != 0);
+  ASH_CHECK(hashAssetPackSource(path) == hash);
+
+  Test::writeTempFile("source.obj", "v 0 0 1\n");
+  uint64_t changed = hashAssetPackSource(path);
+  ASH_CHECK(changed != hash);
+  ASH_CHECK(hashAssetPackSource(Test::getTempPath("missing.obj")) == 0);
+
+  // Import flags and every source take part in the combined hash
+  std::vector<AssetPackSource> sources{{path, hash}};
+  uint64_t combined = hashAssetPackSources(sources, 0);
+  ASH_CHECK(hashAssetPackSources(sources, 1) != combined);
+  sources[0].hash = changed;
+  ASH_CHECK(hashAssetPackSources(sources, 0) != combined);
+}
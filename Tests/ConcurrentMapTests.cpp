@@ -0,0 +1,111 @@
+#include <ConcurrentMap.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+ASH_TEST(ConcurrentMap, InsertKeepsTheFirstValue) {
+  ConcurrentMap<std::string, int> map;
+  ASH_CHECK(map.insert("a", 1) == 1);
+  ASH_CHECK(map.insert("a", 2) == 1);
+
+  int value = 0;
+  ASH_CHECK(map.find("a", value) && value == 1);
+  ASH_CHECK(!map.find("b", value));
+
+  map.assign("a", 3);
+  ASH_CHECK(map.find("a", value) && value == 3);
+}
+
+ASH_TEST(ConcurrentMap, EraseOnlyMatchingValues) {
+  ConcurrentMap<std::string, int> map;
+  map.insert("a", 1);
+
+  ASH_CHECK(!map.erase("a", 2));
+  ASH_CHECK(map.contains("a"));
+  ASH_CHECK(map.erase("a", 1));
+  ASH_CHECK(!map.contains("a"));
+  ASH_CHECK(!map.erase("a"));
+
+  for (int i = 0; i < 100; i++)
+    map.insert(std::to_string(i), i);
+  map.eraseIf([](const std::string &, int value) { return value % 2 == 0; });
+
+  int value = 0;
+  ASH_CHECK(!map.contains("10"));
+  ASH_CHECK(map.find("11", value) && value == 11);
+}
+
+ASH_TEST(ConcurrentMap, ReadersSeeWholeValues) {
+  // Writers flip every key between two values readers can tell apart
+  ConcurrentMap<int, std::string> map;
+  for (int i = 0; i < 64; i++)
+    map.insert(i, "even");
+
+  std::atomic<bool> stop{false};
+  std::atomic<bool> consistent{true};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++)
+    readers.emplace_back([&]() {
+      std::string value;
+      while (!stop)
+        for (int i = 0; i < 64; i++)
+          if (map.find(i, value) && value != "even" && value != "odd")
+            consistent = false;
+    });
+
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < 64; i++)
+      map.assign(i, round % 2 ? "odd" : "even");
+    if (round % 10 == 0)
+      map.eraseIf([](int key, const std::string &) { return key % 7 == 0; });
+  }
+
+  stop = true;
+  for (std::thread &reader : readers)
+    reader.join();
+  ASH_CHECK(consistent);
+}
+
+ASH_TEST(ConcurrentMap, KeepsEveryKeyWhileGrowing) {
+  // Enough keys to double every shard's buckets several times
+  ConcurrentMap<int, int> map;
+  for (int i = 0; i < 5000; i++)
+    ASH_CHECK(map.insert(i, i) == i);
+
+  for (int i = 0; i < 5000; i += 3)
+    ASH_CHECK(map.erase(i));
+  for (int i = 1; i < 5000; i += 3)
+    map.assign(i, -i);
+
+  bool consistent = true;
+  for (int i = 0; i < 5000; i++) {
+    int value = 0;
+    bool found = map.find(i, value);
+    if (i % 3 == 0)
+      consistent &= !found;
+    else
+      consistent &= found && value == (i % 3 == 1 ? -i : i);
+  }
+  ASH_CHECK(consistent);
+
+  std::atomic<bool> stop{false};
+  std::atomic<bool> missing{false};
+  std::thread reader([&]() {
+    int value = 0;
+    while (!stop)
+      for (int i = 2; i < 5000; i += 3)
+        if (!map.find(i, value))
+          missing = true;
+  });
+  for (int i = 5000; i < 20000; i++)
+    map.insert(i, i);
+  stop = true;
+  reader.join();
+  ASH_CHECK(!missing);
+}
@@ -0,0 +1,85 @@
+#include <ContentStore.h>
+#include <Hash.h>
+
+#include <string>
+
+#include "Test.h"
+
+using namespace Ash;
+
+namespace {
+
+// Loads data the way the renderer loads meshes and textures: a resource is
+// shared only when the bytes behind a matching key compare equal
+struct Store {
+  SlotMap<std::string> resources;
+  ContentStore<std::string> contents;
+
+  Handle<std::string> load(uint64_t key, const std::string &data) {
+    Handle<std::string> shared =
+        contents.find(key, [&](Handle<std::string> candidate) {
+          return resources.get(candidate) == data;
+        });
+    if (shared.isValid())
+      return shared;
+
+    Handle<std::string> handle = resources.insert(data);
+    contents.insert(key, handle);
+    return handle;
+  }
+
+  Handle<std::string> loadHashed(const std::string &data) {
+    return load(hash64(data.data(), data.size()), data);
+  }
+};
+
+} // namespace
+
+ASH_TEST(ContentStore, IdenticalDataSharesOneHandle) {
+  Store store;
+  Handle<std::string> first = store.loadHashed("vertices");
+  Handle<std::string> second = store.loadHashed("vertices");
+  ASH_CHECK(first == second);
+  ASH_CHECK(store.contents.size() == 1);
+
+  // Textures are keyed by their encoded size instead
+  ASH_CHECK(store.load(4, "abcd") == store.load(4, "abcd"));
+}
+
+ASH_TEST(ContentStore, CollidingKeysNeverAlias) {
+  Store store;
+
+  // Same hash but a different size, like two meshes whose hashes collide
+  Handle<std::string> shorter = store.load(42, "abc");
+  Handle<std::string> longer = store.load(42, "abcd");
+  ASH_CHECK(shorter != longer);
+
+  // Same size but different bytes, like two textures keyed by file size
+  Handle<std::string> other = store.load(42, "abce");
+  ASH_CHECK(other != longer);
+  ASH_CHECK(store.contents.size() == 3);
+
+  // Every resource under the key is still found by its own data
+  ASH_CHECK(store.load(42, "abc") == shorter);
+  ASH_CHECK(store.load(42, "abcd") == longer);
+  ASH_CHECK(store.load(42, "abce") == other);
+}
+
+ASH_TEST(ContentStore, EraseRemovesOnlyItsHandle) {
+  Store store;
+  Handle<std::string> first = store.load(7, "first");
+  Handle<std::string> second = store.load(7, "second");
+
+  store.contents.erase(7, first);
+  ASH_CHECK(store.contents.contains(7));
+  ASH_CHECK(store.contents.size() == 1);
+  ASH_CHECK(store.load(7, "second") == second);
+
+  // Erasing a handle that isn't stored leaves the rest alone
+  store.contents.erase(7, first);
+  store.contents.erase(8, second);
+  ASH_CHECK(store.contents.size() == 1);
+
+  store.contents.erase(7, second);
+  ASH_CHECK(!store.contents.contains(7));
+}
@@ -0,0 +1,141 @@
+#include <EntityCommandBuffer.h>
+#include <MainThread.h>
+#include <Scene.h>
+
+#include <utility>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+namespace {
+
+struct Value {
+  int value;
+};
+
+// Appends to a log when it's constructed, which shows the playback order
+struct Trace {
+  Trace(std::vector<int> *log, int value) : value(value) {
+    log->push_back(value);
+  }
+
+  int value;
+};
+
+struct Built {
+  Built(int value) : value(value), onMainThread(MainThread::isCurrent()) {}
+
+  int value;
+  bool onMainThread;
+};
+
+} // namespace
+
+static std::vector<entt::entity> spawnValues(Scene &scene, int count) {
+  for (int i = 0; i < count; i++) {
+    Entity entity = scene.spawn();
+    scene.addComponent<Value>(entity, Value{i});
+  }
+
+  // parallelEach keys commands by position in this order
+  auto view = scene.registry.view<Value>();
+  return {view.begin(), view.end()};
+}
+
+ASH_TEST(EntityCommandBuffer, PassesReplayInRecordingOrder) {
+  constexpr int COUNT = 5000;
+
+  Scene scene;
+  std::vector<entt::entity> order = spawnValues(scene, COUNT);
+  Entity marker = scene.spawn();
+
+  std::vector<int> log;
+  scene.addSystem<Read<Value>, Write<>>("record", [&](Scene &scene) {
+    EntityCommandBuffer &commands = scene.getCommands();
+    commands.add<Trace>(marker, &log, -1);
+
+    // Element i of both passes used to share a key
+    for (int pass = 0; pass < 2; pass++)
+      scene.parallelEach<Value>(
+          [&](entt::entity entity, Value &value) {
+            commands.add<Trace>(entity, &log, pass * COUNT + value.value);
+          },
+          64);
+
+    commands.add<Trace>(marker, &log, -2);
+  });
+
+  std::vector<int> expected{-1};
+  for (int pass = 0; pass < 2; pass++)
+    for (entt::entity entity : order)
+      expected.push_back(pass * COUNT +
+                         scene.registry.get<Value>(entity).value);
+  expected.push_back(-2);
+
+  for (int round = 0; round < 20; round++) {
+    log.clear();
+    scene.updateSystems();
+    ASH_CHECK(log == expected);
+  }
+}
+
+ASH_TEST(EntityCommandBuffer, SpawnsBuildComponentsOnPlayback) {
+  constexpr int COUNT = 3000;
+
+  auto run = [&]() {
+    Scene scene;
+    spawnValues(scene, COUNT);
+
+    scene.addSystem<Read<Value>, Write<>>("spawn", [](Scene &scene) {
+      EntityCommandBuffer &commands = scene.getCommands();
+      scene.parallelEach<Value>(
+          [&](entt::entity, Value &value) {
+            PendingEntity spawned = commands.spawn();
+            commands.add<Built>(spawned, value.value);
+            if (value.value % 2)
+              commands.destroy(spawned);
+          },
+          64);
+    });
+    scene.updateSystems();
+
+    std::vector<std::pair<entt::entity, int>> spawned;
+    scene.registry.view<Built>().each([&](entt::entity entity, Built &built) {
+      ASH_CHECK(built.onMainThread);
+      ASH_CHECK(built.value % 2 == 0);
+      spawned.emplace_back(entity, built.value);
+    });
+    return spawned;
+  };
+
+  std::vector<std::pair<entt::entity, int>> first = run();
+  ASH_CHECK(first.size() == COUNT / 2);
+
+  // Entities go to spawns in playback order, so ids don't depend on workers
+  for (int round = 0; round < 5; round++)
+    ASH_CHECK(run() == first);
+}
+
+ASH_TEST(EntityCommandBuffer, SkipsDestroyedEntities) {
+  Scene scene;
+  Entity kept = scene.spawn();
+  Entity destroyed = scene.spawn();
+  scene.addComponent<Value>(kept, Value{1});
+
+  EntityCommandBuffer &commands = scene.getCommands();
+  commands.add<Value>(destroyed, Value{2});
+  commands.destroy(destroyed);
+  commands.add<Value>(destroyed, Value{3});
+  commands.remove<Value>(kept);
+  commands.add<Built>(kept, 4);
+  ASH_CHECK(!commands.isEmpty());
+
+  commands.playback(scene.registry);
+
+  ASH_CHECK(commands.isEmpty());
+  ASH_CHECK(!scene.registry.valid(destroyed.getHandle()));
+  ASH_CHECK(!scene.registry.has<Value>(kept.getHandle()));
+  ASH_CHECK(scene.registry.get<Built>(kept.getHandle()).value == 4);
+}
@@ -0,0 +1,221 @@
+#include <GltfImporter.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+namespace {
+
+constexpr uint32_t BYTE = 5120;
+constexpr uint32_t SHORT = 5122;
+constexpr uint32_t UNSIGNED_SHORT = 5123;
+
+std::string encodeBase64(const std::vector<char> &data) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  std::string text;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t bits = static_cast<uint8_t>(data[i]) << 16;
+    if (i + 1 < data.size())
+      bits |= static_cast<uint8_t>(data[i + 1]) << 8;
+    if (i + 2 < data.size())
+      bits |= static_cast<uint8_t>(data[i + 2]);
+
+    text += alphabet[bits >> 18 & 63];
+    text += alphabet[bits >> 12 & 63];
+    text += i + 1 < data.size() ? alphabet[bits >> 6 & 63] : '=';
+    text += i + 2 < data.size() ? alphabet[bits & 63] : '=';
+  }
+  return text;
+}
+
+template <typename T> void append(std::vector<char> &data, const T &value) {
+  const char *bytes = reinterpret_cast<const char *>(&value);
+  data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+// One triangle with positions at byte 0, texture coordinates at 36 and
+// indices at 60
+std::vector<char> makeTriangleBuffer(uint16_t lastIndex = 2) {
+  std::vector<char> data;
+  for (float value : {0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f})
+    append(data, value);
+  for (float value : {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.25f})
+    append(data, value);
+  for (uint16_t value : {uint16_t(0), uint16_t(1), lastIndex})
+    append(data, value);
+  data.resize(68);
+  return data;
+}
+
+struct TriangleOptions {
+  uint32_t indexType{UNSIGNED_SHORT};
+  uint32_t indexCount{3};
+  std::string node{R"("translation": [0, 0, 5])"};
+  std::string material{R"(, "material": 0)"};
+};
+
+std::string makeTriangleJson(const std::string &buffer,
+                             const TriangleOptions &options = {}) {
+  return R"({
+    "asset": {"version": "2.0"},
+    "scene": 0,
+    "scenes": [{"nodes": [0]}],
+    "nodes": [{"mesh": 0, )" +
+         options.node + R"(}],
+    "meshes": [{"primitives": [{
+      "attributes": {"POSITION": 0, "TEXCOORD_0": 1},
+      "indices": 2)" +
+         options.material + R"(
+    }]}],
+    "materials": [{"pbrMetallicRoughness": {"baseColorTexture": {"index": 0}}}],
+    "textures": [{"source": 0}],
+    "images": [{"uri": "base%20color.png"}],
+    "accessors": [
+      {"bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3"},
+      {"bufferView": 1, "componentType": 5126, "count": 3, "type": "VEC2"},
+      {"bufferView": 2, "componentType": )" +
+         std::to_string(options.indexType) + R"(, "count": )" +
+         std::to_string(options.indexCount) + R"(, "type": "SCALAR"}
+    ],
+    "bufferViews": [
+      {"buffer": 0, "byteOffset": 0, "byteLength": 36},
+      {"buffer": 0, "byteOffset": 36, "byteLength": 24},
+      {"buffer": 0, "byteOffset": 60, "byteLength": 6}
+    ],
+    "buffers": [{"byteLength": 68)" +
+         buffer + R"(}]
+  })";
+}
+
+std::string writeTriangle(const TriangleOptions &options = {},
+                          const std::vector<char> &data =
+                              makeTriangleBuffer()) {
+  std::string uri = R"(, "uri": "data:application/octet-stream;base64,)" +
+                    encodeBase64(data) + "\"";
+  return Test::writeTempFile("triangle.gltf", makeTriangleJson(uri, options));
+}
+
+} // namespace
+
+ASH_TEST(GltfImporter, ImportsEmbeddedTriangle) {
+  ImportedModel model;
+  ASH_CHECK(Helper::importGltf(writeTriangle(), model));
+
+  ASH_CHECK(model.materials.size() == 1);
+  ASH_CHECK(model.materials[0] == "base color.png");
+  ASH_CHECK(model.sourceFiles.size() == 1);
+  ASH_CHECK(model.instances.empty());
+
+  ASH_CHECK(model.meshes.size() == 1);
+  const ImportedMesh &mesh = model.meshes[0];
+  ASH_CHECK(mesh.vertices.size() == 3);
+  ASH_CHECK((mesh.indices == std::vector<uint32_t>{0, 1, 2}));
+
+  // Flattening applies the node's translation, V is flipped
+  ASH_CHECK(mesh.vertices[1].pos == glm::vec3(1.0f, 0.0f, 5.0f));
+  ASH_CHECK(mesh.vertices[2].texCoord == glm::vec2(0.0f, 0.75f));
+  ASH_CHECK(mesh.boundsMin == glm::vec3(0.0f, 0.0f, 5.0f));
+  ASH_CHECK(mesh.boundsMax == glm::vec3(1.0f, 1.0f, 5.0f));
+}
+
+ASH_TEST(GltfImporter, KeepsHierarchy) {
+  ImportedModel model;
+  ASH_CHECK(
+      Helper::importGltf(writeTriangle(), model, ImportMode::Hierarchy));
+
+  ASH_CHECK(model.meshes.size() == 1);
+  ASH_CHECK(model.meshes[0].vertices[1].pos == glm::vec3(1.0f, 0.0f, 0.0f));
+
+  ASH_CHECK(model.instances.size() == 1);
+  ASH_CHECK(model.instances[0].meshes == std::vector<uint32_t>{0});
+  ASH_CHECK(model.instances[0].transform[3] ==
+            glm::vec4(0.0f, 0.0f, 5.0f, 1.0f));
+}
+
+ASH_TEST(GltfImporter, PrimitivesWithoutMaterialUseADefault) {
+  TriangleOptions options;
+  options.material.clear();
+
+  ImportedModel model;
+  ASH_CHECK(Helper::importGltf(writeTriangle(options), model));
+  ASH_CHECK(model.materials.size() == 2 && model.materials[1].empty());
+  ASH_CHECK(model.meshes.size() == 1 && model.meshes[0].material == 1);
+}
+
+ASH_TEST(GltfImporter, ImportsBinary) {
+  std::string json = makeTriangleJson("");
+  json.resize((json.size() + 3) & ~size_t(3), ' ');
+  std::vector<char> buffer = makeTriangleBuffer();
+
+  std::vector<char> data;
+  append(data, uint32_t(0x46546C67));
+  append(data, uint32_t(2));
+  append(data, uint32_t(12 + 8 + json.size() + 8 + buffer.size()));
+  append(data, uint32_t(json.size()));
+  append(data, uint32_t(0x4E4F534A));
+  data.insert(data.end(), json.begin(), json.end());
+  append(data, uint32_t(buffer.size()));
+  append(data, uint32_t(0x004E4942));
+  data.insert(data.end(), buffer.begin(), buffer.end());
+
+  std::string file = Test::writeTempFile(
+      "triangle.glb", std::string(data.data(), data.size()));
+
+  ImportedModel model;
+  ASH_CHECK(Helper::importGltf(file, model));
+  ASH_CHECK(model.meshes.size() == 1);
+  ASH_CHECK(model.meshes[0].vertices.size() == 3);
+
+  // Cutting the binary chunk short is caught before any buffer is read
+  std::string truncated = Test::writeTempFile(
+      "truncated.glb", std::string(data.data(), data.size() - 8));
+  ImportedModel truncatedModel;
+  ASH_CHECK(!Helper::importGltf(truncated, truncatedModel));
+}
+
+ASH_TEST(GltfImporter, RejectsSignedIndices) {
+  for (uint32_t type : {BYTE, SHORT}) {
+    TriangleOptions options;
+    options.indexType = type;
+
+    ImportedModel model;
+    ASH_CHECK(!Helper::importGltf(writeTriangle(options), model));
+  }
+}
+
+ASH_TEST(GltfImporter, RejectsOutOfRangeIndices) {
+  ImportedModel model;
+  ASH_CHECK(!Helper::importGltf(writeTriangle({}, makeTriangleBuffer(3)),
+                                model));
+}
+
+ASH_TEST(GltfImporter, RejectsAccessorsPastTheirView) {
+  TriangleOptions options;
+  options.indexCount = 4;
+
+  ImportedModel model;
+  ASH_CHECK(!Helper::importGltf(writeTriangle(options), model));
+}
+
+ASH_TEST(GltfImporter, RejectsUnsupportedDocuments) {
+  const char *documents[] = {
+      R"({"asset": {"version": "1.0"}})",
+      R"({"asset": {"version": "2.0"},
+          "extensionsRequired": ["KHR_draco_mesh_compression"]})",
+      R"({"asset": {"version": "2.0"}})",
+      R"({"asset": {"version": "2.0"}, "scenes": [{"nodes": [0]}],
+          "nodes": [{"children": [0]}]})",
+  };
+
+  for (const char *document : documents) {
+    ImportedModel model;
+    ASH_CHECK(!Helper::importGltf(
+        Test::writeTempFile("unsupported.gltf", document), model));
+  }
+}
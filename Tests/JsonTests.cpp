@@ -0,0 +1,83 @@
+#include <Json.h>
+
+#include <string>
+
+#include "Test.h"
+
+using namespace Ash;
+
+ASH_TEST(Json, ParsesNestedValues) {
+  JsonValue json;
+  std::string error;
+  ASH_CHECK(JsonValue::parse(R"({
+    "asset": {"version": "2.0"},
+    "numbers": [0, -1.5, 2e3, 4294967295],
+    "flags": [true, false, null],
+    "empty": {}
+  })",
+                             json, &error));
+  ASH_CHECK(error.empty());
+
+  ASH_CHECK(json.isObject());
+  ASH_CHECK(json["asset"]["version"].asString() == "2.0");
+  ASH_CHECK(json["numbers"].size() == 4);
+  ASH_CHECK(json["numbers"][1].asNumber() == -1.5);
+  ASH_CHECK(json["numbers"][2].asUint() == 2000);
+  ASH_CHECK(json["numbers"][3].asUint() == 4294967295u);
+  ASH_CHECK(json["flags"][0].asBool());
+  ASH_CHECK(!json["flags"][1].asBool(true));
+  ASH_CHECK(json["flags"][2].isNull());
+  ASH_CHECK(json["empty"].isObject() && json["empty"].size() == 0);
+
+  // Keys stay in file order
+  ASH_CHECK(json.getKeys().size() == 4 && json.getKeys()[1] == "numbers");
+}
+
+ASH_TEST(Json, MissingValuesChainToNull) {
+  JsonValue json;
+  ASH_CHECK(JsonValue::parse(R"({"a": [1]})", json));
+
+  ASH_CHECK(json["missing"]["deeper"][3].isNull());
+  ASH_CHECK(json["a"][5].isNull());
+  ASH_CHECK(!json.contains("missing"));
+  ASH_CHECK(json["missing"].asUint(7) == 7);
+}
+
+ASH_TEST(Json, AsUintRejectsNonIntegers) {
+  JsonValue json;
+  ASH_CHECK(JsonValue::parse("[-1, 1.5, 4294967296, \"1\"]", json));
+
+  for (const JsonValue &value : json.getValues())
+    ASH_CHECK(value.asUint(9) == 9);
+}
+
+ASH_TEST(Json, DecodesEscapes) {
+  JsonValue json;
+  ASH_CHECK(JsonValue::parse(R"(["a\"b\\c\/d\n", "\u00e9", "\ud83d\ude00"])",
+                             json));
+
+  ASH_CHECK(json[0].asString() == "a\"b\\c/d\n");
+  ASH_CHECK(json[1].asString() == "\xC3\xA9");
+  ASH_CHECK(json[2].asString() == "\xF0\x9F\x98\x80");
+}
+
+ASH_TEST(Json, RejectsMalformedDocuments) {
+  const char *documents[] = {
+      "",         "{",           "[1, 2",         "{\"a\" 1}", "[1,]",
+      "{\"a\":}", "\"unclosed",  "\"bad \\x\"",   "tru",       "[1] 2",
+      "-",        "{1: 2}",      "[\"\\u12\"]",
+  };
+
+  for (const char *document : documents) {
+    JsonValue json;
+    std::string error;
+    bool parsed = JsonValue::parse(document, json, &error);
+    ASH_CHECK(!parsed);
+    ASH_CHECK(parsed || !error.empty());
+  }
+}
+
+ASH_TEST(Json, RejectsDeepNesting) {
+  JsonValue json;
+  ASH_CHECK(!JsonValue::parse(std::string(100000, '['), json));
+}
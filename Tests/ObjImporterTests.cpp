@@ -0,0 +1,76 @@
+#include <ObjImporter.h>
+
+#include <string>
+
+#include "Test.h"
+
+using namespace Ash;
+
+ASH_TEST(ObjImporter, SharesVerticesAndSplitsByMaterial) {
+  Test::writeTempFile("materials.mtl", "newmtl red\n"
+                                       "map_Kd -bm 1.0 red.png\n"
+                                       "newmtl blue\n");
+  std::string file = Test::writeTempFile("quad.obj",
+                                         "mtllib materials.mtl\n"
+                                         "v 0 0 0\n"
+                                         "v 1 0 0\n"
+                                         "v 1 1 0\n"
+                                         "v 0 1 0\n"
+                                         "vt 0 0\n"
+                                         "vn 0 0 1\n"
+                                         "usemtl red\n"
+                                         "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                                         "usemtl blue\n"
+                                         "f -4 -3 -2\n");
+
+  ImportedModel model;
+  ASH_CHECK(Helper::importObj(file, model));
+
+  ASH_CHECK(model.materials.size() == 2);
+  ASH_CHECK(model.materials[0] == "red.png");
+  ASH_CHECK(model.materials[1].empty());
+  ASH_CHECK(model.sourceFiles.size() == 2);
+
+  // The quad is fanned into two triangles sharing two corners
+  ASH_CHECK(model.meshes.size() == 2);
+  const ImportedMesh &quad = model.meshes[0];
+  ASH_CHECK(quad.material == 0);
+  ASH_CHECK(quad.vertices.size() == 4);
+  ASH_CHECK(quad.indices.size() == 6);
+  ASH_CHECK(quad.boundsMin == glm::vec3(0.0f));
+  ASH_CHECK(quad.boundsMax == glm::vec3(1.0f, 1.0f, 0.0f));
+  ASH_CHECK(quad.vertices[0].normal == glm::vec3(0.0f, 0.0f, 1.0f));
+
+  // Negative indices count back from the last position
+  const ImportedMesh &triangle = model.meshes[1];
+  ASH_CHECK(triangle.material == 1);
+  ASH_CHECK(triangle.vertices.size() == 3);
+  ASH_CHECK(triangle.vertices[2].pos == glm::vec3(1.0f, 1.0f, 0.0f));
+  ASH_CHECK(triangle.vertices[0].normal == glm::vec3(0.0f));
+}
+
+ASH_TEST(ObjImporter, FacesWithoutMaterialUseADefault) {
+  std::string file =
+      Test::writeTempFile("plain.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+
+  ImportedModel model;
+  ASH_CHECK(Helper::importObj(file, model));
+  ASH_CHECK(model.meshes.size() == 1);
+  ASH_CHECK(model.materials.size() == 1 && model.materials[0].empty());
+}
+
+ASH_TEST(ObjImporter, RejectsInvalidFaces) {
+  const char *faces[] = {"f 1 2 4\n", "f 0 1 2\n", "f 1 2 -4\n",
+                         "f 1/x 2 3\n", "f 1/1 2 3\n"};
+
+  for (const char *face : faces) {
+    std::string file = Test::writeTempFile(
+        "invalid.obj", std::string("v 0 0 0\nv 1 0 0\nv 0 1 0\n") + face);
+
+    ImportedModel model;
+    ASH_CHECK(!Helper::importObj(file, model));
+  }
+
+  ImportedModel model;
+  ASH_CHECK(!Helper::importObj(Test::getTempPath("missing.obj"), model));
+}
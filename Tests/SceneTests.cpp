@@ -0,0 +1,133 @@
+#include <MainThread.h>
+#include <Scene.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+namespace {
+
+struct Position {
+  float x;
+};
+
+struct Velocity {
+  float x;
+};
+
+// Counts the systems running at once and remembers the most it ever saw
+struct Occupancy {
+  std::atomic<uint32_t> running{0};
+  std::atomic<uint32_t> peak{0};
+
+  void enter() {
+    uint32_t now = ++running;
+    uint32_t seen = peak;
+    while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+    }
+  }
+
+  void leave() { running--; }
+};
+
+// Long enough for the workers to pick up anything else that could overlap
+void linger() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+
+} // namespace
+
+ASH_TEST(Scene, WritersOfOneComponentNeverOverlap) {
+  Scene scene;
+  Occupancy writers;
+  std::vector<int> order;
+
+  for (int i = 0; i < 3; i++)
+    scene.addSystem<Read<>, Write<Position>>(
+        "write" + std::to_string(i), [&, i](Scene &) {
+          writers.enter();
+          order.push_back(i);
+          linger();
+          writers.leave();
+        });
+  // Unrelated, free to run alongside them
+  scene.addSystem<Read<>, Write<Velocity>>("other", [](Scene &) { linger(); });
+
+  for (int frame = 0; frame < 10; frame++)
+    scene.updateSystems();
+
+  ASH_CHECK(writers.peak == 1);
+
+  // Conflicting systems also keep their registration order
+  bool ordered = order.size() == 30;
+  for (size_t i = 0; ordered && i < order.size(); i++)
+    ordered = order[i] == static_cast<int>(i % 3);
+  ASH_CHECK(ordered);
+}
+
+ASH_TEST(Scene, ReadersRunConcurrently) {
+  Scene scene;
+
+  // Each reader waits for the other to start, which only happens if they
+  // are in flight at the same time. The timeout keeps a failure from hanging
+  std::atomic<uint32_t> arrived{0};
+  std::atomic<uint32_t> met{0};
+  auto reader = [&](Scene &) {
+    arrived++;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (arrived < 2 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::yield();
+    if (arrived >= 2)
+      met++;
+  };
+  scene.addSystem<Read<Position>, Write<>>("first", reader);
+  scene.addSystem<Read<Position>, Write<>>("second", reader);
+
+  scene.updateSystems();
+  ASH_CHECK(met == 2);
+}
+
+ASH_TEST(Scene, ExclusiveSystemsRunAlone) {
+  Scene scene;
+  Occupancy systems;
+  std::atomic<bool> alone{true};
+  std::atomic<uint32_t> before{0};
+  std::atomic<uint32_t> after{0};
+
+  auto parallel = [&](std::atomic<uint32_t> &runs) {
+    return [&](Scene &) {
+      systems.enter();
+      linger();
+      runs++;
+      systems.leave();
+    };
+  };
+  scene.addSystem<Read<Position>, Write<>>("before0", parallel(before));
+  scene.addSystem<Read<Position>, Write<>>("before1", parallel(before));
+  scene.addExclusiveSystem("exclusive", [&](Scene &) {
+    // Everything registered before it is done and nothing after has started
+    if (systems.running != 0 || !MainThread::isCurrent())
+      alone = false;
+    if (before != 2 || after != 0)
+      alone = false;
+    linger();
+    if (systems.running != 0)
+      alone = false;
+  });
+  scene.addSystem<Read<Position>, Write<>>("after0", parallel(after));
+  scene.addSystem<Read<Position>, Write<>>("after1", parallel(after));
+
+  for (int frame = 0; frame < 10; frame++) {
+    before = 0;
+    after = 0;
+    scene.updateSystems();
+  }
+
+  ASH_CHECK(alone);
+  ASH_CHECK(after == 2);
+}
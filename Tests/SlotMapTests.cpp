@@ -0,0 +1,94 @@
+#include <SlotMap.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+ASH_TEST(SlotMap, ErasedHandlesGoStale) {
+  SlotMap<std::string> map;
+  Handle<std::string> first = map.insert("first");
+  ASH_CHECK(map.contains(first));
+  ASH_CHECK(map.get(first) == "first");
+
+  map.erase(first);
+  ASH_CHECK(!map.contains(first));
+  ASH_CHECK(map.find(first) == nullptr);
+
+  // The slot is reused under a new generation
+  Handle<std::string> second = map.insert("second");
+  ASH_CHECK(second.index == first.index);
+  ASH_CHECK(second.generation != first.generation);
+  ASH_CHECK(!map.contains(first));
+  ASH_CHECK(*map.find(second) == "second");
+  ASH_CHECK(map.size() == 1);
+
+  // Erasing a stale handle leaves the new value alone
+  map.erase(first);
+  ASH_CHECK(map.contains(second));
+}
+
+ASH_TEST(SlotMap, InvalidHandlesAreNeverContained) {
+  SlotMap<int> map;
+  ASH_CHECK(!map.contains(Handle<int>{}));
+  ASH_CHECK(!map.contains(Handle<int>{5, 0}));
+
+  map.insert(1);
+  ASH_CHECK(!map.contains(Handle<int>{}));
+}
+
+ASH_TEST(SlotMap, ForEachVisitsOccupiedSlots) {
+  SlotMap<int> map;
+  std::vector<Handle<int>> handles;
+  for (int i = 0; i < 10; i++)
+    handles.push_back(map.insert(i));
+  for (int i = 0; i < 10; i += 2)
+    map.erase(handles[i]);
+
+  int sum = 0;
+  int visited = 0;
+  map.forEach([&](Handle<int> handle, int value) {
+    ASH_CHECK(map.contains(handle));
+    sum += value;
+    visited++;
+  });
+  ASH_CHECK(visited == 5);
+  ASH_CHECK(sum == 1 + 3 + 5 + 7 + 9);
+}
+
+ASH_TEST(SlotMap, LookupsWhileInserting) {
+  constexpr int COUNT = 20000;
+
+  // Enough values to publish new pages while readers look up older ones
+  SlotMap<int> map;
+  std::vector<Handle<int>> handles(COUNT);
+  std::atomic<int> published{0};
+  std::atomic<bool> consistent{true};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; r++)
+    readers.emplace_back([&]() {
+      while (published < COUNT) {
+        int count = published.load();
+        for (int i = count > 64 ? count - 64 : 0; i < count; i++) {
+          int *value = map.find(handles[i]);
+          if (!value || *value != i)
+            consistent = false;
+        }
+      }
+    });
+
+  for (int i = 0; i < COUNT; i++) {
+    handles[i] = map.insert(i);
+    published.store(i + 1);
+  }
+
+  for (std::thread &reader : readers)
+    reader.join();
+  ASH_CHECK(consistent);
+  ASH_CHECK(map.size() == COUNT);
+}
@@ -0,0 +1,109 @@
+#include <MainThread.h>
+#include <Task.h>
+#include <ThreadPool.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include "Test.h"
+
+using namespace Ash;
+
+static Task<int> ready(int value) { co_return value; }
+
+static Task<std::thread::id> onWorker() {
+  co_await ThreadPool::schedule();
+  co_return std::this_thread::get_id();
+}
+
+static Task<int> throwing() {
+  co_await ThreadPool::schedule();
+  throw std::runtime_error("failed");
+}
+
+// Pumps main thread jobs like the frame loop until the task finishes
+template <typename T> static void runUntilReady(Task<T> &task) {
+  while (!task.isReady()) {
+    MainThread::update();
+    std::this_thread::yield();
+  }
+}
+
+ASH_TEST(Task, StartsEagerly) {
+  Task<int> task = ready(7);
+  ASH_CHECK(task.isValid());
+  ASH_CHECK(task.isReady());
+  ASH_CHECK(task.get() == 7);
+}
+
+ASH_TEST(Task, AwaitsAcrossThreads) {
+  // The awaiting task goes on where the awaited one finished
+  auto outer = []() -> Task<bool> {
+    std::thread::id worker = co_await onWorker();
+    co_return worker == std::this_thread::get_id() &&
+        ThreadPool::isWorkerThread();
+  };
+
+  Task<bool> task = outer();
+  runUntilReady(task);
+  ASH_CHECK(task.get());
+}
+
+ASH_TEST(Task, RethrowsExceptions) {
+  Task<int> task = throwing();
+  runUntilReady(task);
+
+  bool thrown = false;
+  try {
+    task.get();
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  ASH_CHECK(thrown);
+
+  auto awaiting = []() -> Task<bool> {
+    try {
+      co_await throwing();
+    } catch (const std::runtime_error &) {
+      co_return true;
+    }
+    co_return false;
+  };
+
+  Task<bool> caught = awaiting();
+  runUntilReady(caught);
+  ASH_CHECK(caught.get());
+}
+
+ASH_TEST(Task, ReturnsToTheMainThread) {
+  auto hop = []() -> Task<bool> {
+    co_await ThreadPool::schedule();
+    bool left = !MainThread::isCurrent();
+    co_await MainThread::schedule();
+    co_return left && MainThread::isCurrent();
+  };
+
+  Task<bool> task = hop();
+  runUntilReady(task);
+  ASH_CHECK(task.get());
+}
+
+ASH_TEST(Task, DroppedTaskFinishes) {
+  std::atomic<bool> finished{false};
+
+  // Destroying the frame runs the guard's destructor
+  struct Guard {
+    std::atomic<bool> *finished;
+    ~Guard() { *finished = true; }
+  };
+
+  auto detached = [](std::atomic<bool> *finished) -> Task<> {
+    Guard guard{finished};
+    co_await ThreadPool::schedule();
+  };
+
+  detached(&finished);
+  while (!finished)
+    std::this_thread::yield();
+}
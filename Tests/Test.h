@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Ash::Test {
+
+struct TestCase {
+  const char *suite;
+  const char *name;
+  void (*function)();
+};
+
+std::vector<TestCase> &getTests();
+
+// Marks the running test as failed, it keeps going to report further checks
+void fail(const char *file, int line, const char *expression);
+
+struct Registrar {
+  Registrar(const char *suite, const char *name, void (*function)()) {
+    getTests().push_back({suite, name, function});
+  }
+};
+
+// Scratch file under the system's temporary directory, unique per test run
+std::string getTempPath(const std::string &name);
+
+// Writes contents to a scratch file and returns its path
+std::string writeTempFile(const std::string &name, const std::string &contents);
+
+} // namespace Ash::Test
+
+// Tests are grouped in suites, one per file, which ctest runs separately
+#define ASH_TEST(suite, name)                                                  \
+  static void suite##_##name();                                                \
+  static Ash::Test::Registrar suite##_##name##_registrar(#suite, #name,        \
+                                                         &suite##_##name);     \
+  static void suite##_##name()
+
+#define ASH_CHECK(condition)                                                   \
+  do {                                                                         \
+    if (!(condition))                                                          \
+      Ash::Test::fail(__FILE__, __LINE__, #condition);                         \
+  } while (0)
@@ -0,0 +1,107 @@
+#include <ThreadPool.h>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "Test.h"
+
+using namespace Ash;
+
+ASH_TEST(ThreadPool, ParallelForVisitsEachIndexOnce) {
+  constexpr size_t COUNT = 100000;
+
+  auto visits = std::make_unique<std::atomic<uint32_t>[]>(COUNT);
+  ThreadPool::parallelFor(COUNT, 37, [&](size_t begin, size_t end) {
+    ASH_CHECK(begin < end && end - begin <= 37);
+    for (size_t i = begin; i < end; i++)
+      visits[i]++;
+  });
+
+  bool once = true;
+  for (size_t i = 0; i < COUNT; i++)
+    once = once && visits[i] == 1;
+  ASH_CHECK(once);
+}
+
+ASH_TEST(ThreadPool, NestedParallelForCompletes) {
+  // Outer chunks wait on inner ones, workers have to help or they deadlock
+  std::atomic<uint32_t> total{0};
+  ThreadPool::parallelFor(64, [&](size_t) {
+    ThreadPool::parallelFor(1000, 10, [&](size_t begin, size_t end) {
+      total += static_cast<uint32_t>(end - begin);
+    });
+  });
+
+  ASH_CHECK(total == 64000);
+}
+
+ASH_TEST(ThreadPool, SubmitReturnsResults) {
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < 200; i++)
+    futures.push_back(ThreadPool::submit([i]() { return i * 2; }));
+
+  int sum = 0;
+  for (std::future<int> &future : futures)
+    sum += ThreadPool::wait(future);
+  ASH_CHECK(sum == 199 * 200);
+}
+
+ASH_TEST(ThreadPool, WorkerIndicesAreInRange) {
+  ASH_CHECK(!ThreadPool::isWorkerThread());
+  ASH_CHECK(ThreadPool::getWorkerIndex() == -1);
+
+  int32_t count = static_cast<int32_t>(ThreadPool::getThreadCount());
+  std::atomic<bool> inRange{true};
+  ThreadPool::parallelFor(10000, 16, [&](size_t, size_t) {
+    int32_t index = ThreadPool::getWorkerIndex();
+    // The calling thread takes chunks too
+    if (index < -1 || index >= count ||
+        (index == -1) == ThreadPool::isWorkerThread())
+      inRange = false;
+  });
+
+  ASH_CHECK(inRange);
+}
+
+ASH_TEST(ThreadPool, JobGroupContinuationsRunAfterJobs) {
+  JobGroup group;
+  std::atomic<uint32_t> finished{0};
+  for (int i = 0; i < 1000; i++)
+    group.run([&]() { finished++; });
+
+  std::promise<uint32_t> seen;
+  group.then([&]() { seen.set_value(finished); });
+
+  std::future<uint32_t> future = seen.get_future();
+  ASH_CHECK(ThreadPool::wait(future) == 1000);
+
+  group.wait();
+  ASH_CHECK(group.isDone());
+
+  // A group that's done queues continuations straight away
+  std::promise<void> immediate;
+  group.then([&]() { immediate.set_value(); });
+  std::future<void> immediateFuture = immediate.get_future();
+  ThreadPool::wait(immediateFuture);
+}
+
+ASH_TEST(ThreadPool, JobGroupWaitOnWorkersCompletes) {
+  // More waiting jobs than workers, each waits on jobs queued behind it
+  std::vector<std::future<uint32_t>> outer;
+  for (int i = 0; i < 16; i++)
+    outer.push_back(ThreadPool::submit([]() {
+      JobGroup group;
+      std::atomic<uint32_t> count{0};
+      for (int j = 0; j < 100; j++)
+        group.run([&]() { count++; });
+      group.wait();
+      return count.load();
+    }));
+
+  bool complete = true;
+  for (std::future<uint32_t> &future : outer)
+    complete = complete && ThreadPool::wait(future) == 100;
+  ASH_CHECK(complete);
+}
@@ -0,0 +1,74 @@
+#include <Log.h>
+#include <MainThread.h>
+#include <ThreadPool.h>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Test.h"
+
+namespace Ash::Test {
+
+static bool failed = false;
+
+std::vector<TestCase> &getTests() {
+  static std::vector<TestCase> tests;
+  return tests;
+}
+
+void fail(const char *file, int line, const char *expression) {
+  std::printf("  %s:%d: check failed: %s\n", file, line, expression);
+  failed = true;
+}
+
+std::string getTempPath(const std::string &name) {
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "ash-tests";
+  std::filesystem::create_directories(directory);
+  return (directory / name).string();
+}
+
+std::string writeTempFile(const std::string &name,
+                          const std::string &contents) {
+  std::string path = getTempPath(name);
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      .write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  return path;
+}
+
+} // namespace Ash::Test
+
+using namespace Ash;
+
+// Runs every test, or only the suite named by the first argument
+int main(int argc, char **argv) {
+  Log::init();
+  MainThread::init();
+  // Enough workers for stealing and contention even on small machines
+  ThreadPool::init(4);
+
+  const char *suite = argc > 1 ? argv[1] : nullptr;
+
+  uint32_t run = 0;
+  uint32_t failures = 0;
+  for (const Test::TestCase &test : Test::getTests()) {
+    if (suite && std::strcmp(suite, test.suite) != 0)
+      continue;
+
+    Test::failed = false;
+    test.function();
+
+    run++;
+    if (Test::failed)
+      failures++;
+    std::printf("%s %s.%s\n", Test::failed ? "FAIL" : "ok  ", test.suite,
+                test.name);
+  }
+
+  ThreadPool::cleanup();
+
+  std::printf("%u of %u tests passed\n", run - failures, run);
+  return failures > 0 || run == 0 ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+#include <AssetPack.h>
+#include <Helper.h>
+#include <Log.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace Ash;
+
+// Flags passed to the importer on top of the defaults, part of the hash so
+// changing them re-cooks every pack
+static constexpr uint32_t COOK_IMPORT_FLAGS = 0;
+
+// Each importer is timed over this many imports of a model
+static constexpr uint32_t BENCHMARK_RUNS = 5;
+
+static bool isUpToDate(const std::string &output) {
+  AssetPack pack;
+  if (!pack.open(output))
+    return false;
+
+  std::vector<AssetPackSource> sources;
+  for (const AssetPackDependency &dependency : pack.getDependencies()) {
+    std::string path(pack.getString(dependency.path));
+    sources.push_back({path, hashAssetPackSource(path)});
+  }
+
+  return !sources.empty() &&
+         hashAssetPackSources(sources, COOK_IMPORT_FLAGS) ==
+             pack.getHeader().sourceHash;
+}
+
+static void benchmark(const std::string &input, ImportBackend backend,
+                      const char *label) {
+  float best = std::numeric_limits<float>::max();
+  float total = 0.0f;
+  size_t vertices = 0;
+  size_t meshes = 0;
+
+  for (uint32_t i = 0; i < BENCHMARK_RUNS; i++) {
+    auto start = std::chrono::steady_clock::now();
+
+    ImportedModel model;
+    if (!Helper::importScene(input, COOK_IMPORT_FLAGS, model, backend)) {
+      ASH_WARN("{}: failed to import {}", label, input);
+      return;
+    }
+
+    float milliseconds = std::chrono::duration<float, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    best = std::min(best, milliseconds);
+    total += milliseconds;
+
+    meshes = model.meshes.size();
+    vertices = 0;
+    for (const ImportedMesh &mesh : model.meshes)
+      vertices += mesh.vertices.size();
+  }
+
+  ASH_INFO("{}: {} best {:.2f}ms, mean {:.2f}ms, {} meshes, {} vertices",
+           label, input, best, total / BENCHMARK_RUNS, meshes, vertices);
+}
+
+int main(int argc, char **argv) {
+  Log::init();
+
+  bool force = false;
+  bool benchmarkImport = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--force")
+      force = true;
+    else if (arg == "--benchmark")
+      benchmarkImport = true;
+    else
+      paths.push_back(arg);
+  }
+
+  if (benchmarkImport && !paths.empty()) {
+    ThreadPool::init();
+    for (const std::string &path : paths) {
+      benchmark(path, ImportBackend::Native, "native");
+      benchmark(path, ImportBackend::Assimp, "assimp");
+    }
+    ThreadPool::cleanup();
+    return 0;
+  }
+
+  if (paths.empty() || paths.size() > 2) {
+    ASH_ERROR("Usage: ash-cook [--force] <model> [<output.ashpack>]\n"
+              "       ash-cook --benchmark <model>...");
+    return 1;
+  }
+
+  std::string input = paths[0];
+  std::string output =
+      paths.size() > 1
+          ? paths[1]
+          : std::filesystem::path(input).replace_extension(".ashpack").string();
+
+  // Only the stored sources are re-hashed, nothing is imported
+  if (!force && isUpToDate(output)) {
+    ASH_INFO("{} is up to date", output);
+    return 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  ThreadPool::init();
+  ImportedModel model;
+  bool imported = Helper::importScene(input, COOK_IMPORT_FLAGS, model);
+  ThreadPool::cleanup();
+  if (!imported)
+    return 1;
+
+  std::vector<AssetPackSource> sources;
+  for (const std::string &file : model.sourceFiles)
+    sources.push_back({file, hashAssetPackSource(file)});
+
+  std::filesystem::path outputDirectory =
+      std::filesystem::path(output).parent_path();
+  if (!outputDirectory.empty())
+    std::filesystem::create_directories(outputDirectory);
+
+  if (!writeAssetPack(output, model,
+                      hashAssetPackSources(sources, COOK_IMPORT_FLAGS),
+                      sources))
+    return 1;
+
+  float seconds = std::chrono::duration<float>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  ASH_INFO("Cooked {} meshes from {} into {} in {:.2f}s", model.meshes.size(),
+           input, output, seconds);
+
+  return 0;
+}
@@ -1,6 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Fixed per pipeline variant, the untaken paths are compiled out
+layout (constant_id = 0) const uint LIGHTING_MODEL = 1; // 0 unlit, 1 lambert
+layout (constant_id = 1) const bool ALPHA_TEST = false;
+
 layout (location = 0) in vec4 fragPos;
 layout (location = 1) in vec4 fragNormal;
 layout (location = 2) in vec2 fragTexCoord;
@@ -14,11 +18,22 @@ layout (binding = 1, set = 0) uniform LightBufferObject {
 layout (binding = 0, set = 1) uniform sampler2D diffuseSampler;
 
 void main() {
-    float ambientFactor = 0.1;
+    vec4 albedo = texture(diffuseSampler, fragTexCoord);
+
+    if (ALPHA_TEST && albedo.a < 0.5)
+        discard;
+
+    vec3 color = albedo.xyz;
+
+    if (LIGHTING_MODEL == 1) {
+        float ambientFactor = 0.1;
+
+        vec4 lightDir = normalize(lbo.pos - fragPos);
+        float diff = max(dot(fragNormal.xyz, lightDir.xyz), 0.0);
+        vec3 diffuse = diff * lbo.color.xyz;
 
-    vec4 lightDir = normalize(lbo.pos - fragPos);
-    float diff = max(dot(fragNormal.xyz, lightDir.xyz), 0.0);
-    vec3 diffuse = diff * lbo.color.xyz;
+        color *= ambientFactor + diffuse;
+    }
 
-    outColor = vec4((ambientFactor + diffuse) * texture(diffuseSampler, fragTexCoord).xyz, 1.0);
+    outColor = vec4(color, 1.0);
 }